@@ -0,0 +1,418 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+#include "clipboard.h"
+#include "logger.h"
+
+/* The most one splice or sendfile call moves at once. */
+#define CLIPBOARD_CHUNK (64 << 10)
+
+static void offer_unref(struct ClipboardOffer *offer)
+{
+	if (--offer->refs > 0)
+	{
+		return;
+	}
+
+	struct ClipboardMime *mime, *tmp;
+	wl_list_for_each_safe(mime, tmp, &offer->mimes, link)
+	{
+		if (mime->read != NULL)
+		{
+			wl_event_source_remove(mime->read);
+		}
+		if (mime->pipe >= 0)
+		{
+			close(mime->pipe);
+		}
+		close(mime->memfd);
+		wl_list_remove(&mime->link);
+		free(mime);
+	}
+	free(offer);
+}
+
+static void transfer_finish(struct ClipboardTransfer *transfer)
+{
+	if (transfer->write != NULL)
+	{
+		wl_event_source_remove(transfer->write);
+	}
+	close(transfer->fd);
+	wl_list_remove(&transfer->link);
+	offer_unref(transfer->mime->offer);
+	free(transfer);
+}
+
+static bool transfer_run(struct ClipboardTransfer *transfer)
+{
+	/* Returns false once the transfer is over, one way or another. */
+	struct Clipboard *clipboard = transfer->mime->offer->clipboard;
+	size_t size = transfer->mime->size;
+
+	while ((size_t)transfer->offset < size)
+	{
+		size_t chunk = size - transfer->offset;
+		ssize_t sent = sendfile(transfer->fd, transfer->mime->memfd, &transfer->offset,
+			chunk < CLIPBOARD_CHUNK ? chunk : CLIPBOARD_CHUNK);
+		if (sent < 0 && errno == EAGAIN)
+		{
+			return true;
+		}
+		if (sent <= 0)
+		{
+			if (sent < 0 && errno != EPIPE)
+			{
+				DEBUG_LOG_ERRNO("Clipboard paste failed");
+			}
+			return false;
+		}
+		clipboard->bytes_served += sent;
+	}
+	return false;
+}
+
+static int transfer_handle_writable(int fd, uint32_t mask, void *data)
+{
+	struct ClipboardTransfer *transfer = data;
+	if ((mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) || !transfer_run(transfer))
+	{
+		transfer_finish(transfer);
+	}
+	return 0;
+}
+
+static void offer_send(struct wlr_data_source *source, const char *mime_type, int32_t fd)
+{
+	struct ClipboardOffer *offer = wl_container_of(source, offer, base);
+	struct Clipboard *clipboard = offer->clipboard;
+
+	struct ClipboardMime *mime, *found = NULL;
+	wl_list_for_each(mime, &offer->mimes, link)
+	{
+		if (strcmp(mime->type, mime_type) == 0)
+		{
+			found = mime;
+			break;
+		}
+	}
+	struct ClipboardTransfer *transfer = found != NULL ? calloc(1, sizeof(*transfer)) : NULL;
+	if (transfer == NULL)
+	{
+		close(fd);
+		return;
+	}
+
+	clipboard->pastes++;
+	offer->refs++;
+	transfer->mime = found;
+	transfer->fd = fd;
+	wl_list_insert(&clipboard->transfers, &transfer->link);
+
+	/* Whatever fits into the reader's pipe goes out right away; the rest
+	 * follows whenever it drains, without ever blocking the compositor. */
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	if (!transfer_run(transfer))
+	{
+		transfer_finish(transfer);
+		return;
+	}
+	transfer->write = wl_event_loop_add_fd(clipboard->loop, fd, WL_EVENT_WRITABLE,
+		transfer_handle_writable, transfer);
+	if (transfer->write == NULL)
+	{
+		transfer_finish(transfer);
+	}
+}
+
+static void offer_destroy(struct wlr_data_source *source)
+{
+	struct ClipboardOffer *offer = wl_container_of(source, offer, base);
+	struct Clipboard *clipboard = offer->clipboard;
+
+	if (clipboard->current == offer)
+	{
+		clipboard->current = NULL;
+	}
+	if (clipboard->pending == offer)
+	{
+		clipboard->pending = NULL;
+	}
+	offer_unref(offer);
+}
+
+static const struct wlr_data_source_impl offer_impl = {
+	.send = offer_send,
+	.destroy = offer_destroy,
+};
+
+static void capture_stop(struct Clipboard *clipboard)
+{
+	if (clipboard->captured != NULL)
+	{
+		wl_list_remove(&clipboard->captured_destroy.link);
+		clipboard->captured = NULL;
+	}
+	if (clipboard->pending != NULL)
+	{
+		/* Never set as the selection, so this frees it right away. */
+		wlr_data_source_destroy(&clipboard->pending->base);
+	}
+}
+
+static void capture_complete(struct Clipboard *clipboard)
+{
+	struct ClipboardOffer *offer = clipboard->pending;
+	struct wlr_data_source *captured = clipboard->captured;
+
+	clipboard->captures++;
+	clipboard->bytes_captured += offer->bytes;
+	DEBUG_LOG("Clipboard captured %zu bytes", offer->bytes);
+
+	/* If the source is still the selection, or went away with it, ours
+	 * takes its place; the source gets a cancelled event like any replaced
+	 * selection does. */
+	if (clipboard->seat->selection_source != captured &&
+		clipboard->seat->selection_source != NULL)
+	{
+		capture_stop(clipboard);
+		return;
+	}
+
+	if (captured != NULL)
+	{
+		wl_list_remove(&clipboard->captured_destroy.link);
+		clipboard->captured = NULL;
+	}
+	clipboard->pending = NULL;
+	clipboard->current = offer;
+	wlr_seat_set_selection(clipboard->seat, &offer->base,
+		wl_display_next_serial(clipboard->display));
+}
+
+static int capture_handle_readable(int fd, uint32_t mask, void *data)
+{
+	struct ClipboardMime *mime = data;
+	struct ClipboardOffer *offer = mime->offer;
+	struct Clipboard *clipboard = offer->clipboard;
+
+	for (;;)
+	{
+		ssize_t moved = splice(mime->pipe, NULL, mime->memfd, NULL, CLIPBOARD_CHUNK,
+			SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (moved < 0 && errno == EAGAIN)
+		{
+			return 0;
+		}
+		if (moved < 0)
+		{
+			DEBUG_LOG_ERRNO("Clipboard capture of %s failed", mime->type);
+			clipboard->rejected++;
+			capture_stop(clipboard);
+			return 0;
+		}
+		if (moved == 0)
+		{
+			break;
+		}
+
+		mime->size += moved;
+		offer->bytes += moved;
+		if (offer->bytes > clipboard->max_bytes)
+		{
+			DEBUG_LOG("Clipboard selection exceeds %zu bytes; not stored",
+				clipboard->max_bytes);
+			clipboard->rejected++;
+			capture_stop(clipboard);
+			return 0;
+		}
+	}
+
+	/* End of this type's data. */
+	wl_event_source_remove(mime->read);
+	mime->read = NULL;
+	close(mime->pipe);
+	mime->pipe = -1;
+	if (--offer->capturing == 0)
+	{
+		capture_complete(clipboard);
+	}
+	return 0;
+}
+
+static bool mime_accepted(struct Clipboard *clipboard, const char *type)
+{
+	const char *pattern = clipboard->mime_filter;
+	while (*pattern != '\0')
+	{
+		size_t len = strcspn(pattern, ",");
+		char glob[128];
+		if (len < sizeof(glob))
+		{
+			memcpy(glob, pattern, len);
+			glob[len] = '\0';
+			if (fnmatch(glob, type, 0) == 0)
+			{
+				return true;
+			}
+		}
+		pattern += len;
+		pattern += *pattern == ',';
+	}
+	return false;
+}
+
+static bool capture_mime(struct Clipboard *clipboard, struct ClipboardOffer *offer,
+	struct wlr_data_source *source, const char *type)
+{
+	char **slot = wl_array_add(&offer->base.mime_types, sizeof(*slot));
+	struct ClipboardMime *mime = calloc(1, sizeof(*mime));
+	if (slot == NULL || mime == NULL || (*slot = strdup(type)) == NULL)
+	{
+		if (slot != NULL)
+		{
+			offer->base.mime_types.size -= sizeof(*slot);
+		}
+		free(mime);
+		return false;
+	}
+
+	int fds[2];
+	mime->type = *slot;
+	mime->offer = offer;
+	mime->pipe = -1;
+	mime->memfd = memfd_create("scowl-clipboard", MFD_CLOEXEC);
+	wl_list_insert(offer->mimes.prev, &mime->link);
+	if (mime->memfd < 0 || pipe2(fds, O_CLOEXEC) < 0)
+	{
+		wlr_log_errno(WLR_ERROR, "Failed to set up clipboard capture");
+		return false;
+	}
+	/* Only our end; the source may not expect EAGAIN on its writes. */
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+	mime->pipe = fds[0];
+	mime->read = wl_event_loop_add_fd(clipboard->loop, fds[0], WL_EVENT_READABLE,
+		capture_handle_readable, mime);
+	/* The source closes its end once written; wlroots closes ours. */
+	wlr_data_source_send(source, type, fds[1]);
+	offer->capturing++;
+	return mime->read != NULL;
+}
+
+static void captured_handle_destroy(struct wl_listener *listener, void *data)
+{
+	/* The client may still finish writing what it was asked for. */
+	struct Clipboard *clipboard = wl_container_of(listener, clipboard, captured_destroy);
+	wl_list_remove(&clipboard->captured_destroy.link);
+	clipboard->captured = NULL;
+}
+
+static void clipboard_handle_set_selection(struct wl_listener *listener, void *data)
+{
+	struct Clipboard *clipboard = wl_container_of(listener, clipboard, set_selection);
+	struct wlr_data_source *source = clipboard->seat->selection_source;
+
+	if (source == NULL || (clipboard->current != NULL && source == &clipboard->current->base))
+	{
+		return;
+	}
+	capture_stop(clipboard);
+
+	struct ClipboardOffer *offer = calloc(1, sizeof(*offer));
+	if (offer == NULL)
+	{
+		return;
+	}
+	wlr_data_source_init(&offer->base, &offer_impl);
+	offer->clipboard = clipboard;
+	offer->refs = 1;
+	wl_list_init(&offer->mimes);
+	clipboard->pending = offer;
+
+	char **type;
+	wl_array_for_each(type, &source->mime_types)
+	{
+		if (mime_accepted(clipboard, *type) &&
+			!capture_mime(clipboard, offer, source, *type))
+		{
+			capture_stop(clipboard);
+			return;
+		}
+	}
+	if (offer->capturing == 0)
+	{
+		clipboard->rejected++;
+		capture_stop(clipboard);
+		return;
+	}
+
+	clipboard->captured = source;
+	clipboard->captured_destroy.notify = captured_handle_destroy;
+	wl_signal_add(&source->events.destroy, &clipboard->captured_destroy);
+}
+
+void clipboard_init(struct Clipboard *clipboard, struct wl_display *display,
+	struct wlr_seat *seat, size_t max_bytes, const char *mime_filter)
+{
+	memset(clipboard, 0, sizeof(*clipboard));
+	clipboard->seat = seat;
+	clipboard->display = display;
+	clipboard->loop = wl_display_get_event_loop(display);
+	clipboard->max_bytes = max_bytes;
+	clipboard->mime_filter = strdup(mime_filter);
+	wl_list_init(&clipboard->transfers);
+
+	clipboard->set_selection.notify = clipboard_handle_set_selection;
+	wl_signal_add(&seat->events.set_selection, &clipboard->set_selection);
+	wlr_log(WLR_INFO, "Clipboard store enabled (%zu bytes, %s)", max_bytes, mime_filter);
+}
+
+void clipboard_finish(struct Clipboard *clipboard)
+{
+	if (clipboard->seat == NULL)
+	{
+		return;
+	}
+
+	capture_stop(clipboard);
+	struct ClipboardTransfer *transfer, *tmp;
+	wl_list_for_each_safe(transfer, tmp, &clipboard->transfers, link)
+	{
+		transfer_finish(transfer);
+	}
+	wl_list_remove(&clipboard->set_selection.link);
+	free(clipboard->mime_filter);
+	clipboard->seat = NULL;
+}
+
+void clipboard_write_summary(struct Clipboard *clipboard, FILE *out)
+{
+	if (clipboard->seat == NULL)
+	{
+		fprintf(out, "clipboard store is disabled (set SCOWL_CLIPBOARD)\n");
+		return;
+	}
+
+	fprintf(out, "captures %" PRIu64 " rejected %" PRIu64 " bytes %" PRIu64 "\n",
+		clipboard->captures, clipboard->rejected, clipboard->bytes_captured);
+	fprintf(out, "pastes %" PRIu64 " bytes %" PRIu64 " in flight %d\n",
+		clipboard->pastes, clipboard->bytes_served, wl_list_length(&clipboard->transfers));
+	if (clipboard->current != NULL)
+	{
+		struct ClipboardMime *mime;
+		wl_list_for_each(mime, &clipboard->current->mimes, link)
+		{
+			fprintf(out, "  %s %zu bytes\n", mime->type, mime->size);
+		}
+	}
+}
@@ -0,0 +1,83 @@
+#ifndef CLIPBOARD_H_
+#define CLIPBOARD_H_
+
+#include <stdio.h>
+#include "wayland.h"
+
+#define CLIPBOARD_MAX_BYTES (16 << 20)
+#define CLIPBOARD_MIME_TYPES "text/*,UTF8_STRING,STRING,TEXT,image/png"
+
+/*
+ * Compositor-side clipboard store, enabled with SCOWL_CLIPBOARD.
+ *
+ * Whenever a client sets the selection, every offered MIME type that
+ * passes the filter is read from the source through non-blocking pipes on
+ * the event loop, spliced straight into one memfd per type. Once all of
+ * them arrived, the store takes over the selection, so the contents
+ * outlive the source and pastes no longer wait on it. Pastes are served
+ * from the memfds with sendfile, again driven by the event loop when the
+ * reader is slow; the data never passes through userspace.
+ *
+ * Selections bigger than the byte cap (SCOWL_CLIPBOARD_MAX) or without an
+ * acceptable type (SCOWL_CLIPBOARD_MIMES, comma-separated globs) are left
+ * to the source client as before.
+ */
+struct ClipboardMime
+{
+	struct wl_list link;
+	const char *type; /* owned by the offer's mime_types array */
+	int memfd;
+	size_t size;
+	int pipe;                     /* read end while capturing, else -1 */
+	struct wl_event_source *read; /* while capturing */
+	struct ClipboardOffer *offer;
+};
+
+struct ClipboardOffer
+{
+	struct wlr_data_source base;
+	struct Clipboard *clipboard;
+	struct wl_list mimes; /* ClipboardMime.link */
+	size_t bytes;
+	int capturing;        /* types still being read */
+	int refs;             /* the data source plus each running paste */
+};
+
+struct ClipboardTransfer
+{
+	struct wl_list link;
+	struct ClipboardMime *mime; /* holds a reference on mime->offer */
+	int fd;
+	off_t offset;
+	struct wl_event_source *write;
+};
+
+struct Clipboard
+{
+	struct wlr_seat *seat;
+	struct wl_display *display;
+	struct wl_event_loop *loop;
+	size_t max_bytes;
+	char *mime_filter;
+
+	struct ClipboardOffer *pending;   /* capture in progress */
+	struct ClipboardOffer *current;   /* our source, while it is the selection */
+	struct wlr_data_source *captured; /* the client source `pending` copies */
+	struct wl_listener captured_destroy;
+	struct wl_listener set_selection;
+	struct wl_list transfers;         /* ClipboardTransfer.link */
+
+	uint64_t captures;
+	uint64_t rejected;
+	uint64_t bytes_captured;
+	uint64_t pastes;
+	uint64_t bytes_served;
+};
+
+void clipboard_init(struct Clipboard *clipboard, struct wl_display *display,
+	struct wlr_seat *seat, size_t max_bytes, const char *mime_filter);
+void clipboard_finish(struct Clipboard *clipboard);
+
+void clipboard_write_summary(struct Clipboard *clipboard, FILE *out);
+
+#endif
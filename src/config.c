@@ -0,0 +1,779 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+
+#define CONFIG_SETTLE_MS 50
+
+static const struct ConfigBinding default_bindings[] = {
+	{ WLR_MODIFIER_ALT, XKB_KEY_Escape, BIND_QUIT, NULL },
+	{ WLR_MODIFIER_ALT, XKB_KEY_Return, BIND_TERMINAL, NULL },
+	{ WLR_MODIFIER_ALT, XKB_KEY_F1, BIND_FOCUS_LAST, NULL },
+	{ WLR_MODIFIER_ALT, XKB_KEY_Tab, BIND_CYCLE_NEXT, NULL },
+	{ WLR_MODIFIER_ALT, XKB_KEY_ISO_Left_Tab, BIND_CYCLE_PREV, NULL },
+};
+
+static const char *const bind_action_names[] = {
+	[BIND_NONE] = "none",
+	[BIND_QUIT] = "quit",
+	[BIND_TERMINAL] = "terminal",
+	[BIND_SPAWN] = "spawn",
+	[BIND_FOCUS_LAST] = "focus_last",
+	[BIND_CYCLE_NEXT] = "cycle next",
+	[BIND_CYCLE_PREV] = "cycle prev",
+};
+
+static const struct
+{
+	const char *name;
+	uint32_t modifier;
+} modifier_names[] = {
+	{ "shift", WLR_MODIFIER_SHIFT },
+	{ "ctrl", WLR_MODIFIER_CTRL },
+	{ "control", WLR_MODIFIER_CTRL },
+	{ "alt", WLR_MODIFIER_ALT },
+	{ "mod1", WLR_MODIFIER_ALT },
+	{ "logo", WLR_MODIFIER_LOGO },
+	{ "super", WLR_MODIFIER_LOGO },
+	{ "mod4", WLR_MODIFIER_LOGO },
+};
+
+char *config_default_path(void)
+{
+	const char *explicit = getenv("SCOWL_CONFIG");
+	if (explicit != NULL)
+	{
+		return strdup(explicit);
+	}
+
+	char path[PATH_MAX];
+	const char *config_home = getenv("XDG_CONFIG_HOME");
+	const char *home = getenv("HOME");
+	if (config_home != NULL && config_home[0] != '\0')
+	{
+		snprintf(path, sizeof(path), "%s/scowl/config", config_home);
+	} else if (home != NULL)
+	{
+		snprintf(path, sizeof(path), "%s/.config/scowl/config", home);
+	} else
+	{
+		return NULL;
+	}
+	return strdup(path);
+}
+
+static char *skip_space(char *p)
+{
+	while (*p == ' ' || *p == '\t')
+	{
+		p++;
+	}
+	return p;
+}
+
+static char *next_token(char **cursor)
+{
+	/* Cuts the next blank-separated word out of the line, in place. */
+	char *start = skip_space(*cursor);
+	if (*start == '\0')
+	{
+		*cursor = start;
+		return NULL;
+	}
+
+	char *end = start + strcspn(start, " \t");
+	if (*end != '\0')
+	{
+		*end++ = '\0';
+	}
+	*cursor = end;
+	return start;
+}
+
+static void *grow(void *array, size_t count, size_t size)
+{
+	/* Doubles at powers of two, so `count` alone tells when to. */
+	if (count != 0 && (count & (count - 1)) != 0)
+	{
+		return array;
+	}
+	return realloc(array, (count == 0 ? 4 : count * 2) * size);
+}
+
+static bool parse_uint(const char *value, unsigned int *out)
+{
+	char *end;
+	unsigned long n = value != NULL ? strtoul(value, &end, 10) : 0;
+	if (value == NULL || *value == '\0' || *end != '\0' || n > INT_MAX)
+	{
+		return false;
+	}
+	*out = n;
+	return true;
+}
+
+static bool parse_keymap(struct Config *config, char *rest, const char *where)
+{
+	char *word;
+	while ((word = next_token(&rest)) != NULL)
+	{
+		char *value = strchr(word, '=');
+		if (value == NULL)
+		{
+			wlr_log(WLR_ERROR, "%s: keymap wants key=value, not '%s'", where, word);
+			return false;
+		}
+		*value++ = '\0';
+
+		if (strcmp(word, "rules") == 0)
+		{
+			config->keymap.rules = value;
+		} else if (strcmp(word, "model") == 0)
+		{
+			config->keymap.model = value;
+		} else if (strcmp(word, "layout") == 0)
+		{
+			config->keymap.layout = value;
+		} else if (strcmp(word, "variant") == 0)
+		{
+			config->keymap.variant = value;
+		} else if (strcmp(word, "options") == 0)
+		{
+			config->keymap.options = value;
+		} else
+		{
+			wlr_log(WLR_ERROR, "%s: unknown keymap setting '%s'", where, word);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool parse_bind(struct Config *config, char *rest, const char *where)
+{
+	struct ConfigBinding binding = {0};
+	char *combo = next_token(&rest);
+	char *action = next_token(&rest);
+	if (combo == NULL || action == NULL)
+	{
+		wlr_log(WLR_ERROR, "%s: bind wants keys and an action", where);
+		return false;
+	}
+
+	char *save = NULL;
+	char *part = strtok_r(combo, "+", &save);
+	char *next;
+	for (; part != NULL; part = next)
+	{
+		next = strtok_r(NULL, "+", &save);
+		if (next == NULL)
+		{
+			binding.sym = xkb_keysym_from_name(part, XKB_KEYSYM_CASE_INSENSITIVE);
+			if (binding.sym == XKB_KEY_NoSymbol)
+			{
+				wlr_log(WLR_ERROR, "%s: unknown key '%s'", where, part);
+				return false;
+			}
+			break;
+		}
+
+		size_t i;
+		for (i = 0; i < sizeof(modifier_names) / sizeof(modifier_names[0]); i++)
+		{
+			if (strcasecmp(part, modifier_names[i].name) == 0)
+			{
+				binding.modifiers |= modifier_names[i].modifier;
+				break;
+			}
+		}
+		if (i == sizeof(modifier_names) / sizeof(modifier_names[0]))
+		{
+			wlr_log(WLR_ERROR, "%s: unknown modifier '%s'", where, part);
+			return false;
+		}
+	}
+
+	rest = skip_space(rest);
+	if (strcmp(action, "cycle") == 0)
+	{
+		if (*rest == '\0' || strcmp(rest, "next") == 0)
+		{
+			binding.action = BIND_CYCLE_NEXT;
+		} else if (strcmp(rest, "prev") == 0)
+		{
+			binding.action = BIND_CYCLE_PREV;
+		} else
+		{
+			wlr_log(WLR_ERROR, "%s: cycle wants next or prev, not '%s'", where, rest);
+			return false;
+		}
+	} else if (strcmp(action, "spawn") == 0 && *rest != '\0')
+	{
+		binding.action = BIND_SPAWN;
+		binding.command = rest;
+	} else
+	{
+		size_t i;
+		for (i = 0; i <= BIND_FOCUS_LAST; i++)
+		{
+			if (i != BIND_SPAWN && strcmp(action, bind_action_names[i]) == 0)
+			{
+				binding.action = i;
+				break;
+			}
+		}
+		if (i > BIND_FOCUS_LAST)
+		{
+			wlr_log(WLR_ERROR, "%s: unknown action '%s'", where, action);
+			return false;
+		}
+	}
+
+	struct ConfigBinding *bindings = grow(config->bindings, config->binding_count,
+		sizeof(*bindings));
+	if (bindings == NULL)
+	{
+		return false;
+	}
+	config->bindings = bindings;
+	config->bindings[config->binding_count++] = binding;
+	return true;
+}
+
+static bool parse_output(struct Config *config, char *rest, const char *where)
+{
+	struct ConfigOutput output = { .name = next_token(&rest) };
+	if (output.name == NULL)
+	{
+		wlr_log(WLR_ERROR, "%s: output wants a name or *", where);
+		return false;
+	}
+
+	char *word;
+	while ((word = next_token(&rest)) != NULL)
+	{
+		if (strncmp(word, "scale=", 6) == 0)
+		{
+			char *end;
+			output.scale = strtof(word + 6, &end);
+			if (*end != '\0' || output.scale <= 0.0f)
+			{
+				wlr_log(WLR_ERROR, "%s: bad scale '%s'", where, word + 6);
+				return false;
+			}
+		} else if (strncmp(word, "mode=", 5) == 0)
+		{
+			float refresh = 0.0f;
+			int n = sscanf(word + 5, "%dx%d@%f", &output.width, &output.height, &refresh);
+			if (n < 2 || output.width <= 0 || output.height <= 0)
+			{
+				wlr_log(WLR_ERROR, "%s: mode wants WIDTHxHEIGHT[@HZ], not '%s'", where,
+					word + 5);
+				return false;
+			}
+			output.refresh_mhz = (int)(refresh * 1000.0f + 0.5f);
+		} else
+		{
+			wlr_log(WLR_ERROR, "%s: unknown output setting '%s'", where, word);
+			return false;
+		}
+	}
+
+	struct ConfigOutput *outputs = grow(config->outputs, config->output_count,
+		sizeof(*outputs));
+	if (outputs == NULL)
+	{
+		return false;
+	}
+	config->outputs = outputs;
+	config->outputs[config->output_count++] = output;
+	return true;
+}
+
+static bool parse_rule(struct Config *config, char *rest, unsigned int lineno)
+{
+	/* Kept as text; the rule set parses it when it is applied. */
+	struct ConfigRule *rules = grow(config->rules, config->rule_count, sizeof(*rules));
+	if (rules == NULL)
+	{
+		return false;
+	}
+	config->rules = rules;
+	config->rules[config->rule_count++] = (struct ConfigRule){ rest, lineno };
+	return true;
+}
+
+static void config_parse_line(struct Config *config, char *line, unsigned int lineno)
+{
+	char where[PATH_MAX + 16];
+	char *rest = line;
+	char *key = next_token(&rest);
+	bool ok = true;
+
+	if (key == NULL || key[0] == '#')
+	{
+		return;
+	}
+
+	/* Everything after the key, without trailing blanks (or \r). */
+	rest = skip_space(rest);
+	size_t len = strlen(rest);
+	while (len > 0 && (rest[len - 1] == ' ' || rest[len - 1] == '\t' || rest[len - 1] == '\r'))
+	{
+		rest[--len] = '\0';
+	}
+	snprintf(where, sizeof(where), "%s:%u", config->path, lineno);
+
+	if (strcmp(key, "terminal") == 0 && len > 0)
+	{
+		config->terminal = rest;
+	} else if (strcmp(key, "autostart") == 0)
+	{
+		config->autostart = rest;
+	} else if (strcmp(key, "repeat") == 0)
+	{
+		unsigned int rate, delay;
+		ok = parse_uint(next_token(&rest), &rate) && parse_uint(next_token(&rest), &delay);
+		if (ok)
+		{
+			config->repeat_rate = rate;
+			config->repeat_delay = delay;
+		}
+	} else if (strcmp(key, "border") == 0)
+	{
+		ok = parse_uint(rest, &config->border_width);
+	} else if (strcmp(key, "idle_timeout") == 0)
+	{
+		ok = parse_uint(rest, &config->idle_timeout);
+	} else if (strcmp(key, "cursor_theme") == 0 && len > 0)
+	{
+		config->cursor_theme = strcmp(rest, "default") != 0 ? rest : NULL;
+	} else if (strcmp(key, "cursor_size") == 0)
+	{
+		ok = parse_uint(rest, &config->cursor_size) && config->cursor_size > 0;
+	} else if (strcmp(key, "keymap") == 0)
+	{
+		ok = parse_keymap(config, rest, where);
+	} else if (strcmp(key, "bind") == 0)
+	{
+		ok = parse_bind(config, rest, where);
+	} else if (strcmp(key, "output") == 0)
+	{
+		ok = parse_output(config, rest, where);
+	} else if (strcmp(key, "rule") == 0)
+	{
+		ok = parse_rule(config, rest, lineno);
+	} else if (strcmp(key, "quota") == 0)
+	{
+		config->quota = rest;
+	} else
+	{
+		wlr_log(WLR_ERROR, "%s: unknown setting '%s'", where, key);
+		return;
+	}
+
+	if (!ok)
+	{
+		wlr_log(WLR_ERROR, "%s: ignoring bad '%s' line", where, key);
+	}
+}
+
+static char *read_file(const char *path)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return NULL;
+	}
+
+	struct stat st;
+	char *text = NULL;
+	if (fstat(fd, &st) == 0 && (text = malloc(st.st_size + 1)) != NULL)
+	{
+		size_t size = 0;
+		ssize_t n;
+		while (size < (size_t)st.st_size &&
+			(n = read(fd, text + size, st.st_size - size)) > 0)
+		{
+			size += n;
+		}
+		text[size] = '\0';
+	}
+	close(fd);
+	return text;
+}
+
+bool config_load(struct Config *config, const char *path)
+{
+	*config = (struct Config){
+		.path = path,
+		.terminal = CONFIG_DEFAULT_TERMINAL,
+		.repeat_rate = CONFIG_DEFAULT_REPEAT_RATE,
+		.repeat_delay = CONFIG_DEFAULT_REPEAT_DELAY,
+		.border_width = CONFIG_DEFAULT_BORDER_WIDTH,
+		.cursor_size = CONFIG_DEFAULT_CURSOR_SIZE,
+		.idle_timeout = CONFIG_DEFAULT_IDLE_TIMEOUT,
+	};
+
+	config->text = path != NULL ? read_file(path) : NULL;
+	if (config->text == NULL)
+	{
+		if (path != NULL && errno != ENOENT)
+		{
+			wlr_log_errno(WLR_ERROR, "Failed to read %s", path);
+		}
+		return false;
+	}
+
+	char *line = config->text;
+	unsigned int lineno = 0;
+	while (line != NULL)
+	{
+		char *end = strchr(line, '\n');
+		if (end != NULL)
+		{
+			*end = '\0';
+		}
+		config_parse_line(config, line, ++lineno);
+		line = end != NULL ? end + 1 : NULL;
+	}
+	return true;
+}
+
+void config_finish(struct Config *config)
+{
+	free(config->bindings);
+	free(config->outputs);
+	free(config->rules);
+	free(config->text);
+	config->bindings = NULL;
+	config->outputs = NULL;
+	config->rules = NULL;
+	config->text = NULL;
+}
+
+static bool str_equal(const char *a, const char *b)
+{
+	return a == b || (a != NULL && b != NULL && strcmp(a, b) == 0);
+}
+
+uint32_t config_diff(const struct Config *old, const struct Config *new)
+{
+	uint32_t changes = 0;
+
+	if (!str_equal(old->terminal, new->terminal))
+	{
+		changes |= CONFIG_TERMINAL;
+	}
+	if (old->repeat_rate != new->repeat_rate || old->repeat_delay != new->repeat_delay)
+	{
+		changes |= CONFIG_REPEAT;
+	}
+	if (old->border_width != new->border_width)
+	{
+		changes |= CONFIG_BORDER;
+	}
+	if (old->idle_timeout != new->idle_timeout)
+	{
+		changes |= CONFIG_IDLE;
+	}
+	if (!str_equal(old->cursor_theme, new->cursor_theme) ||
+		old->cursor_size != new->cursor_size)
+	{
+		changes |= CONFIG_CURSOR;
+	}
+	if (!str_equal(old->keymap.rules, new->keymap.rules) ||
+		!str_equal(old->keymap.model, new->keymap.model) ||
+		!str_equal(old->keymap.layout, new->keymap.layout) ||
+		!str_equal(old->keymap.variant, new->keymap.variant) ||
+		!str_equal(old->keymap.options, new->keymap.options))
+	{
+		changes |= CONFIG_KEYMAP;
+	}
+	if (!str_equal(old->quota, new->quota))
+	{
+		changes |= CONFIG_QUOTA;
+	}
+
+	if (old->binding_count != new->binding_count)
+	{
+		changes |= CONFIG_BINDINGS;
+	}
+	for (size_t i = 0; !(changes & CONFIG_BINDINGS) && i < new->binding_count; i++)
+	{
+		const struct ConfigBinding *a = &old->bindings[i], *b = &new->bindings[i];
+		if (a->modifiers != b->modifiers || a->sym != b->sym || a->action != b->action ||
+			!str_equal(a->command, b->command))
+		{
+			changes |= CONFIG_BINDINGS;
+		}
+	}
+
+	if (old->output_count != new->output_count)
+	{
+		changes |= CONFIG_OUTPUTS;
+	}
+	for (size_t i = 0; !(changes & CONFIG_OUTPUTS) && i < new->output_count; i++)
+	{
+		const struct ConfigOutput *a = &old->outputs[i], *b = &new->outputs[i];
+		if (!str_equal(a->name, b->name) || a->scale != b->scale || a->width != b->width ||
+			a->height != b->height || a->refresh_mhz != b->refresh_mhz)
+		{
+			changes |= CONFIG_OUTPUTS;
+		}
+	}
+
+	/* Line numbers do not matter, only the rules themselves and their order. */
+	if (old->rule_count != new->rule_count)
+	{
+		changes |= CONFIG_RULES;
+	}
+	for (size_t i = 0; !(changes & CONFIG_RULES) && i < new->rule_count; i++)
+	{
+		if (strcmp(old->rules[i].line, new->rules[i].line) != 0)
+		{
+			changes |= CONFIG_RULES;
+		}
+	}
+	return changes;
+}
+
+const struct ConfigOutput *config_output(const struct Config *config, const char *name)
+{
+	const struct ConfigOutput *any = NULL;
+	for (size_t i = 0; i < config->output_count; i++)
+	{
+		const struct ConfigOutput *output = &config->outputs[i];
+		if (strcmp(output->name, name) == 0)
+		{
+			return output;
+		}
+		if (strcmp(output->name, "*") == 0)
+		{
+			any = output;
+		}
+	}
+	return any;
+}
+
+const struct ConfigBinding *config_binding(const struct Config *config, uint32_t modifiers,
+	xkb_keysym_t sym)
+{
+	/* The configured bindings, later lines first, then the defaults. */
+	const struct ConfigBinding *found = NULL;
+	for (size_t i = config->binding_count; found == NULL && i > 0; i--)
+	{
+		if (config->bindings[i - 1].modifiers == modifiers && config->bindings[i - 1].sym == sym)
+		{
+			found = &config->bindings[i - 1];
+		}
+	}
+	for (size_t i = 0; found == NULL && i < sizeof(default_bindings) / sizeof(default_bindings[0]); i++)
+	{
+		if (default_bindings[i].modifiers == modifiers && default_bindings[i].sym == sym)
+		{
+			found = &default_bindings[i];
+		}
+	}
+	return found != NULL && found->action != BIND_NONE ? found : NULL;
+}
+
+static int config_watch_settled(void *data)
+{
+	struct ConfigWatch *watch = data;
+	watch->reloads++;
+	watch->changed(watch->data);
+	return 0;
+}
+
+static bool config_watch_add(struct ConfigWatch *watch)
+{
+	/* Watches the directory if it exists, or else the nearest parent that
+	 * does for any directory appearing in it. */
+	char *watched = strdup(watch->dir);
+	struct stat st;
+	while (watched != NULL && stat(watched, &st) != 0 && strcmp(watched, "/") != 0)
+	{
+		char *slash = strrchr(watched, '/');
+		if (slash == NULL)
+		{
+			free(watched);
+			watched = strdup(".");
+			break;
+		}
+		slash[slash == watched ? 1 : 0] = '\0';
+	}
+	if (watched == NULL)
+	{
+		return false;
+	}
+
+	bool found = strcmp(watched, watch->dir) == 0;
+	int wd = inotify_add_watch(watch->fd, watched,
+		found ? IN_CLOSE_WRITE | IN_MOVED_TO : IN_CREATE | IN_MOVED_TO | IN_ONLYDIR);
+	if (wd < 0)
+	{
+		free(watched);
+		return false;
+	}
+	if (watch->wd >= 0 && watch->wd != wd)
+	{
+		inotify_rm_watch(watch->fd, watch->wd);
+	}
+	watch->wd = wd;
+	free(watch->watched);
+	watch->watched = watched;
+	return true;
+}
+
+static int config_watch_readable(int fd, uint32_t mask, void *data)
+{
+	struct ConfigWatch *watch = data;
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	bool found = strcmp(watch->watched, watch->dir) == 0;
+	bool ours = false, appeared = false;
+	ssize_t n;
+
+	while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+	{
+		for (char *p = buffer; p < buffer + n; )
+		{
+			struct inotify_event *event = (struct inotify_event *)p;
+			if (!found && (event->mask & IN_ISDIR))
+			{
+				appeared = true;
+			} else if (found && event->len > 0 && strcmp(event->name, watch->name) == 0)
+			{
+				ours = true;
+			}
+			p += sizeof(*event) + event->len;
+		}
+	}
+
+	if (appeared)
+	{
+		/* A step closer, or there; the file may have come along already. */
+		struct stat st;
+		if (!config_watch_add(watch))
+		{
+			wlr_log_errno(WLR_ERROR, "Lost the watch for %s; config hot reload is off",
+				watch->dir);
+		} else if (strcmp(watch->watched, watch->dir) == 0)
+		{
+			wlr_log(WLR_INFO, "Watching %s for changes", watch->dir);
+			ours = stat(watch->path, &st) == 0;
+		}
+	}
+
+	if (ours)
+	{
+		wl_event_source_timer_update(watch->settle, CONFIG_SETTLE_MS);
+	}
+	return 0;
+}
+
+bool config_watch_init(struct ConfigWatch *watch, struct wl_event_loop *loop,
+	const char *path, void (*changed)(void *data), void *data)
+{
+	/* The directory, not the file: editors that save by writing a new file
+	 * and renaming it over the old one would leave a file watch behind on
+	 * the deleted original. */
+	*watch = (struct ConfigWatch){ .fd = -1, .wd = -1, .changed = changed, .data = data };
+	watch->path = strdup(path);
+	watch->dir = strdup(path);
+	char *slash = strrchr(watch->dir, '/');
+	if (slash == NULL)
+	{
+		free(watch->dir);
+		watch->dir = strdup(".");
+		watch->name = watch->path;
+	} else
+	{
+		*slash = '\0';
+		watch->name = watch->path + (slash - watch->dir) + 1;
+	}
+
+	watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch->fd < 0 || !config_watch_add(watch))
+	{
+		wlr_log_errno(WLR_ERROR, "Not watching %s for changes; config hot reload is off",
+			watch->dir);
+		config_watch_finish(watch);
+		return false;
+	}
+	if (strcmp(watch->watched, watch->dir) != 0)
+	{
+		wlr_log(WLR_INFO, "%s does not exist yet; watching %s for it", watch->dir,
+			watch->watched);
+	}
+
+	watch->source = wl_event_loop_add_fd(loop, watch->fd, WL_EVENT_READABLE,
+		config_watch_readable, watch);
+	watch->settle = wl_event_loop_add_timer(loop, config_watch_settled, watch);
+	return true;
+}
+
+void config_watch_finish(struct ConfigWatch *watch)
+{
+	if (watch->settle != NULL)
+	{
+		wl_event_source_remove(watch->settle);
+		watch->settle = NULL;
+	}
+	if (watch->source != NULL)
+	{
+		wl_event_source_remove(watch->source);
+		watch->source = NULL;
+	}
+	if (watch->fd >= 0)
+	{
+		close(watch->fd);
+		watch->fd = -1;
+	}
+	free(watch->path);
+	free(watch->dir);
+	free(watch->watched);
+	watch->path = watch->dir = watch->watched = NULL;
+}
+
+void config_write_summary(const struct Config *config, FILE *out)
+{
+	fprintf(out, "terminal %s\n", config->terminal);
+	fprintf(out, "repeat %d %d\n", config->repeat_rate, config->repeat_delay);
+	fprintf(out, "border %u\n", config->border_width);
+	fprintf(out, "idle_timeout %u\n", config->idle_timeout);
+	fprintf(out, "cursor_theme %s\ncursor_size %u\n",
+		config->cursor_theme ? config->cursor_theme : "default", config->cursor_size);
+	fprintf(out, "keymap layout=%s variant=%s options=%s\n",
+		config->keymap.layout ? config->keymap.layout : "",
+		config->keymap.variant ? config->keymap.variant : "",
+		config->keymap.options ? config->keymap.options : "");
+	for (size_t i = 0; i < config->binding_count; i++)
+	{
+		char name[64];
+		const struct ConfigBinding *binding = &config->bindings[i];
+		xkb_keysym_get_name(binding->sym, name, sizeof(name));
+		fprintf(out, "bind %s%s%s%s%s %s%s%s\n",
+			binding->modifiers & WLR_MODIFIER_LOGO ? "Logo+" : "",
+			binding->modifiers & WLR_MODIFIER_CTRL ? "Ctrl+" : "",
+			binding->modifiers & WLR_MODIFIER_ALT ? "Alt+" : "",
+			binding->modifiers & WLR_MODIFIER_SHIFT ? "Shift+" : "", name,
+			bind_action_names[binding->action], binding->command ? " " : "",
+			binding->command ? binding->command : "");
+	}
+	for (size_t i = 0; i < config->output_count; i++)
+	{
+		const struct ConfigOutput *output = &config->outputs[i];
+		fprintf(out, "output %s scale=%.3f mode=%dx%d@%.3f\n", output->name, output->scale,
+			output->width, output->height, output->refresh_mhz / 1000.0);
+	}
+	fprintf(out, "%zu rules\n", config->rule_count);
+}
@@ -0,0 +1,157 @@
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+#include <stdio.h>
+#include "wayland.h"
+
+#define CONFIG_DEFAULT_TERMINAL "foot"
+#define CONFIG_DEFAULT_REPEAT_RATE 25
+#define CONFIG_DEFAULT_REPEAT_DELAY 600
+#define CONFIG_DEFAULT_BORDER_WIDTH 4
+#define CONFIG_DEFAULT_CURSOR_SIZE 24
+#define CONFIG_DEFAULT_IDLE_TIMEOUT 600
+
+/*
+ * The configuration file: $SCOWL_CONFIG, or scowl/config under
+ * $XDG_CONFIG_HOME (~/.config). One directive per line, `#` starts a
+ * comment:
+ *
+ *   terminal foot
+ *   autostart waybar; foot
+ *   repeat 25 600                  rate per second, delay in ms
+ *   border 4
+ *   cursor_theme Adwaita
+ *   cursor_size 24
+ *   keymap layout=us,de options=grp:alt_shift_toggle
+ *   bind Alt+Return terminal
+ *   bind Logo+d spawn fuzzel
+ *   bind Alt+Escape none           removes a default binding
+ *   output eDP-1 scale=1.5 mode=1920x1080@60
+ *   output * scale=1
+ *   rule app_id=mpv : content=video
+ *   quota surfaces=512,action=throttle
+ *   idle_timeout 600               seconds until outputs power down, 0 never
+ *
+ * Bindings name the keysym the key produces with its modifiers applied,
+ * so Alt+Shift+Tab is written Alt+ISO_Left_Tab; they are added to the
+ * defaults (quit, terminal, focus_last, cycle next/prev), replacing those
+ * on the same keys. Rules use the syntax in rules.h, quotas that in
+ * quota.h. For outputs, an entry naming the output beats the last `*`.
+ *
+ * The file is read whole and cut up in place: every string in a Config
+ * points into `text`, so parsing allocates nothing per line beyond the
+ * arrays. A missing file means the defaults.
+ *
+ * The file's directory is watched with inotify; until it exists, its
+ * nearest existing parent is, for the directory showing up. A change is
+ * picked up after a short quiet period, so an editor's write-and-rename comes
+ * through once; the new config is compared against the running one and
+ * only what differs is applied (see ConfigChange).
+ */
+enum BindAction
+{
+	BIND_NONE,
+	BIND_QUIT,
+	BIND_TERMINAL,
+	BIND_SPAWN,
+	BIND_FOCUS_LAST,
+	BIND_CYCLE_NEXT,
+	BIND_CYCLE_PREV,
+};
+
+struct ConfigBinding
+{
+	uint32_t modifiers; /* WLR_MODIFIER_SHIFT, CTRL, ALT and LOGO only */
+	xkb_keysym_t sym;
+	enum BindAction action;
+	const char *command; /* BIND_SPAWN */
+};
+
+struct ConfigOutput
+{
+	const char *name; /* or "*" */
+	float scale;      /* 0 to leave alone */
+	int width, height;
+	int refresh_mhz;  /* 0 for any */
+};
+
+struct ConfigRule
+{
+	const char *line;
+	unsigned int lineno;
+};
+
+struct Config
+{
+	char *text;
+	const char *path;
+	const char *terminal;
+	const char *autostart;
+	int repeat_rate, repeat_delay;
+	unsigned int border_width;
+	const char *cursor_theme; /* NULL for the default theme */
+	unsigned int cursor_size;
+	struct xkb_rule_names keymap;
+	const char *quota;
+	unsigned int idle_timeout; /* seconds, 0 for never */
+
+	struct ConfigBinding *bindings;
+	size_t binding_count;
+	struct ConfigOutput *outputs;
+	size_t output_count;
+	struct ConfigRule *rules;
+	size_t rule_count;
+};
+
+/* What config_diff found different; each is applied on its own. */
+enum ConfigChange
+{
+	CONFIG_KEYMAP = 1 << 0,
+	CONFIG_REPEAT = 1 << 1,
+	CONFIG_BORDER = 1 << 2,
+	CONFIG_CURSOR = 1 << 3,
+	CONFIG_BINDINGS = 1 << 4,
+	CONFIG_OUTPUTS = 1 << 5,
+	CONFIG_RULES = 1 << 6,
+	CONFIG_QUOTA = 1 << 7,
+	CONFIG_TERMINAL = 1 << 8, /* nothing to do; used on the next launch */
+	CONFIG_IDLE = 1 << 9,
+};
+
+struct ConfigWatch
+{
+	char *path;
+	char *dir;
+	const char *name; /* within `dir` */
+	char *watched;    /* `dir`, or its nearest existing parent */
+	int fd;
+	int wd;
+	struct wl_event_source *source;
+	struct wl_event_source *settle; /* timer, restarted by every event */
+	void (*changed)(void *data);
+	void *data;
+	uint64_t reloads;
+};
+
+/* Returns the path the config is read from, to be freed. */
+char *config_default_path(void);
+/* Fills `config` with the defaults overlaid with `path`. On a syntax error
+ * the line is logged and skipped; false means the file could not be read
+ * at all, in which case `config` holds the defaults. */
+bool config_load(struct Config *config, const char *path);
+void config_finish(struct Config *config);
+/* Returns ConfigChange bits. */
+uint32_t config_diff(const struct Config *old, const struct Config *new);
+const struct ConfigOutput *config_output(const struct Config *config, const char *name);
+const struct ConfigBinding *config_binding(const struct Config *config, uint32_t modifiers,
+	xkb_keysym_t sym);
+
+/* `changed` runs from the event loop whenever the file settled after a
+ * change. */
+bool config_watch_init(struct ConfigWatch *watch, struct wl_event_loop *loop,
+	const char *path, void (*changed)(void *data), void *data);
+void config_watch_finish(struct ConfigWatch *watch);
+
+void config_write_summary(const struct Config *config, FILE *out);
+
+#endif
@@ -0,0 +1,189 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <wlr/util/region.h>
+
+#include "constraint.h"
+
+static void constraint_deactivate(struct PointerConstraints *constraints)
+{
+	struct wlr_pointer_constraint_v1 *active = constraints->active;
+	if (active == NULL)
+	{
+		return;
+	}
+	constraints->active = NULL;
+
+	/* A lock can say where the client drew its own cursor last; put ours
+	 * there, if the pointer is still over the surface to measure from. */
+	if (active->type == WLR_POINTER_CONSTRAINT_V1_LOCKED &&
+		(active->current.committed & WLR_POINTER_CONSTRAINT_V1_STATE_CURSOR_HINT) &&
+		constraints->seat->pointer_state.focused_surface == active->surface)
+	{
+		struct wlr_seat_pointer_state *pointer = &constraints->seat->pointer_state;
+		double x = constraints->cursor->x - pointer->sx + active->current.cursor_hint.x;
+		double y = constraints->cursor->y - pointer->sy + active->current.cursor_hint.y;
+		wlr_cursor_warp(constraints->cursor, NULL, x, y);
+		wlr_seat_pointer_warp(constraints->seat, active->current.cursor_hint.x,
+			active->current.cursor_hint.y);
+	}
+	wlr_pointer_constraint_v1_send_deactivated(active);
+}
+
+static void constraint_activate(struct PointerConstraints *constraints,
+	struct wlr_pointer_constraint_v1 *constraint)
+{
+	if (constraints->active == constraint)
+	{
+		return;
+	}
+	constraint_deactivate(constraints);
+	if (constraint != NULL)
+	{
+		constraints->active = constraint;
+		constraints->activations++;
+		wlr_pointer_constraint_v1_send_activated(constraint);
+	}
+}
+
+static void constraint_destroy(struct wl_listener *listener, void *data)
+{
+	struct PointerConstraint *constraint = wl_container_of(listener, constraint, destroy);
+	struct PointerConstraints *constraints = constraint->owner;
+
+	/* Destroyed constraints get no events; just forget it. */
+	if (constraints->active == constraint->constraint)
+	{
+		constraints->active = NULL;
+	}
+	wl_list_remove(&constraint->destroy.link);
+	free(constraint);
+}
+
+static void constraints_new_constraint(struct wl_listener *listener, void *data)
+{
+	struct PointerConstraints *constraints =
+		wl_container_of(listener, constraints, new_constraint);
+	struct wlr_pointer_constraint_v1 *wlr_constraint = data;
+
+	struct PointerConstraint *constraint = calloc(1, sizeof(*constraint));
+	if (constraint == NULL)
+	{
+		wlr_log(WLR_ERROR, "Failed to allocate a pointer constraint");
+		return;
+	}
+	constraint->owner = constraints;
+	constraint->constraint = wlr_constraint;
+	constraint->destroy.notify = constraint_destroy;
+	wl_signal_add(&wlr_constraint->events.destroy, &constraint->destroy);
+
+	if (wlr_constraint->surface == constraints->seat->keyboard_state.focused_surface &&
+		wlr_constraint->surface == constraints->seat->pointer_state.focused_surface)
+	{
+		constraint_activate(constraints, wlr_constraint);
+	}
+}
+
+static void constraints_update(struct PointerConstraints *constraints,
+	struct wlr_surface *keyboard, struct wlr_surface *pointer)
+{
+	/* A client must not be told it is locked while the cursor moves freely
+	 * next to its window. */
+	constraint_activate(constraints, keyboard == NULL || keyboard != pointer ? NULL :
+		wlr_pointer_constraints_v1_constraint_for_surface(constraints->manager,
+			keyboard, constraints->seat));
+}
+
+static void constraints_focus_change(struct wl_listener *listener, void *data)
+{
+	/* Follows every keyboard focus change, whatever caused it. */
+	struct PointerConstraints *constraints =
+		wl_container_of(listener, constraints, focus_change);
+	struct wlr_seat_keyboard_focus_change_event *event = data;
+
+	constraints_update(constraints, event->new_surface,
+		constraints->seat->pointer_state.focused_surface);
+}
+
+static void constraints_pointer_focus_change(struct wl_listener *listener, void *data)
+{
+	struct PointerConstraints *constraints =
+		wl_container_of(listener, constraints, pointer_focus_change);
+	struct wlr_seat_pointer_focus_change_event *event = data;
+
+	constraints_update(constraints, constraints->seat->keyboard_state.focused_surface,
+		event->new_surface);
+}
+
+void pointer_constraints_init(struct PointerConstraints *constraints,
+	struct wl_display *display, struct wlr_seat *seat, struct wlr_cursor *cursor)
+{
+	constraints->manager = wlr_pointer_constraints_v1_create(display);
+	constraints->relative = wlr_relative_pointer_manager_v1_create(display);
+	constraints->seat = seat;
+	constraints->cursor = cursor;
+	constraints->active = NULL;
+	constraints->activations = constraints->locked_motions = constraints->confined_motions = 0;
+
+	constraints->new_constraint.notify = constraints_new_constraint;
+	wl_signal_add(&constraints->manager->events.new_constraint, &constraints->new_constraint);
+	constraints->focus_change.notify = constraints_focus_change;
+	wl_signal_add(&seat->keyboard_state.events.focus_change, &constraints->focus_change);
+	constraints->pointer_focus_change.notify = constraints_pointer_focus_change;
+	wl_signal_add(&seat->pointer_state.events.focus_change,
+		&constraints->pointer_focus_change);
+}
+
+void pointer_constraints_finish(struct PointerConstraints *constraints)
+{
+	/* The constraints themselves go with their clients. */
+	wl_list_remove(&constraints->new_constraint.link);
+	wl_list_remove(&constraints->focus_change.link);
+	wl_list_remove(&constraints->pointer_focus_change.link);
+	constraints->active = NULL;
+}
+
+bool pointer_constraints_motion(struct PointerConstraints *constraints, uint32_t time_msec,
+	double *dx, double *dy, double dx_unaccel, double dy_unaccel, bool constrain)
+{
+	wlr_relative_pointer_manager_v1_send_relative_motion(constraints->relative,
+		constraints->seat, (uint64_t)time_msec * 1000, *dx, *dy, dx_unaccel, dy_unaccel);
+
+	struct wlr_pointer_constraint_v1 *active = constraints->active;
+	struct wlr_seat_pointer_state *pointer = &constraints->seat->pointer_state;
+	if (active == NULL || !constrain || pointer->focused_surface != active->surface)
+	{
+		return false;
+	}
+
+	if (active->type == WLR_POINTER_CONSTRAINT_V1_LOCKED)
+	{
+		constraints->locked_motions++;
+		return true;
+	}
+
+	/* The seat already knows where the pointer is on the surface. */
+	double sx, sy;
+	if (wlr_region_confine(&active->region, pointer->sx, pointer->sy,
+			pointer->sx + *dx, pointer->sy + *dy, &sx, &sy))
+	{
+		if (sx != pointer->sx + *dx || sy != pointer->sy + *dy)
+		{
+			constraints->confined_motions++;
+		}
+		*dx = sx - pointer->sx;
+		*dy = sy - pointer->sy;
+	}
+	return false;
+}
+
+void pointer_constraints_write_summary(struct PointerConstraints *constraints, FILE *out)
+{
+	struct wlr_pointer_constraint_v1 *active = constraints->active;
+
+	fprintf(out, "active %s activations %" PRIu64 " locked_motions %" PRIu64
+		" confined_motions %" PRIu64 "\n",
+		active == NULL ? "none" :
+			active->type == WLR_POINTER_CONSTRAINT_V1_LOCKED ? "locked" : "confined",
+		constraints->activations, constraints->locked_motions,
+		constraints->confined_motions);
+}
@@ -0,0 +1,59 @@
+#ifndef CONSTRAINT_H_
+#define CONSTRAINT_H_
+
+#include <stdio.h>
+#include "wayland.h"
+
+/*
+ * Pointer constraints (zwp_pointer_constraints_v1) and relative pointer
+ * motion (zwp_relative_pointer_manager_v1), for games and other clients
+ * that steer with the mouse rather than point with it.
+ *
+ * A constraint is active while its surface has both keyboard and pointer
+ * focus, since it is only enforced while the pointer is over it. Every
+ * motion is forwarded unaccelerated to the focused client's relative
+ * pointers first; absolute motion, from nested backends, tablets and VM
+ * pointers, as the delta it amounts to. Then, when the pointer is over the constrained
+ * surface: a lock consumes the motion outright, so the cursor stays put
+ * and the hit test and scene lookup of normal motion are skipped, and a
+ * confinement clips the motion to the constraint's region.
+ */
+struct PointerConstraint
+{
+	struct PointerConstraints *owner;
+	struct wlr_pointer_constraint_v1 *constraint;
+	struct wl_listener destroy;
+};
+
+struct PointerConstraints
+{
+	struct wlr_pointer_constraints_v1 *manager;
+	struct wlr_relative_pointer_manager_v1 *relative;
+	struct wlr_seat *seat;
+	struct wlr_cursor *cursor;
+	struct wlr_pointer_constraint_v1 *active;
+	struct wl_listener new_constraint;
+	struct wl_listener focus_change;         /* keyboard */
+	struct wl_listener pointer_focus_change;
+
+	uint64_t activations;
+	uint64_t locked_motions;   /* consumed on the fast path */
+	uint64_t confined_motions; /* clipped to a region */
+};
+
+void pointer_constraints_init(struct PointerConstraints *constraints,
+	struct wl_display *display, struct wlr_seat *seat, struct wlr_cursor *cursor);
+void pointer_constraints_finish(struct PointerConstraints *constraints);
+
+/*
+ * Called for each motion before the cursor moves, absolute motion as the
+ * delta it amounts to, with `constrain`
+ * false during interactive moves and resizes. Returns true if a lock took
+ * the motion; otherwise `dx` and `dy` may have been confined.
+ */
+bool pointer_constraints_motion(struct PointerConstraints *constraints, uint32_t time_msec,
+	double *dx, double *dy, double dx_unaccel, double dy_unaccel, bool constrain);
+
+void pointer_constraints_write_summary(struct PointerConstraints *constraints, FILE *out);
+
+#endif
@@ -0,0 +1,33 @@
+#include <string.h>
+
+#include "content.h"
+
+static const struct ContentPolicy policies[] = {
+	[WP_CONTENT_TYPE_V1_TYPE_NONE] = { "none", CONTENT_SCHEDULE_VSYNC, 0 },
+	[WP_CONTENT_TYPE_V1_TYPE_PHOTO] = { "photo", CONTENT_SCHEDULE_VSYNC, 0 },
+	[WP_CONTENT_TYPE_V1_TYPE_VIDEO] = { "video", CONTENT_SCHEDULE_ADAPTIVE, 10 },
+	[WP_CONTENT_TYPE_V1_TYPE_GAME] = { "game", CONTENT_SCHEDULE_TEARING, 1 },
+};
+
+const struct ContentPolicy *content_policy(enum wp_content_type_v1_type type)
+{
+	/* Types from a newer protocol version are treated like none. */
+	if ((size_t)type >= sizeof(policies) / sizeof(policies[0]))
+	{
+		type = WP_CONTENT_TYPE_V1_TYPE_NONE;
+	}
+	return &policies[type];
+}
+
+bool content_type_parse(const char *name, enum wp_content_type_v1_type *type)
+{
+	for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+	{
+		if (strcmp(policies[i].name, name) == 0)
+		{
+			*type = i;
+			return true;
+		}
+	}
+	return false;
+}
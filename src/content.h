@@ -0,0 +1,44 @@
+#ifndef CONTENT_H_
+#define CONTENT_H_
+
+#include "wayland.h"
+
+/*
+ * What a window shows, as reported over wp_content_type_v1 or set by a
+ * `content=` rule, picks the trade-offs made for it:
+ *
+ *   type    output, while in front       frame callbacks while hidden
+ *   none    vsync                        none
+ *   photo   vsync                        none
+ *   video   adaptive sync                10 per second
+ *   game    adaptive sync and tearing    1 per second
+ *
+ * Adaptive sync lets the refresh rate follow a video's or game's own
+ * cadence instead of juddering against a fixed one; it is only switched on
+ * while that window covers the whole output, so no window sets the rate for
+ * others it shares the screen with. Games additionally get async page
+ * flips, trading tearing for latency. Hidden windows get no callbacks from
+ * the scene at all; the rate above keeps them ticking over without drawing
+ * frames nobody sees. Most windows never say what they show, so anything
+ * else has to opt in, with a `hidden_fps=` rule or by being a video or a
+ * game; an overlapped desktop then wakes nobody.
+ */
+enum ContentSchedule
+{
+	CONTENT_SCHEDULE_VSYNC,
+	CONTENT_SCHEDULE_ADAPTIVE,
+	CONTENT_SCHEDULE_TEARING,
+};
+
+struct ContentPolicy
+{
+	const char *name;
+	enum ContentSchedule schedule;
+	unsigned int hidden_fps;
+};
+
+const struct ContentPolicy *content_policy(enum wp_content_type_v1_type type);
+/* For rules: "none", "photo", "video" or "game". */
+bool content_type_parse(const char *name, enum wp_content_type_v1_type *type);
+
+#endif
@@ -0,0 +1,193 @@
+#include <inttypes.h>
+
+#include "foreign.h"
+
+void foreign_toplevels_init(struct ForeignToplevels *foreign, struct wl_display *display)
+{
+	foreign->manager = wlr_foreign_toplevel_manager_v1_create(display);
+	foreign->list = wlr_ext_foreign_toplevel_list_v1_create(display, 1);
+	foreign->loop = wl_display_get_event_loop(display);
+	foreign->idle = NULL;
+	foreign->changes = foreign->batches = 0;
+	wl_list_init(&foreign->toplevels);
+	wl_list_init(&foreign->dirty);
+}
+
+void foreign_toplevels_finish(struct ForeignToplevels *foreign)
+{
+	if (foreign->idle != NULL)
+	{
+		wl_event_source_remove(foreign->idle);
+		foreign->idle = NULL;
+	}
+}
+
+static void foreign_send(struct ForeignToplevels *foreign, struct ForeignToplevel *toplevel,
+	uint32_t dirty)
+{
+	const char *title = toplevel->xdg_toplevel->title;
+	const char *app_id = toplevel->xdg_toplevel->app_id;
+
+	/* wlroots closes this batch with one done event of its own, from an
+	 * idle source that still runs in this iteration. */
+	if (dirty & FOREIGN_TITLE)
+	{
+		wlr_foreign_toplevel_handle_v1_set_title(toplevel->handle, title ? title : "");
+	}
+	if (dirty & FOREIGN_APP_ID)
+	{
+		wlr_foreign_toplevel_handle_v1_set_app_id(toplevel->handle, app_id ? app_id : "");
+	}
+	if (dirty & FOREIGN_ACTIVATED)
+	{
+		wlr_foreign_toplevel_handle_v1_set_activated(toplevel->handle, toplevel->activated);
+	}
+	if ((dirty & FOREIGN_OUTPUT) && toplevel->output != toplevel->sent_output)
+	{
+		if (toplevel->sent_output != NULL)
+		{
+			wlr_foreign_toplevel_handle_v1_output_leave(toplevel->handle,
+				toplevel->sent_output);
+		}
+		if (toplevel->output != NULL)
+		{
+			wlr_foreign_toplevel_handle_v1_output_enter(toplevel->handle, toplevel->output);
+		}
+		toplevel->sent_output = toplevel->output;
+	}
+
+	/* The ext list only knows titles and app_ids, and sends both followed
+	 * by done on every update. */
+	struct wlr_ext_foreign_toplevel_handle_v1_state state = {
+		.title = title,
+		.app_id = app_id,
+	};
+	if (toplevel->ext_handle == NULL)
+	{
+		toplevel->ext_handle = wlr_ext_foreign_toplevel_handle_v1_create(foreign->list,
+			&state);
+	} else if (dirty & (FOREIGN_TITLE | FOREIGN_APP_ID))
+	{
+		wlr_ext_foreign_toplevel_handle_v1_update_state(toplevel->ext_handle, &state);
+	}
+}
+
+static void foreign_flush(void *data)
+{
+	struct ForeignToplevels *foreign = data;
+	struct ForeignToplevel *toplevel, *tmp;
+
+	foreign->idle = NULL;
+	foreign->batches++;
+	wl_list_for_each_safe(toplevel, tmp, &foreign->dirty, dirty_link)
+	{
+		uint32_t dirty = toplevel->dirty;
+		toplevel->dirty = 0;
+		wl_list_remove(&toplevel->dirty_link);
+		wl_list_init(&toplevel->dirty_link);
+		foreign_send(foreign, toplevel, dirty);
+	}
+}
+
+void foreign_toplevel_update(struct ForeignToplevels *foreign,
+	struct ForeignToplevel *toplevel, uint32_t what)
+{
+	if (toplevel->handle == NULL)
+	{
+		return;
+	}
+
+	foreign->changes++;
+	if (toplevel->dirty == 0)
+	{
+		wl_list_insert(foreign->dirty.prev, &toplevel->dirty_link);
+	}
+	toplevel->dirty |= what;
+
+	if (foreign->idle == NULL)
+	{
+		foreign->idle = wl_event_loop_add_idle(foreign->loop, foreign_flush, foreign);
+	}
+}
+
+void foreign_toplevel_create(struct ForeignToplevels *foreign,
+	struct ForeignToplevel *toplevel, struct wlr_xdg_toplevel *xdg_toplevel)
+{
+	toplevel->xdg_toplevel = xdg_toplevel;
+	toplevel->handle = wlr_foreign_toplevel_handle_v1_create(foreign->manager);
+	toplevel->ext_handle = NULL;
+	toplevel->sent_output = NULL;
+	toplevel->dirty = 0;
+	wl_list_init(&toplevel->dirty_link);
+	wl_list_insert(&foreign->toplevels, &toplevel->link);
+
+	/* Nothing is announced until the first flush, which then sends the
+	 * whole initial state in one batch. */
+	foreign_toplevel_update(foreign, toplevel, FOREIGN_ALL);
+}
+
+void foreign_toplevel_destroy(struct ForeignToplevels *foreign,
+	struct ForeignToplevel *toplevel)
+{
+	if (toplevel->handle == NULL)
+	{
+		return;
+	}
+
+	wl_list_remove(&toplevel->dirty_link);
+	wl_list_remove(&toplevel->link);
+	wlr_foreign_toplevel_handle_v1_destroy(toplevel->handle);
+	toplevel->handle = NULL;
+	if (toplevel->ext_handle != NULL)
+	{
+		wlr_ext_foreign_toplevel_handle_v1_destroy(toplevel->ext_handle);
+		toplevel->ext_handle = NULL;
+	}
+	toplevel->dirty = 0;
+	toplevel->output = NULL;
+}
+
+void foreign_toplevel_set_activated(struct ForeignToplevels *foreign,
+	struct ForeignToplevel *toplevel, bool activated)
+{
+	if (toplevel->activated != activated)
+	{
+		toplevel->activated = activated;
+		foreign_toplevel_update(foreign, toplevel, FOREIGN_ACTIVATED);
+	}
+}
+
+void foreign_toplevel_set_output(struct ForeignToplevels *foreign,
+	struct ForeignToplevel *toplevel, struct wlr_output *output)
+{
+	/* Cheap enough to call on every step of an interactive move. */
+	if (toplevel->output != output)
+	{
+		toplevel->output = output;
+		foreign_toplevel_update(foreign, toplevel, FOREIGN_OUTPUT);
+	}
+}
+
+void foreign_toplevels_output_destroyed(struct ForeignToplevels *foreign,
+	struct wlr_output *output)
+{
+	/* wlroots already sent output_leave; only forget the pointer. */
+	struct ForeignToplevel *toplevel;
+	wl_list_for_each(toplevel, &foreign->toplevels, link)
+	{
+		if (toplevel->output == output)
+		{
+			toplevel->output = NULL;
+		}
+		if (toplevel->sent_output == output)
+		{
+			toplevel->sent_output = NULL;
+		}
+	}
+}
+
+void foreign_toplevels_write_summary(struct ForeignToplevels *foreign, FILE *out)
+{
+	fprintf(out, "toplevels %d changes %" PRIu64 " batches %" PRIu64 "\n",
+		wl_list_length(&foreign->toplevels), foreign->changes, foreign->batches);
+}
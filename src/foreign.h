@@ -0,0 +1,75 @@
+#ifndef FOREIGN_H_
+#define FOREIGN_H_
+
+#include <stdio.h>
+#include "wayland.h"
+
+/*
+ * Window lists for taskbars and docks, over both wlr-foreign-toplevel-management
+ * and ext-foreign-toplevel-list. Every mapped toplevel gets a handle on
+ * each protocol.
+ *
+ * Changes are never sent on the spot: they set dirty bits, and an idle
+ * source sends everything that changed during the event-loop iteration in
+ * one go, closed by a single done event. A window that is retitled,
+ * focused and moved to another output at once makes the taskbar redraw
+ * once, not three times.
+ */
+enum ForeignDirty
+{
+	FOREIGN_TITLE = 1 << 0,
+	FOREIGN_APP_ID = 1 << 1,
+	FOREIGN_ACTIVATED = 1 << 2,
+	FOREIGN_OUTPUT = 1 << 3,
+	FOREIGN_ALL = (1 << 4) - 1,
+};
+
+struct ForeignToplevel
+{
+	struct wl_list link;       /* ForeignToplevels.toplevels */
+	struct wl_list dirty_link; /* ForeignToplevels.dirty */
+	uint32_t dirty;
+	struct wlr_xdg_toplevel *xdg_toplevel;
+	struct wlr_foreign_toplevel_handle_v1 *handle;
+	struct wlr_ext_foreign_toplevel_handle_v1 *ext_handle;
+	bool activated;
+	struct wlr_output *output;      /* the output the window is on */
+	struct wlr_output *sent_output; /* the output clients were told about */
+};
+
+struct ForeignToplevels
+{
+	struct wlr_foreign_toplevel_manager_v1 *manager;
+	struct wlr_ext_foreign_toplevel_list_v1 *list;
+	struct wl_event_loop *loop;
+	struct wl_event_source *idle;
+	struct wl_list toplevels; /* ForeignToplevel.link */
+	struct wl_list dirty;     /* ForeignToplevel.dirty_link */
+	uint64_t changes;
+	uint64_t batches;
+};
+
+void foreign_toplevels_init(struct ForeignToplevels *foreign, struct wl_display *display);
+void foreign_toplevels_finish(struct ForeignToplevels *foreign);
+
+/* Called on map; `toplevel->handle` exists afterwards, so its requests can
+ * be listened to. */
+void foreign_toplevel_create(struct ForeignToplevels *foreign,
+	struct ForeignToplevel *toplevel, struct wlr_xdg_toplevel *xdg_toplevel);
+/* Called on unmap. */
+void foreign_toplevel_destroy(struct ForeignToplevels *foreign,
+	struct ForeignToplevel *toplevel);
+
+/* Marks ForeignDirty bits; harmless on a toplevel that is not mapped. */
+void foreign_toplevel_update(struct ForeignToplevels *foreign,
+	struct ForeignToplevel *toplevel, uint32_t what);
+void foreign_toplevel_set_activated(struct ForeignToplevels *foreign,
+	struct ForeignToplevel *toplevel, bool activated);
+void foreign_toplevel_set_output(struct ForeignToplevels *foreign,
+	struct ForeignToplevel *toplevel, struct wlr_output *output);
+void foreign_toplevels_output_destroyed(struct ForeignToplevels *foreign,
+	struct wlr_output *output);
+
+void foreign_toplevels_write_summary(struct ForeignToplevels *foreign, FILE *out);
+
+#endif
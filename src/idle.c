@@ -0,0 +1,200 @@
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "idle.h"
+#include "metrics.h"
+
+static bool idle_inhibited(struct Idle *idle)
+{
+	/* An inhibitor only counts while its surface is on screen, so a player
+	 * left paused in the background does not keep the outputs on forever. */
+	struct IdleInhibitor *inhibitor;
+	wl_list_for_each(inhibitor, &idle->inhibitors, link)
+	{
+		if (inhibitor->inhibitor->surface->mapped)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static void idle_update_inhibited(struct Idle *idle)
+{
+	bool inhibited = idle_inhibited(idle);
+	if (inhibited != idle->inhibited)
+	{
+		idle->inhibited = inhibited;
+		wlr_idle_notifier_v1_set_inhibited(idle->notifier, inhibited);
+	}
+}
+
+static void idle_arm(struct Idle *idle, uint64_t delay_ns)
+{
+	idle->armed = delay_ns > 0;
+	wl_event_source_timer_update(idle->timer,
+		delay_ns > 0 ? (int)((delay_ns + 999999) / 1000000) : 0);
+}
+
+static int idle_timeout(void *data)
+{
+	struct Idle *idle = data;
+	uint64_t elapsed = metrics_now_ns() - idle->activity_ns;
+
+	idle->armed = false;
+	if (idle->timeout_ns == 0 || idle->idle)
+	{
+		return 0;
+	}
+	if (elapsed < idle->timeout_ns)
+	{
+		idle_arm(idle, idle->timeout_ns - elapsed);
+		return 0;
+	}
+
+	if (idle->inhibited)
+	{
+		idle->inhibited_timeouts++;
+		idle_arm(idle, idle->timeout_ns);
+		return 0;
+	}
+
+	wlr_log(WLR_INFO, "Idle for %" PRIu64 "s, turning outputs off",
+		elapsed / 1000000000);
+	idle->idle = true;
+	idle->sleeps++;
+	idle->set_idle(idle->data, true);
+	return 0;
+}
+
+void idle_activity(struct Idle *idle)
+{
+	idle->activity_ns = metrics_now_ns();
+	wlr_idle_notifier_v1_notify_activity(idle->notifier, idle->seat);
+
+	if (idle->idle)
+	{
+		wlr_log(WLR_INFO, "Input while idle, turning outputs on");
+		idle->idle = false;
+		idle->set_idle(idle->data, false);
+	}
+	if (!idle->armed && idle->timeout_ns > 0)
+	{
+		idle_arm(idle, idle->timeout_ns);
+	}
+}
+
+static void inhibitor_release(struct IdleInhibitor *inhibitor)
+{
+	wl_list_remove(&inhibitor->destroy.link);
+	wl_list_remove(&inhibitor->map.link);
+	wl_list_remove(&inhibitor->unmap.link);
+	wl_list_remove(&inhibitor->link);
+	free(inhibitor);
+}
+
+static void inhibitor_destroy(struct wl_listener *listener, void *data)
+{
+	/* An inhibitor goes at the latest with its surface's destroy signal,
+	 * while the surface's own signals are still there to leave. */
+	struct IdleInhibitor *inhibitor = wl_container_of(listener, inhibitor, destroy);
+	struct Idle *idle = inhibitor->idle;
+
+	inhibitor_release(inhibitor);
+	idle_update_inhibited(idle);
+}
+
+static void inhibitor_map(struct wl_listener *listener, void *data)
+{
+	/* A player may create its inhibitor before its window shows, and
+	 * notify clients have to hear about it either way. */
+	struct IdleInhibitor *inhibitor = wl_container_of(listener, inhibitor, map);
+	idle_update_inhibited(inhibitor->idle);
+}
+
+static void inhibitor_unmap(struct wl_listener *listener, void *data)
+{
+	struct IdleInhibitor *inhibitor = wl_container_of(listener, inhibitor, unmap);
+	idle_update_inhibited(inhibitor->idle);
+}
+
+static void idle_new_inhibitor(struct wl_listener *listener, void *data)
+{
+	struct Idle *idle = wl_container_of(listener, idle, new_inhibitor);
+	struct wlr_idle_inhibitor_v1 *wlr_inhibitor = data;
+
+	struct IdleInhibitor *inhibitor = calloc(1, sizeof(*inhibitor));
+	if (inhibitor == NULL)
+	{
+		wlr_log(WLR_ERROR, "Failed to allocate an idle inhibitor");
+		return;
+	}
+	inhibitor->idle = idle;
+	inhibitor->inhibitor = wlr_inhibitor;
+	inhibitor->destroy.notify = inhibitor_destroy;
+	wl_signal_add(&wlr_inhibitor->events.destroy, &inhibitor->destroy);
+	inhibitor->map.notify = inhibitor_map;
+	wl_signal_add(&wlr_inhibitor->surface->events.map, &inhibitor->map);
+	inhibitor->unmap.notify = inhibitor_unmap;
+	wl_signal_add(&wlr_inhibitor->surface->events.unmap, &inhibitor->unmap);
+	wl_list_insert(&idle->inhibitors, &inhibitor->link);
+	idle_update_inhibited(idle);
+}
+
+void idle_init(struct Idle *idle, struct wl_display *display, struct wlr_seat *seat,
+	unsigned int timeout_s, void (*set_idle)(void *data, bool idle), void *data)
+{
+	idle->notifier = wlr_idle_notifier_v1_create(display);
+	idle->inhibit_manager = wlr_idle_inhibit_v1_create(display);
+	idle->seat = seat;
+	idle->set_idle = set_idle;
+	idle->data = data;
+	idle->inhibited = idle->idle = false;
+	idle->sleeps = idle->inhibited_timeouts = 0;
+	wl_list_init(&idle->inhibitors);
+	idle->new_inhibitor.notify = idle_new_inhibitor;
+	wl_signal_add(&idle->inhibit_manager->events.new_inhibitor, &idle->new_inhibitor);
+
+	idle->timer = wl_event_loop_add_timer(wl_display_get_event_loop(display), idle_timeout,
+		idle);
+	idle->armed = false;
+	idle->activity_ns = metrics_now_ns();
+	idle_set_timeout(idle, timeout_s);
+}
+
+void idle_finish(struct Idle *idle)
+{
+	struct IdleInhibitor *inhibitor, *tmp;
+	wl_list_for_each_safe(inhibitor, tmp, &idle->inhibitors, link)
+	{
+		inhibitor_release(inhibitor);
+	}
+	wl_list_remove(&idle->new_inhibitor.link);
+	if (idle->timer != NULL)
+	{
+		wl_event_source_remove(idle->timer);
+		idle->timer = NULL;
+	}
+}
+
+void idle_set_timeout(struct Idle *idle, unsigned int timeout_s)
+{
+	/* Counted from the last input, so shortening it can send the outputs
+	 * to sleep right away. */
+	idle->timeout_ns = (uint64_t)timeout_s * 1000000000ull;
+	idle_arm(idle, 0);
+	if (idle->timeout_ns > 0 && !idle->idle)
+	{
+		uint64_t elapsed = metrics_now_ns() - idle->activity_ns;
+		idle_arm(idle, elapsed < idle->timeout_ns ? idle->timeout_ns - elapsed : 1);
+	}
+}
+
+void idle_write_summary(struct Idle *idle, FILE *out)
+{
+	fprintf(out, "timeout %" PRIu64 "s idle %s inhibitors %d inhibited %s\n",
+		idle->timeout_ns / 1000000000, idle->idle ? "yes" : "no",
+		wl_list_length(&idle->inhibitors), idle->inhibited ? "yes" : "no");
+	fprintf(out, "sleeps %" PRIu64 " inhibited_timeouts %" PRIu64 "\n",
+		idle->sleeps, idle->inhibited_timeouts);
+}
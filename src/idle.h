@@ -0,0 +1,58 @@
+#ifndef IDLE_H_
+#define IDLE_H_
+
+#include <stdio.h>
+#include "wayland.h"
+
+/*
+ * Idle tracking: ext-idle-notify-v1 for clients (screen lockers, status
+ * bars), idle-inhibit-unstable-v1 for video players and the like, and the
+ * compositor's own policy on top of both. Once no input arrived for the
+ * configured timeout and no inhibitor is on a mapped surface, every output
+ * is disabled, so nothing renders or commits and clients get no frame
+ * callbacks. The next input event turns them back on.
+ *
+ * Input arrives far more often than the timeout runs out, so an event only
+ * records its time; the timer is left alone and, when it fires early,
+ * re-armed for what remains.
+ */
+struct IdleInhibitor
+{
+	struct wl_list link;
+	struct Idle *idle;
+	struct wlr_idle_inhibitor_v1 *inhibitor;
+	struct wl_listener destroy;
+	struct wl_listener map;   /* on the inhibitor's surface */
+	struct wl_listener unmap;
+};
+
+struct Idle
+{
+	struct wlr_idle_notifier_v1 *notifier;
+	struct wlr_idle_inhibit_manager_v1 *inhibit_manager;
+	struct wlr_seat *seat;
+	struct wl_listener new_inhibitor;
+	struct wl_list inhibitors; /* IdleInhibitor.link */
+	struct wl_event_source *timer;
+	bool armed;
+	uint64_t timeout_ns;  /* 0 for never */
+	uint64_t activity_ns; /* last input */
+	bool inhibited;       /* as last told to the notifier */
+	bool idle;            /* outputs are off */
+	void (*set_idle)(void *data, bool idle);
+	void *data;
+
+	uint64_t sleeps;
+	uint64_t inhibited_timeouts; /* timeouts an inhibitor kept the outputs on through */
+};
+
+void idle_init(struct Idle *idle, struct wl_display *display, struct wlr_seat *seat,
+	unsigned int timeout_s, void (*set_idle)(void *data, bool idle), void *data);
+void idle_finish(struct Idle *idle);
+void idle_set_timeout(struct Idle *idle, unsigned int timeout_s);
+/* To be called for every input event; wakes the outputs if they are off. */
+void idle_activity(struct Idle *idle);
+
+void idle_write_summary(struct Idle *idle, FILE *out);
+
+#endif
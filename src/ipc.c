@@ -0,0 +1,258 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "ipc.h"
+
+/*
+ * A tiny line-based control socket. A client connects to
+ * $XDG_RUNTIME_DIR/scowl-$WAYLAND_DISPLAY.sock, writes a single request line
+ * ("<command> [args]\n"), reads the reply until EOF and disconnects. Replies
+ * are produced in full before anything is written, and written without
+ * blocking from the event loop, so a slow reader can never stall a frame.
+ */
+
+#define IPC_REQUEST_MAX 512
+
+struct IpcConnection
+{
+	struct wl_list link;
+	struct Ipc *ipc;
+	int fd;
+	struct wl_event_source *source;
+	char request[IPC_REQUEST_MAX];
+	size_t request_len;
+	char *reply;
+	size_t reply_len, reply_off;
+};
+
+static void ipc_connection_destroy(struct IpcConnection *conn)
+{
+	wl_event_source_remove(conn->source);
+	close(conn->fd);
+	wl_list_remove(&conn->link);
+	free(conn->reply);
+	free(conn);
+}
+
+static void ipc_dispatch(struct IpcConnection *conn, FILE *out)
+{
+	struct Ipc *ipc = conn->ipc;
+	char *name = conn->request;
+	char *args = strchr(name, ' ');
+
+	if (args != NULL)
+	{
+		*args++ = '\0';
+	} else
+	{
+		args = name + strlen(name);
+	}
+
+	struct IpcCommand *cmd;
+	wl_list_for_each(cmd, &ipc->commands, link)
+	{
+		if (strcmp(cmd->name, name) == 0)
+		{
+			cmd->handler(out, args, cmd->data);
+			return;
+		}
+	}
+
+	if (strcmp(name, "help") != 0)
+	{
+		fprintf(out, "error: unknown command '%s'\n", name);
+	}
+
+	wl_list_for_each_reverse(cmd, &ipc->commands, link)
+	{
+		fprintf(out, "%-12s %s\n", cmd->name, cmd->help);
+	}
+}
+
+static int ipc_connection_write(struct IpcConnection *conn)
+{
+	while (conn->reply_off < conn->reply_len)
+	{
+		/* A peer that already hung up gets EPIPE, not a SIGPIPE for us. */
+		ssize_t n = send(conn->fd, conn->reply + conn->reply_off,
+			conn->reply_len - conn->reply_off, MSG_NOSIGNAL);
+		if (n < 0)
+		{
+			if (errno == EAGAIN || errno == EINTR)
+			{
+				return 0;
+			}
+			break;
+		}
+		conn->reply_off += n;
+	}
+
+	ipc_connection_destroy(conn);
+	return 0;
+}
+
+static int ipc_connection_handle(int fd, uint32_t mask, void *data)
+{
+	struct IpcConnection *conn = data;
+
+	if (conn->reply != NULL)
+	{
+		return ipc_connection_write(conn);
+	}
+
+	if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR))
+	{
+		ipc_connection_destroy(conn);
+		return 0;
+	}
+
+	ssize_t n = read(fd, conn->request + conn->request_len,
+		sizeof(conn->request) - conn->request_len - 1);
+	if (n <= 0)
+	{
+		if (n < 0 && (errno == EAGAIN || errno == EINTR))
+		{
+			return 0;
+		}
+		ipc_connection_destroy(conn);
+		return 0;
+	}
+	conn->request_len += n;
+	conn->request[conn->request_len] = '\0';
+
+	char *end = strchr(conn->request, '\n');
+	if (end == NULL)
+	{
+		if (conn->request_len + 1 >= sizeof(conn->request))
+		{
+			wlr_log(WLR_ERROR, "IPC request too long; dropping connection");
+			ipc_connection_destroy(conn);
+		}
+		return 0;
+	}
+	*end = '\0';
+
+	FILE *out = open_memstream(&conn->reply, &conn->reply_len);
+	if (out == NULL)
+	{
+		ipc_connection_destroy(conn);
+		return 0;
+	}
+	ipc_dispatch(conn, out);
+	fclose(out);
+
+	wl_event_source_fd_update(conn->source, WL_EVENT_WRITABLE);
+	return ipc_connection_write(conn);
+}
+
+static int ipc_handle_accept(int fd, uint32_t mask, void *data)
+{
+	struct Ipc *ipc = data;
+
+	int client_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (client_fd < 0)
+	{
+		return 0;
+	}
+
+	struct IpcConnection *conn = calloc(1, sizeof(*conn));
+	conn->ipc = ipc;
+	conn->fd = client_fd;
+	conn->source = wl_event_loop_add_fd(ipc->loop, client_fd,
+		WL_EVENT_READABLE, ipc_connection_handle, conn);
+	wl_list_insert(&ipc->connections, &conn->link);
+
+	return 0;
+}
+
+bool ipc_init(struct Ipc *ipc, struct wl_event_loop *loop, const char *display)
+{
+	const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+
+	wl_list_init(&ipc->commands);
+	wl_list_init(&ipc->connections);
+	ipc->loop = loop;
+	ipc->fd = -1;
+
+	if (runtime_dir == NULL)
+	{
+		wlr_log(WLR_ERROR, "XDG_RUNTIME_DIR is not set; IPC will not be available.");
+		return false;
+	}
+
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int len = snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/scowl-%s.sock",
+		runtime_dir, display);
+	if (len < 0 || (size_t)len >= sizeof(addr.sun_path))
+	{
+		wlr_log(WLR_ERROR, "IPC socket path is too long");
+		return false;
+	}
+	memcpy(ipc->path, addr.sun_path, sizeof(ipc->path));
+
+	ipc->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (ipc->fd < 0)
+	{
+		wlr_log_errno(WLR_ERROR, "Failed to create IPC socket");
+		return false;
+	}
+
+	unlink(ipc->path);
+	if (bind(ipc->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+		listen(ipc->fd, 8) < 0)
+	{
+		wlr_log_errno(WLR_ERROR, "Failed to bind IPC socket %s", ipc->path);
+		close(ipc->fd);
+		ipc->fd = -1;
+		return false;
+	}
+
+	ipc->source = wl_event_loop_add_fd(loop, ipc->fd, WL_EVENT_READABLE,
+		ipc_handle_accept, ipc);
+	setenv("SCOWL_SOCK", ipc->path, true);
+
+	wlr_log(WLR_INFO, "IPC listening on %s", ipc->path);
+	return true;
+}
+
+void ipc_register(struct Ipc *ipc, const char *name, const char *help,
+	ipc_handler_func_t handler, void *data)
+{
+	struct IpcCommand *cmd = calloc(1, sizeof(*cmd));
+	cmd->name = name;
+	cmd->help = help;
+	cmd->handler = handler;
+	cmd->data = data;
+	wl_list_insert(&ipc->commands, &cmd->link);
+}
+
+void ipc_finish(struct Ipc *ipc)
+{
+	struct IpcConnection *conn, *tmp_conn;
+	wl_list_for_each_safe(conn, tmp_conn, &ipc->connections, link)
+	{
+		ipc_connection_destroy(conn);
+	}
+
+	struct IpcCommand *cmd, *tmp_cmd;
+	wl_list_for_each_safe(cmd, tmp_cmd, &ipc->commands, link)
+	{
+		wl_list_remove(&cmd->link);
+		free(cmd);
+	}
+
+	if (ipc->fd >= 0)
+	{
+		wl_event_source_remove(ipc->source);
+		close(ipc->fd);
+		unlink(ipc->path);
+		ipc->fd = -1;
+	}
+}
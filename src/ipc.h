@@ -0,0 +1,35 @@
+#ifndef IPC_H_
+#define IPC_H_
+
+#include <stdio.h>
+#include "wayland.h"
+
+/* Handlers write their reply to `out`; `args` is the rest of the request line
+ * after the command name (never NULL, possibly empty). */
+typedef void (*ipc_handler_func_t)(FILE *out, const char *args, void *data);
+
+struct IpcCommand
+{
+	struct wl_list link;
+	const char *name;
+	const char *help;
+	ipc_handler_func_t handler;
+	void *data;
+};
+
+struct Ipc
+{
+	int fd;
+	char path[108];
+	struct wl_event_loop *loop;
+	struct wl_event_source *source;
+	struct wl_list commands;
+	struct wl_list connections;
+};
+
+bool ipc_init(struct Ipc *ipc, struct wl_event_loop *loop, const char *display);
+void ipc_register(struct Ipc *ipc, const char *name, const char *help,
+	ipc_handler_func_t handler, void *data);
+void ipc_finish(struct Ipc *ipc);
+
+#endif
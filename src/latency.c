@@ -0,0 +1,125 @@
+#include "latency.h"
+#include "metrics.h"
+
+/* Anything above this is a clock mismatch (e.g. a nested backend forwarding
+ * its parent's timestamps), not a latency. */
+#define LATENCY_MAX_NS 10000000000ull
+
+static uint64_t latency_event_ns(uint32_t time_msec)
+{
+	/* Event times are CLOCK_MONOTONIC milliseconds cut to 32 bits, which
+	 * wrap every 49.7 days; take the upper bits from the clock, choosing
+	 * whichever wrap puts the event nearest to now. */
+	uint64_t now_ms = metrics_now_ns() / 1000000;
+	uint64_t event_ms = (now_ms & ~(uint64_t)UINT32_MAX) | time_msec;
+	if (event_ms > now_ms + (1ull << 31) && event_ms >= (1ull << 32))
+	{
+		event_ms -= 1ull << 32;
+	} else if (event_ms + (1ull << 31) < now_ms)
+	{
+		event_ms += 1ull << 32;
+	}
+	return event_ms * 1000000;
+}
+
+void latency_input(struct InputLatency *tag, uint32_t time_msec)
+{
+	if (tag->state != INPUT_LATENCY_IDLE)
+	{
+		return;
+	}
+
+	tag->state = INPUT_LATENCY_DELIVERED;
+	tag->input_ns = latency_event_ns(time_msec);
+}
+
+void latency_commit(struct wl_list *pending, struct InputLatency *tag,
+	struct wlr_surface *surface)
+{
+	if (tag->state != INPUT_LATENCY_DELIVERED)
+	{
+		return;
+	}
+
+	tag->state = INPUT_LATENCY_COMMITTED;
+	tag->surface = surface;
+	wl_list_insert(pending, &tag->link);
+}
+
+static bool surface_on_output(struct wlr_surface *surface, struct wlr_output *output)
+{
+	struct wlr_surface_output *surface_output;
+	wl_list_for_each(surface_output, &surface->current_outputs, link)
+	{
+		if (surface_output->output == output)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void latency_output_commit(struct wl_list *pending, struct wlr_output *output)
+{
+	struct InputLatency *tag;
+	wl_list_for_each(tag, pending, link)
+	{
+		if (tag->state == INPUT_LATENCY_COMMITTED && surface_on_output(tag->surface, output))
+		{
+			tag->state = INPUT_LATENCY_SUBMITTED;
+			tag->output = output;
+			tag->commit_seq = output->commit_seq;
+		}
+	}
+}
+
+void latency_output_present(struct wl_list *pending,
+	const struct wlr_output_event_present *event)
+{
+	if (!event->presented || event->when == NULL)
+	{
+		return;
+	}
+
+	uint64_t when = timespec_to_ns(event->when);
+	struct InputLatency *tag, *tmp;
+	wl_list_for_each_safe(tag, tmp, pending, link)
+	{
+		if (tag->state != INPUT_LATENCY_SUBMITTED || tag->output != event->output ||
+			(int32_t)(event->commit_seq - tag->commit_seq) < 0)
+		{
+			continue;
+		}
+
+		if (when > tag->input_ns && when - tag->input_ns < LATENCY_MAX_NS)
+		{
+			struct ClientMetrics *client = wl_container_of(tag, client, input);
+			histogram_record(&client->input_latency, when - tag->input_ns);
+		}
+		latency_cancel(tag);
+	}
+}
+
+void latency_output_destroy(struct wl_list *pending, struct wlr_output *output)
+{
+	struct InputLatency *tag;
+	wl_list_for_each(tag, pending, link)
+	{
+		if (tag->state == INPUT_LATENCY_SUBMITTED && tag->output == output)
+		{
+			tag->state = INPUT_LATENCY_COMMITTED;
+			tag->output = NULL;
+		}
+	}
+}
+
+void latency_cancel(struct InputLatency *tag)
+{
+	if (tag->state == INPUT_LATENCY_COMMITTED || tag->state == INPUT_LATENCY_SUBMITTED)
+	{
+		wl_list_remove(&tag->link);
+	}
+	tag->state = INPUT_LATENCY_IDLE;
+	tag->surface = NULL;
+	tag->output = NULL;
+}
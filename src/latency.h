@@ -0,0 +1,43 @@
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include "wayland.h"
+
+/*
+ * End-to-end input latency: from the kernel timestamp of an input event to the
+ * presentation of the first frame containing the target client's response.
+ *
+ * Each client carries one tag. An input event delivered to the client arms it
+ * (events arriving while it is armed are folded into it, so we measure the
+ * oldest outstanding one), the client's next commit moves it to the server's
+ * pending list, the next output commit showing the surface pins it to that
+ * commit sequence, and that commit's present event resolves it.
+ */
+enum InputLatencyState
+{
+	INPUT_LATENCY_IDLE,
+	INPUT_LATENCY_DELIVERED,
+	INPUT_LATENCY_COMMITTED,
+	INPUT_LATENCY_SUBMITTED,
+};
+
+struct InputLatency
+{
+	enum InputLatencyState state;
+	uint64_t input_ns;
+	struct wlr_surface *surface;
+	struct wlr_output *output;
+	uint32_t commit_seq;
+	struct wl_list link; /* Server.latency_pending, once committed */
+};
+
+void latency_input(struct InputLatency *tag, uint32_t time_msec);
+void latency_commit(struct wl_list *pending, struct InputLatency *tag,
+	struct wlr_surface *surface);
+void latency_output_commit(struct wl_list *pending, struct wlr_output *output);
+void latency_output_present(struct wl_list *pending,
+	const struct wlr_output_event_present *event);
+void latency_output_destroy(struct wl_list *pending, struct wlr_output *output);
+void latency_cancel(struct InputLatency *tag);
+
+#endif
@@ -0,0 +1,681 @@
+/*
+ * scowl-load: a synthetic shm client for stress testing the compositor.
+ *
+ * Opens a number of xdg toplevels (each with optional popups) and commits
+ * buffers of a given size and damage pattern at a fixed rate, or as fast as
+ * frame callbacks allow. Reads commands from stdin ("resize W H", "stats",
+ * "quit") and reports the configure-to-commit latency it observes.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <wayland-client.h>
+
+#include "xdg-shell-client-protocol.h"
+
+#define LATENCY_SAMPLES 4096
+#define POPUP_SIZE 96
+#define RECT_SIZE 64
+
+enum DamagePattern
+{
+	DAMAGE_FULL,
+	DAMAGE_RECT,
+	DAMAGE_NONE,
+};
+
+struct Buffer
+{
+	struct wl_buffer *wl_buffer;
+	uint32_t *data;
+	size_t size;
+	int width, height;
+	bool busy;
+};
+
+struct Window
+{
+	struct Load *load;
+	struct wl_list link;
+	struct wl_surface *surface;
+	struct xdg_surface *xdg_surface;
+	struct xdg_toplevel *toplevel;
+	struct xdg_popup *popup;
+	struct Window *parent;
+	struct wl_callback *frame;
+	struct Buffer buffers[2];
+	int width, height;
+	int configured_width, configured_height;
+	bool configured;
+	bool has_popups;
+	uint32_t frame_no;
+	uint64_t configure_ns;
+};
+
+struct Load
+{
+	struct wl_display *display;
+	struct wl_registry *registry;
+	struct wl_compositor *compositor;
+	struct wl_shm *shm;
+	struct xdg_wm_base *wm_base;
+	struct wl_list windows;
+
+	int toplevels;
+	int popups;
+	int width, height;
+	int rate;
+	bool resize_storm;
+	enum DamagePattern damage;
+	bool running;
+
+	uint64_t commits;
+	uint64_t latencies[LATENCY_SAMPLES];
+	size_t latency_count;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void buffer_release(void *data, struct wl_buffer *wl_buffer)
+{
+	struct Buffer *buffer = data;
+	buffer->busy = false;
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+	.release = buffer_release,
+};
+
+static void buffer_destroy(struct Buffer *buffer)
+{
+	if (buffer->wl_buffer == NULL)
+	{
+		return;
+	}
+
+	wl_buffer_destroy(buffer->wl_buffer);
+	munmap(buffer->data, buffer->size);
+	memset(buffer, 0, sizeof(*buffer));
+}
+
+static bool buffer_create(struct Load *load, struct Buffer *buffer, int width, int height)
+{
+	int stride = width * 4;
+	size_t size = (size_t)stride * height;
+
+	int fd = memfd_create("scowl-load", MFD_CLOEXEC);
+	if (fd < 0 || ftruncate(fd, size) < 0)
+	{
+		perror("scowl-load: shm");
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+		return false;
+	}
+
+	buffer->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (buffer->data == MAP_FAILED)
+	{
+		perror("scowl-load: mmap");
+		close(fd);
+		return false;
+	}
+
+	struct wl_shm_pool *pool = wl_shm_create_pool(load->shm, fd, size);
+	buffer->wl_buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride,
+		WL_SHM_FORMAT_XRGB8888);
+	wl_shm_pool_destroy(pool);
+	close(fd);
+
+	wl_buffer_add_listener(buffer->wl_buffer, &buffer_listener, buffer);
+	buffer->size = size;
+	buffer->width = width;
+	buffer->height = height;
+	return true;
+}
+
+static struct Buffer *window_next_buffer(struct Window *window)
+{
+	for (size_t i = 0; i < 2; i++)
+	{
+		struct Buffer *buffer = &window->buffers[i];
+		if (buffer->busy)
+		{
+			continue;
+		}
+
+		if (buffer->wl_buffer != NULL &&
+			(buffer->width != window->width || buffer->height != window->height))
+		{
+			buffer_destroy(buffer);
+		}
+		if (buffer->wl_buffer == NULL &&
+			!buffer_create(window->load, buffer, window->width, window->height))
+		{
+			return NULL;
+		}
+		return buffer;
+	}
+
+	/* Both buffers are still held by the compositor; skip this frame. */
+	return NULL;
+}
+
+static void fill(struct Buffer *buffer, int x, int y, int width, int height, uint32_t color)
+{
+	for (int row = y; row < y + height && row < buffer->height; row++)
+	{
+		uint32_t *pixel = buffer->data + (size_t)row * buffer->width + x;
+		for (int col = x; col < x + width && col < buffer->width; col++)
+		{
+			*pixel++ = color;
+		}
+	}
+}
+
+static void window_frame_done(void *data, struct wl_callback *callback, uint32_t time);
+
+static const struct wl_callback_listener frame_listener = {
+	.done = window_frame_done,
+};
+
+static void window_create_popups(struct Window *window);
+
+static void window_draw(struct Window *window)
+{
+	struct Load *load = window->load;
+
+	if (!window->configured)
+	{
+		return;
+	}
+
+	struct Buffer *buffer = window_next_buffer(window);
+	if (buffer == NULL)
+	{
+		return;
+	}
+
+	uint32_t frame = window->frame_no++;
+	uint32_t background = 0xff202020 + (frame % 64) * 0x010101;
+
+	/* A fresh buffer has no previous contents, so always paint it fully. */
+	bool fresh = buffer->data[0] == 0;
+	switch (fresh ? DAMAGE_FULL : load->damage)
+	{
+	case DAMAGE_FULL:
+		fill(buffer, 0, 0, buffer->width, buffer->height, background);
+		wl_surface_damage_buffer(window->surface, 0, 0, buffer->width, buffer->height);
+		break;
+	case DAMAGE_RECT:
+	{
+		int x = (frame * 8) % (buffer->width > RECT_SIZE ? buffer->width - RECT_SIZE : 1);
+		int y = (frame * 5) % (buffer->height > RECT_SIZE ? buffer->height - RECT_SIZE : 1);
+		/* Only the moving square is redrawn and damaged; the two buffers
+		 * drift apart elsewhere, which is fine for a load generator. */
+		fill(buffer, x, y, RECT_SIZE, RECT_SIZE, 0xff000000 | (frame * 2654435761u));
+		wl_surface_damage_buffer(window->surface, x, y, RECT_SIZE, RECT_SIZE);
+		break;
+	}
+	case DAMAGE_NONE:
+		break;
+	}
+
+	if (load->rate == 0)
+	{
+		window->frame = wl_surface_frame(window->surface);
+		wl_callback_add_listener(window->frame, &frame_listener, window);
+	}
+
+	wl_surface_attach(window->surface, buffer->wl_buffer, 0, 0);
+	wl_surface_commit(window->surface);
+	buffer->busy = true;
+	load->commits++;
+
+	if (window->configure_ns != 0)
+	{
+		load->latencies[load->latency_count++ % LATENCY_SAMPLES] =
+			now_ns() - window->configure_ns;
+		window->configure_ns = 0;
+	}
+
+	if (window->toplevel != NULL && !window->has_popups)
+	{
+		window_create_popups(window);
+	}
+}
+
+static void window_frame_done(void *data, struct wl_callback *callback, uint32_t time)
+{
+	struct Window *window = data;
+
+	wl_callback_destroy(callback);
+	window->frame = NULL;
+
+	if (window->load->resize_storm && window->toplevel != NULL)
+	{
+		/* Oscillate between the requested size and 1.5x of it. */
+		int step = window->frame_no % 32;
+		int grow = step < 16 ? step : 32 - step;
+		window->width = window->load->width + window->load->width * grow / 32;
+		window->height = window->load->height + window->load->height * grow / 32;
+	}
+	window_draw(window);
+}
+
+static void xdg_surface_handle_configure(void *data, struct xdg_surface *xdg_surface,
+	uint32_t serial)
+{
+	struct Window *window = data;
+
+	xdg_surface_ack_configure(xdg_surface, serial);
+	if (window->configured_width > 0 && window->configured_height > 0)
+	{
+		window->width = window->configured_width;
+		window->height = window->configured_height;
+	}
+
+	bool first = !window->configured;
+	window->configured = true;
+	window->configure_ns = now_ns();
+
+	/* Answer every configure right away; this is what the latency measures. */
+	if (first || window->load->rate != 0 || window->frame == NULL)
+	{
+		window_draw(window);
+	}
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+	.configure = xdg_surface_handle_configure,
+};
+
+static void xdg_toplevel_handle_configure(void *data, struct xdg_toplevel *toplevel,
+	int32_t width, int32_t height, struct wl_array *states)
+{
+	struct Window *window = data;
+	window->configured_width = width;
+	window->configured_height = height;
+}
+
+static void xdg_toplevel_handle_close(void *data, struct xdg_toplevel *toplevel)
+{
+	struct Window *window = data;
+	window->load->running = false;
+}
+
+static const struct xdg_toplevel_listener xdg_toplevel_listener = {
+	.configure = xdg_toplevel_handle_configure,
+	.close = xdg_toplevel_handle_close,
+};
+
+static void xdg_popup_handle_configure(void *data, struct xdg_popup *popup,
+	int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	struct Window *window = data;
+	window->configured_width = width;
+	window->configured_height = height;
+}
+
+static void window_destroy(struct Window *window);
+
+static void xdg_popup_handle_done(void *data, struct xdg_popup *popup)
+{
+	/* A dismissed popup is never shown again; drop it and its surface
+	 * rather than keep them around for the rest of the run. */
+	window_destroy(data);
+}
+
+static const struct xdg_popup_listener xdg_popup_listener = {
+	.configure = xdg_popup_handle_configure,
+	.popup_done = xdg_popup_handle_done,
+};
+
+static struct Window *window_create(struct Load *load, struct Window *parent, int index)
+{
+	struct Window *window = calloc(1, sizeof(*window));
+	window->load = load;
+	window->parent = parent;
+	window->surface = wl_compositor_create_surface(load->compositor);
+	window->xdg_surface = xdg_wm_base_get_xdg_surface(load->wm_base, window->surface);
+	xdg_surface_add_listener(window->xdg_surface, &xdg_surface_listener, window);
+
+	if (parent == NULL)
+	{
+		char title[64];
+		snprintf(title, sizeof(title), "scowl-load %d", index);
+
+		window->width = load->width;
+		window->height = load->height;
+		window->toplevel = xdg_surface_get_toplevel(window->xdg_surface);
+		xdg_toplevel_add_listener(window->toplevel, &xdg_toplevel_listener, window);
+		xdg_toplevel_set_app_id(window->toplevel, "scowl-load");
+		xdg_toplevel_set_title(window->toplevel, title);
+	} else
+	{
+		struct xdg_positioner *positioner = xdg_wm_base_create_positioner(load->wm_base);
+		xdg_positioner_set_size(positioner, POPUP_SIZE, POPUP_SIZE);
+		xdg_positioner_set_anchor_rect(positioner, 16 + index * (POPUP_SIZE + 8), 16, 1, 1);
+		xdg_positioner_set_anchor(positioner, XDG_POSITIONER_ANCHOR_TOP_LEFT);
+		xdg_positioner_set_gravity(positioner, XDG_POSITIONER_GRAVITY_BOTTOM_RIGHT);
+
+		window->width = POPUP_SIZE;
+		window->height = POPUP_SIZE;
+		window->popup = xdg_surface_get_popup(window->xdg_surface, parent->xdg_surface,
+			positioner);
+		xdg_popup_add_listener(window->popup, &xdg_popup_listener, window);
+		xdg_positioner_destroy(positioner);
+	}
+
+	wl_surface_commit(window->surface);
+	wl_list_insert(load->windows.prev, &window->link);
+	return window;
+}
+
+static void window_create_popups(struct Window *window)
+{
+	/* Popups need a mapped parent, so they are created after its first
+	 * buffer has been committed. */
+	window->has_popups = true;
+	for (int i = 0; i < window->load->popups; i++)
+	{
+		window_create(window->load, window, i);
+	}
+}
+
+static void window_destroy(struct Window *window)
+{
+	if (window->frame != NULL)
+	{
+		wl_callback_destroy(window->frame);
+	}
+	if (window->popup != NULL)
+	{
+		xdg_popup_destroy(window->popup);
+	}
+	if (window->toplevel != NULL)
+	{
+		xdg_toplevel_destroy(window->toplevel);
+	}
+	xdg_surface_destroy(window->xdg_surface);
+	wl_surface_destroy(window->surface);
+	buffer_destroy(&window->buffers[0]);
+	buffer_destroy(&window->buffers[1]);
+	wl_list_remove(&window->link);
+	free(window);
+}
+
+static void wm_base_handle_ping(void *data, struct xdg_wm_base *wm_base, uint32_t serial)
+{
+	xdg_wm_base_pong(wm_base, serial);
+}
+
+static const struct xdg_wm_base_listener wm_base_listener = {
+	.ping = wm_base_handle_ping,
+};
+
+static void registry_handle_global(void *data, struct wl_registry *registry,
+	uint32_t name, const char *interface, uint32_t version)
+{
+	struct Load *load = data;
+
+	if (strcmp(interface, wl_compositor_interface.name) == 0)
+	{
+		load->compositor = wl_registry_bind(registry, name, &wl_compositor_interface, 4);
+	} else if (strcmp(interface, wl_shm_interface.name) == 0)
+	{
+		load->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+	} else if (strcmp(interface, xdg_wm_base_interface.name) == 0)
+	{
+		load->wm_base = wl_registry_bind(registry, name, &xdg_wm_base_interface, 1);
+		xdg_wm_base_add_listener(load->wm_base, &wm_base_listener, load);
+	}
+}
+
+static void registry_handle_global_remove(void *data, struct wl_registry *registry,
+	uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+	.global = registry_handle_global,
+	.global_remove = registry_handle_global_remove,
+};
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static void report(struct Load *load)
+{
+	size_t count = load->latency_count < LATENCY_SAMPLES ? load->latency_count : LATENCY_SAMPLES;
+	uint64_t sorted[LATENCY_SAMPLES];
+
+	printf("commits %llu configures %zu", (unsigned long long)load->commits,
+		load->latency_count);
+	if (count > 0)
+	{
+		memcpy(sorted, load->latencies, count * sizeof(*sorted));
+		qsort(sorted, count, sizeof(*sorted), compare_u64);
+		printf(" configure-to-commit p50=%.3fms p99=%.3fms max=%.3fms",
+			sorted[count / 2] / 1e6, sorted[count * 99 / 100] / 1e6, sorted[count - 1] / 1e6);
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+static void handle_command(struct Load *load, char *line)
+{
+	int width, height;
+
+	if (sscanf(line, "resize %d %d", &width, &height) == 2 && width > 0 && height > 0)
+	{
+		struct Window *window;
+		wl_list_for_each(window, &load->windows, link)
+		{
+			if (window->toplevel != NULL)
+			{
+				window->width = width;
+				window->height = height;
+				if (window->frame == NULL)
+				{
+					window_draw(window);
+				}
+			}
+		}
+		load->width = width;
+		load->height = height;
+	} else if (strncmp(line, "stats", 5) == 0)
+	{
+		report(load);
+	} else if (strncmp(line, "quit", 4) == 0)
+	{
+		load->running = false;
+	} else
+	{
+		fprintf(stderr, "scowl-load: commands: resize W H | stats | quit\n");
+	}
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [-n toplevels] [-p popups] [-s WxH] [-r hz] [-d full|rect|none] [-R]\n"
+		"  -r 0 (default) redraws on every frame callback\n"
+		"  -R   continuously resize toplevels (resize storm)\n", argv0);
+}
+
+int main(int argc, char *argv[])
+{
+	struct Load load = {
+		.toplevels = 1,
+		.width = 640,
+		.height = 480,
+		.damage = DAMAGE_FULL,
+		.running = true,
+	};
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:p:s:r:d:Rh")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n': load.toplevels = atoi(optarg); break;
+		case 'p': load.popups = atoi(optarg); break;
+		case 'r': load.rate = atoi(optarg); break;
+		case 'R': load.resize_storm = true; break;
+		case 's':
+			if (sscanf(optarg, "%dx%d", &load.width, &load.height) != 2 ||
+				load.width <= 0 || load.height <= 0)
+			{
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'd':
+			if (strcmp(optarg, "full") == 0) load.damage = DAMAGE_FULL;
+			else if (strcmp(optarg, "rect") == 0) load.damage = DAMAGE_RECT;
+			else if (strcmp(optarg, "none") == 0) load.damage = DAMAGE_NONE;
+			else { usage(argv[0]); return 1; }
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	load.display = wl_display_connect(NULL);
+	if (load.display == NULL)
+	{
+		fprintf(stderr, "scowl-load: failed to connect to a Wayland display\n");
+		return 1;
+	}
+
+	wl_list_init(&load.windows);
+	load.registry = wl_display_get_registry(load.display);
+	wl_registry_add_listener(load.registry, &registry_listener, &load);
+	wl_display_roundtrip(load.display);
+
+	if (load.compositor == NULL || load.shm == NULL || load.wm_base == NULL)
+	{
+		fprintf(stderr, "scowl-load: compositor lacks wl_compositor, wl_shm or xdg_wm_base\n");
+		return 1;
+	}
+
+	for (int i = 0; i < load.toplevels; i++)
+	{
+		window_create(&load, NULL, i);
+	}
+
+	int timer_fd = -1;
+	if (load.rate > 0)
+	{
+		long interval_ns = 1000000000l / load.rate;
+		struct itimerspec spec = {
+			.it_interval = { interval_ns / 1000000000l, interval_ns % 1000000000l },
+			.it_value = { interval_ns / 1000000000l, interval_ns % 1000000000l },
+		};
+		timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+		timerfd_settime(timer_fd, 0, &spec, NULL);
+	}
+
+	struct pollfd fds[] = {
+		{ .fd = wl_display_get_fd(load.display), .events = POLLIN },
+		{ .fd = STDIN_FILENO, .events = POLLIN },
+		{ .fd = timer_fd, .events = POLLIN },
+	};
+	uint64_t last_report = now_ns();
+	char line[128];
+
+	while (load.running)
+	{
+		while (wl_display_prepare_read(load.display) != 0)
+		{
+			wl_display_dispatch_pending(load.display);
+		}
+		wl_display_flush(load.display);
+
+		if (poll(fds, timer_fd >= 0 ? 3 : 2, 1000) < 0 && errno != EINTR)
+		{
+			wl_display_cancel_read(load.display);
+			break;
+		}
+
+		if (fds[0].revents & POLLIN)
+		{
+			if (wl_display_read_events(load.display) < 0)
+			{
+				break;
+			}
+		} else
+		{
+			wl_display_cancel_read(load.display);
+		}
+		if (wl_display_dispatch_pending(load.display) < 0)
+		{
+			break;
+		}
+
+		if (fds[1].revents & POLLIN)
+		{
+			if (fgets(line, sizeof(line), stdin) != NULL)
+			{
+				handle_command(&load, line);
+			} else
+			{
+				fds[1].fd = -1;
+			}
+		}
+
+		if (timer_fd >= 0 && (fds[2].revents & POLLIN))
+		{
+			uint64_t expirations;
+			if (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+			{
+				perror("scowl-load: timerfd");
+				break;
+			}
+
+			struct Window *window;
+			wl_list_for_each(window, &load.windows, link)
+			{
+				window_draw(window);
+			}
+		}
+
+		if (now_ns() - last_report > 5000000000ull)
+		{
+			report(&load);
+			last_report = now_ns();
+		}
+	}
+
+	report(&load);
+
+	struct Window *window, *tmp;
+	wl_list_for_each_reverse_safe(window, tmp, &load.windows, link)
+	{
+		window_destroy(window);
+	}
+	wl_display_disconnect(load.display);
+	return 0;
+}
@@ -0,0 +1,234 @@
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+#define LOGGER_BATCH 4096
+#define LOGGER_POLL_NS 100000000 /* how often to look without wakeups */
+
+static struct Logger logger;
+
+static const char *const level_names[] = {
+	[WLR_SILENT] = "silent",
+	[WLR_ERROR] = "error",
+	[WLR_INFO] = "info",
+	[WLR_DEBUG] = "debug",
+};
+
+static const char *const level_colors[] = {
+	[WLR_SILENT] = "",
+	[WLR_ERROR] = "\x1B[1;31m",
+	[WLR_INFO] = "\x1B[1;34m",
+	[WLR_DEBUG] = "\x1B[1;90m",
+};
+
+static uint64_t logger_now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+bool logger_parse_level(const char *name, enum wlr_log_importance *level)
+{
+	for (size_t i = 0; i < sizeof(level_names) / sizeof(level_names[0]); i++)
+	{
+		if (strcmp(level_names[i], name) == 0)
+		{
+			*level = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void logger_wake(void)
+{
+	/* EAGAIN means the counter is full, so a wakeup is pending already.
+	 * errno is left alone for whoever logged. */
+	int saved_errno = errno;
+	uint64_t one = 1;
+	while (write(logger.wake, &one, sizeof(one)) < 0 && errno == EINTR)
+	{
+	}
+	errno = saved_errno;
+}
+
+static void logger_callback(enum wlr_log_importance importance, const char *fmt,
+	va_list args)
+{
+	/* A bounded multi-producer queue: claim a position by bumping head, but
+	 * only once its slot has been printed since the last lap. */
+	size_t pos = atomic_load_explicit(&logger.head, memory_order_relaxed);
+	struct LogSlot *slot;
+	for (;;)
+	{
+		slot = &logger.slots[pos & (LOGGER_SLOTS - 1)];
+		size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+		if (sequence == pos)
+		{
+			if (atomic_compare_exchange_weak_explicit(&logger.head, &pos, pos + 1,
+					memory_order_relaxed, memory_order_relaxed))
+			{
+				break;
+			}
+		} else if ((ptrdiff_t)(sequence - pos) < 0)
+		{
+			/* Full: losing a line beats waiting for the terminal. */
+			atomic_fetch_add_explicit(&logger.dropped, 1, memory_order_relaxed);
+			return;
+		} else
+		{
+			pos = atomic_load_explicit(&logger.head, memory_order_relaxed);
+		}
+	}
+
+	slot->importance = importance;
+	slot->time_ns = logger_now_ns();
+	vsnprintf(slot->line, sizeof(slot->line), fmt, args);
+	atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+
+	if (atomic_exchange(&logger.sleeping, false))
+	{
+		logger_wake();
+	}
+}
+
+static size_t logger_append(char *batch, size_t used, struct LogSlot *slot)
+{
+	/* The same layout as wlroots' own stderr logger. */
+	uint64_t elapsed_ms = (slot->time_ns - logger.start_ns) / 1000000;
+	unsigned int importance = slot->importance < WLR_LOG_IMPORTANCE_LAST ?
+		slot->importance : WLR_DEBUG;
+	int n = snprintf(batch + used, LOGGER_BATCH - used, "%02u:%02u:%02u.%03u %s%s%s\n",
+		(unsigned int)(elapsed_ms / 3600000), (unsigned int)(elapsed_ms / 60000 % 60),
+		(unsigned int)(elapsed_ms / 1000 % 60), (unsigned int)(elapsed_ms % 1000),
+		logger.colors ? level_colors[importance] : "", slot->line,
+		logger.colors ? "\x1B[0m" : "");
+	if (n < 0)
+	{
+		return used;
+	}
+	return used + n < LOGGER_BATCH ? used + n : LOGGER_BATCH - 1;
+}
+
+static void logger_write(const char *data, size_t size)
+{
+	while (size > 0)
+	{
+		ssize_t n = write(STDERR_FILENO, data, size);
+		if (n <= 0)
+		{
+			return;
+		}
+		data += n;
+		size -= n;
+	}
+}
+
+static bool logger_drain(void)
+{
+	char batch[LOGGER_BATCH];
+	size_t used = 0;
+	bool drained = false;
+
+	for (;;)
+	{
+		struct LogSlot *slot = &logger.slots[logger.tail & (LOGGER_SLOTS - 1)];
+		if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != logger.tail + 1)
+		{
+			break;
+		}
+
+		if (used + sizeof(slot->line) + 64 > LOGGER_BATCH)
+		{
+			logger_write(batch, used);
+			used = 0;
+		}
+		used = logger_append(batch, used, slot);
+		atomic_store_explicit(&slot->sequence, logger.tail + LOGGER_SLOTS,
+			memory_order_release);
+		logger.tail++;
+		drained = true;
+	}
+
+	uint64_t dropped = atomic_exchange_explicit(&logger.dropped, 0, memory_order_relaxed);
+	if (dropped > 0)
+	{
+		used += snprintf(batch + used, LOGGER_BATCH - used,
+			"(%llu log messages dropped)\n", (unsigned long long)dropped);
+	}
+	logger_write(batch, used);
+	return drained;
+}
+
+static void *logger_thread(void *data)
+{
+	while (atomic_load(&logger.running))
+	{
+		if (logger_drain())
+		{
+			continue;
+		}
+
+		/* Announce the sleep, then look once more, so a line queued in
+		 * between is either seen here or followed by a wakeup. */
+		atomic_store(&logger.sleeping, true);
+		atomic_thread_fence(memory_order_seq_cst);
+		if (logger_drain())
+		{
+			continue;
+		}
+
+		uint64_t count;
+		if (read(logger.wake, &count, sizeof(count)) < 0 && errno != EINTR &&
+			errno != EAGAIN)
+		{
+			/* The eventfd is no use any more; look every so often instead. */
+			nanosleep(&(struct timespec){ .tv_nsec = LOGGER_POLL_NS }, NULL);
+		}
+	}
+	logger_drain();
+	return NULL;
+}
+
+void logger_init(enum wlr_log_importance level)
+{
+	logger.level = level;
+	logger.start_ns = logger_now_ns();
+	logger.colors = isatty(STDERR_FILENO);
+	for (size_t i = 0; i < LOGGER_SLOTS; i++)
+	{
+		atomic_init(&logger.slots[i].sequence, i);
+	}
+
+	logger.wake = eventfd(0, EFD_CLOEXEC);
+	atomic_store(&logger.running, true);
+	if (logger.wake < 0 || pthread_create(&logger.thread, NULL, logger_thread, NULL) != 0)
+	{
+		atomic_store(&logger.running, false);
+		wlr_log_init(level, NULL);
+		wlr_log(WLR_ERROR, "Failed to start the log thread, logging synchronously");
+		return;
+	}
+	wlr_log_init(level, logger_callback);
+}
+
+void logger_finish(void)
+{
+	if (!atomic_load(&logger.running))
+	{
+		return;
+	}
+
+	wlr_log_init(logger.level, NULL);
+	atomic_store(&logger.running, false);
+	logger_wake();
+	pthread_join(logger.thread, NULL);
+	close(logger.wake);
+}
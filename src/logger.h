@@ -0,0 +1,65 @@
+#ifndef LOGGER_H_
+#define LOGGER_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "wayland.h"
+
+#define LOGGER_SLOTS 1024 /* a power of two */
+#define LOGGER_LINE_MAX 256
+
+/*
+ * Asynchronous logging behind wlr_log. The callback installed with
+ * wlr_log_init only formats the message into a slot of a lock-free ring
+ * (any thread may log) and returns; a drain thread writes the lines to
+ * stderr, in batches. A slow terminal or a full pipe therefore stalls the
+ * drain thread, never the event loop. When the ring is full, messages are
+ * dropped, and the drain thread says how many.
+ *
+ * wlr_log skips the callback for messages above the runtime level, which
+ * comes from `scowl -l` or SCOWL_LOG (silent, error, info or debug; info by
+ * default). Our own debug messages go through DEBUG_LOG, which only exists
+ * in debug builds (configure -d); elsewhere the call, its arguments and
+ * the format string are compiled out.
+ */
+#ifdef DEBUG
+#define DEBUG_LOG(...) wlr_log(WLR_DEBUG, __VA_ARGS__)
+#define DEBUG_LOG_ERRNO(...) wlr_log_errno(WLR_DEBUG, __VA_ARGS__)
+#else
+#define DEBUG_LOG(...) ((void)0)
+#define DEBUG_LOG_ERRNO(...) ((void)0)
+#endif
+
+struct LogSlot
+{
+	_Atomic size_t sequence; /* position + 1 once written, + LOGGER_SLOTS once printed */
+	enum wlr_log_importance importance;
+	uint64_t time_ns;
+	char line[LOGGER_LINE_MAX];
+};
+
+struct Logger
+{
+	struct LogSlot slots[LOGGER_SLOTS];
+	_Atomic size_t head;  /* next position to claim */
+	size_t tail;          /* next position to print; drain thread only */
+	_Atomic uint64_t dropped;
+	_Atomic bool sleeping; /* the drain thread waits for `wake` */
+	_Atomic bool running;
+	int wake;              /* eventfd */
+	bool colors;
+	uint64_t start_ns;
+	enum wlr_log_importance level;
+	pthread_t thread;
+};
+
+/* "silent", "error", "info" or "debug". */
+bool logger_parse_level(const char *name, enum wlr_log_importance *level);
+
+/* Falls back to wlroots' synchronous logging if the drain thread cannot be
+ * started. */
+void logger_init(enum wlr_log_importance level);
+/* Prints whatever is still queued and goes back to synchronous logging. */
+void logger_finish(void);
+
+#endif
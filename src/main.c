@@ -1,10 +1,54 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
 #include "wayland.h"
+#include "logger.h"
 #include "server.h"
 
-int main()
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-l silent|error|info|debug]\n", name);
+}
+
+int main(int argc, char *argv[])
 {
-	wlr_log_init(WLR_DEBUG, NULL);
+	/* The command line wins over SCOWL_LOG. */
+	enum wlr_log_importance level = WLR_INFO;
+	const char *level_name = getenv("SCOWL_LOG");
+	int ch;
 
-	struct Server server;
+	while ((ch = getopt(argc, argv, "hl:")) != -1)
+	{
+		switch (ch)
+		{
+		case 'l':
+			level_name = optarg;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (level_name != NULL && !logger_parse_level(level_name, &level))
+	{
+		fprintf(stderr, "%s: unknown log level '%s'\n", argv[0], level_name);
+		return 1;
+	}
+
+	logger_init(level);
+
+	/* A client that closes its end of a pipe early, like a paste piped
+	 * into `head`, must make the write fail with EPIPE, not kill us.
+	 * Spawned processes get the default back. */
+	signal(SIGPIPE, SIG_IGN);
+
+	struct Server server = {0};
 	server_init(server);
+
+	logger_finish();
 }
@@ -0,0 +1,404 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+#define PROM_DEFAULT_INTERVAL_MS 10000
+
+uint64_t timespec_to_ns(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * 1000000000ull + ts->tv_nsec;
+}
+
+uint64_t metrics_now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return timespec_to_ns(&now);
+}
+
+static size_t histogram_bucket(uint64_t value)
+{
+	size_t bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+	return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+void histogram_record(struct Histogram *hist, uint64_t value)
+{
+	atomic_fetch_add_explicit(&hist->buckets[histogram_bucket(value)], 1,
+		memory_order_relaxed);
+	atomic_fetch_add_explicit(&hist->count, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&hist->sum, value, memory_order_relaxed);
+
+	uint64_t max = atomic_load_explicit(&hist->max, memory_order_relaxed);
+	while (value > max && !atomic_compare_exchange_weak_explicit(&hist->max,
+			&max, value, memory_order_relaxed, memory_order_relaxed))
+		;
+}
+
+uint64_t histogram_percentile(struct Histogram *hist, double percentile)
+{
+	/* Returns the upper bound of the bucket holding the given percentile, so
+	 * the result overestimates by at most a factor of two. */
+	uint64_t count = atomic_load_explicit(&hist->count, memory_order_relaxed);
+	uint64_t target = (uint64_t)(count * percentile);
+	uint64_t seen = 0;
+
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		seen += atomic_load_explicit(&hist->buckets[i], memory_order_relaxed);
+		if (seen > target)
+		{
+			return i == 0 ? 0 : (1ull << i) - 1;
+		}
+	}
+
+	return atomic_load_explicit(&hist->max, memory_order_relaxed);
+}
+
+static uint64_t load(_Atomic uint64_t *value)
+{
+	return atomic_load_explicit(value, memory_order_relaxed);
+}
+
+void metrics_output_init(struct Metrics *metrics, struct OutputMetrics *output,
+	const char *name)
+{
+	memset(output, 0, sizeof(*output));
+	snprintf(output->name, sizeof(output->name), "%s", name);
+	wl_list_insert(&metrics->outputs, &output->link);
+}
+
+void metrics_output_present(struct OutputMetrics *output,
+	const struct wlr_output_event_present *event)
+{
+	if (!event->presented)
+	{
+		atomic_fetch_add_explicit(&output->missed_frames, 1, memory_order_relaxed);
+		return;
+	}
+
+	uint64_t when = event->when != NULL ? timespec_to_ns(event->when) : metrics_now_ns();
+	if (event->commit_seq == output->commit_seq && when > output->commit_ns)
+	{
+		histogram_record(&output->commit_latency, when - output->commit_ns);
+	}
+
+	/* A frame was missed if we committed within one refresh period of the
+	 * previous vblank, but the page-flip only landed one or more periods later. */
+	if (event->refresh > 0 && output->last_present_ns != 0 &&
+		output->commit_ns - output->last_present_ns < (uint64_t)event->refresh &&
+		when - output->last_present_ns > (uint64_t)event->refresh * 3 / 2)
+	{
+		atomic_fetch_add_explicit(&output->missed_frames,
+			(when - output->last_present_ns) / event->refresh - 1, memory_order_relaxed);
+	}
+
+	output->last_present_ns = when;
+}
+
+void metrics_output_finish(struct OutputMetrics *output)
+{
+	wl_list_remove(&output->link);
+}
+
+void metrics_client_init(struct Metrics *metrics, struct ClientMetrics *client,
+	pid_t pid)
+{
+	memset(client, 0, sizeof(*client));
+	client->id = ++metrics->next_client_id;
+	client->pid = pid;
+	client->created_ns = metrics_now_ns();
+	wl_list_insert(&metrics->clients, &client->link);
+}
+
+void metrics_client_commit(struct ClientMetrics *client, struct wlr_surface *surface)
+{
+	atomic_fetch_add_explicit(&client->commits, 1, memory_order_relaxed);
+
+	/* current.buffer is already let go of after the upload; the size of
+	 * what was attached stays in the state. */
+	if ((surface->current.committed & WLR_SURFACE_STATE_BUFFER) &&
+		surface->current.buffer_width > 0)
+	{
+		/* Assume 4 bytes per pixel, which holds for every shm and dmabuf
+		 * format clients realistically use. */
+		histogram_record(&client->buffer_bytes,
+			(uint64_t)surface->current.buffer_width * surface->current.buffer_height * 4);
+	}
+}
+
+void metrics_solid_buffer(struct Metrics *metrics, struct wlr_surface *surface)
+{
+	uint64_t pixels = (uint64_t)surface->current.width * surface->current.height;
+	if (pixels <= 1)
+	{
+		return;
+	}
+
+	atomic_fetch_add_explicit(&metrics->solid_buffers, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&metrics->upload_bytes_avoided, (pixels - 1) * 4,
+		memory_order_relaxed);
+}
+
+void metrics_client_configure(struct ClientMetrics *client, uint32_t serial)
+{
+	size_t slot = client->configure_head++ % CONFIGURES_TRACKED;
+	client->configures[slot].serial = serial;
+	client->configures[slot].sent_ns = metrics_now_ns();
+}
+
+void metrics_client_ack_configure(struct ClientMetrics *client, uint32_t serial)
+{
+	for (size_t i = 0; i < CONFIGURES_TRACKED; i++)
+	{
+		if (client->configures[i].sent_ns != 0 && client->configures[i].serial == serial)
+		{
+			histogram_record(&client->configure_rtt,
+				metrics_now_ns() - client->configures[i].sent_ns);
+			client->configures[i].sent_ns = 0;
+			return;
+		}
+	}
+}
+
+void metrics_client_finish(struct ClientMetrics *client)
+{
+	latency_cancel(&client->input);
+	wl_list_remove(&client->link);
+}
+
+static void write_histogram_summary(FILE *out, const char *label,
+	struct Histogram *hist, double scale, const char *unit)
+{
+	uint64_t count = load(&hist->count);
+	if (count == 0)
+	{
+		fprintf(out, "  %-16s -\n", label);
+		return;
+	}
+
+	fprintf(out, "  %-16s n=%-8" PRIu64 " avg=%.2f%s p50<=%.2f%s p99<=%.2f%s max=%.2f%s\n",
+		label, count,
+		load(&hist->sum) / (double)count * scale, unit,
+		histogram_percentile(hist, 0.5) * scale, unit,
+		histogram_percentile(hist, 0.99) * scale, unit,
+		load(&hist->max) * scale, unit);
+}
+
+void metrics_write_summary(struct Metrics *metrics, FILE *out)
+{
+	uint64_t now = metrics_now_ns();
+
+	fprintf(out, "uptime %.1fs\n", (now - metrics->started_ns) / 1e9);
+	write_histogram_summary(out, "dispatch", &metrics->dispatch_time, 1e-3, "us");
+	fprintf(out, "solid buffers %" PRIu64 " upload avoided %.1f MiB\n",
+		load(&metrics->solid_buffers), load(&metrics->upload_bytes_avoided) / 1048576.0);
+
+	struct OutputMetrics *output;
+	wl_list_for_each_reverse(output, &metrics->outputs, link)
+	{
+		fprintf(out, "output %s frames=%" PRIu64 " missed=%" PRIu64 "\n", output->name,
+			load(&output->frames), load(&output->missed_frames));
+		write_histogram_summary(out, "render", &output->render_time, 1e-3, "us");
+		write_histogram_summary(out, "commit-latency", &output->commit_latency, 1e-6, "ms");
+	}
+
+	struct ClientMetrics *client;
+	wl_list_for_each_reverse(client, &metrics->clients, link)
+	{
+		double age = (now - client->created_ns) / 1e9;
+		uint64_t commits = load(&client->commits);
+		fprintf(out, "client %u app_id=%s pid=%d commits=%" PRIu64 " rate=%.1f/s"
+			" property_changes=%" PRIu64 " suppressed=%" PRIu64 "\n",
+			client->id, client->app_id[0] ? client->app_id : "-", (int)client->pid,
+			commits, age > 0 ? commits / age : 0.0, load(&client->property_changes),
+			load(&client->property_suppressed));
+		write_histogram_summary(out, "buffer", &client->buffer_bytes, 1.0 / 1024, "KiB");
+		write_histogram_summary(out, "configure-rtt", &client->configure_rtt, 1e-3, "us");
+		write_histogram_summary(out, "input-latency", &client->input_latency, 1e-6, "ms");
+	}
+}
+
+static void write_label_value(FILE *out, const char *value)
+{
+	for (; *value; value++)
+	{
+		if (*value == '"' || *value == '\\')
+		{
+			fputc('\\', out);
+		} else if (*value == '\n')
+		{
+			fputs("\\n", out);
+			continue;
+		}
+		fputc(*value, out);
+	}
+}
+
+static void write_histogram_prometheus(FILE *out, const char *name,
+	const char *labels, struct Histogram *hist, double scale)
+{
+	uint64_t cumulative = 0;
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS - 1; i++)
+	{
+		cumulative += load(&hist->buckets[i]);
+		fprintf(out, "%s_bucket{%s,le=\"%g\"} %" PRIu64 "\n", name, labels,
+			(double)(1ull << i) * scale, cumulative);
+	}
+	fprintf(out, "%s_bucket{%s,le=\"+Inf\"} %" PRIu64 "\n", name, labels, load(&hist->count));
+	fprintf(out, "%s_sum{%s} %g\n", name, labels, load(&hist->sum) * scale);
+	fprintf(out, "%s_count{%s} %" PRIu64 "\n", name, labels, load(&hist->count));
+}
+
+void metrics_write_prometheus(struct Metrics *metrics, FILE *out)
+{
+	char labels[160];
+	struct OutputMetrics *output;
+	struct ClientMetrics *client;
+
+	fprintf(out, "# TYPE scowl_dispatch_seconds histogram\n");
+	write_histogram_prometheus(out, "scowl_dispatch_seconds", "loop=\"main\"",
+		&metrics->dispatch_time, 1e-9);
+	fprintf(out, "# TYPE scowl_solid_buffers_total counter\n");
+	fprintf(out, "scowl_solid_buffers_total %" PRIu64 "\n", load(&metrics->solid_buffers));
+	fprintf(out, "# TYPE scowl_upload_bytes_avoided_total counter\n");
+	fprintf(out, "scowl_upload_bytes_avoided_total %" PRIu64 "\n",
+		load(&metrics->upload_bytes_avoided));
+
+	fprintf(out, "# TYPE scowl_output_frames_total counter\n");
+	wl_list_for_each_reverse(output, &metrics->outputs, link)
+	{
+		fprintf(out, "scowl_output_frames_total{output=\"%s\"} %" PRIu64 "\n",
+			output->name, load(&output->frames));
+	}
+	fprintf(out, "# TYPE scowl_output_missed_frames_total counter\n");
+	wl_list_for_each_reverse(output, &metrics->outputs, link)
+	{
+		fprintf(out, "scowl_output_missed_frames_total{output=\"%s\"} %" PRIu64 "\n",
+			output->name, load(&output->missed_frames));
+	}
+	fprintf(out, "# TYPE scowl_output_render_seconds histogram\n");
+	wl_list_for_each_reverse(output, &metrics->outputs, link)
+	{
+		snprintf(labels, sizeof(labels), "output=\"%s\"", output->name);
+		write_histogram_prometheus(out, "scowl_output_render_seconds", labels,
+			&output->render_time, 1e-9);
+	}
+	fprintf(out, "# TYPE scowl_output_commit_latency_seconds histogram\n");
+	wl_list_for_each_reverse(output, &metrics->outputs, link)
+	{
+		snprintf(labels, sizeof(labels), "output=\"%s\"", output->name);
+		write_histogram_prometheus(out, "scowl_output_commit_latency_seconds", labels,
+			&output->commit_latency, 1e-9);
+	}
+
+	fprintf(out, "# TYPE scowl_client_commits_total counter\n");
+	wl_list_for_each_reverse(client, &metrics->clients, link)
+	{
+		fprintf(out, "scowl_client_commits_total{client=\"%u\",app_id=\"", client->id);
+		write_label_value(out, client->app_id);
+		fprintf(out, "\"} %" PRIu64 "\n", load(&client->commits));
+	}
+	fprintf(out, "# TYPE scowl_client_property_changes_total counter\n");
+	wl_list_for_each_reverse(client, &metrics->clients, link)
+	{
+		fprintf(out, "scowl_client_property_changes_total{client=\"%u\"} %" PRIu64 "\n",
+			client->id, load(&client->property_changes));
+	}
+	fprintf(out, "# TYPE scowl_client_property_suppressed_total counter\n");
+	wl_list_for_each_reverse(client, &metrics->clients, link)
+	{
+		fprintf(out, "scowl_client_property_suppressed_total{client=\"%u\"} %" PRIu64 "\n",
+			client->id, load(&client->property_suppressed));
+	}
+	fprintf(out, "# TYPE scowl_client_buffer_bytes histogram\n");
+	wl_list_for_each_reverse(client, &metrics->clients, link)
+	{
+		snprintf(labels, sizeof(labels), "client=\"%u\"", client->id);
+		write_histogram_prometheus(out, "scowl_client_buffer_bytes", labels,
+			&client->buffer_bytes, 1.0);
+	}
+	fprintf(out, "# TYPE scowl_client_configure_rtt_seconds histogram\n");
+	wl_list_for_each_reverse(client, &metrics->clients, link)
+	{
+		snprintf(labels, sizeof(labels), "client=\"%u\"", client->id);
+		write_histogram_prometheus(out, "scowl_client_configure_rtt_seconds", labels,
+			&client->configure_rtt, 1e-9);
+	}
+	fprintf(out, "# TYPE scowl_client_input_latency_seconds histogram\n");
+	wl_list_for_each_reverse(client, &metrics->clients, link)
+	{
+		snprintf(labels, sizeof(labels), "client=\"%u\"", client->id);
+		write_histogram_prometheus(out, "scowl_client_input_latency_seconds", labels,
+			&client->input_latency, 1e-9);
+	}
+}
+
+static int metrics_handle_prom_timer(void *data)
+{
+	struct Metrics *metrics = data;
+	char tmp_path[4096];
+
+	/* Write next to the target and rename over it, so a scraper never sees a
+	 * half-written file. */
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", metrics->prom_path);
+	FILE *out = fopen(tmp_path, "w");
+	if (out == NULL)
+	{
+		wlr_log_errno(WLR_ERROR, "Failed to open %s", tmp_path);
+	} else
+	{
+		metrics_write_prometheus(metrics, out);
+		if (fclose(out) == 0)
+		{
+			rename(tmp_path, metrics->prom_path);
+		}
+	}
+
+	wl_event_source_timer_update(metrics->prom_timer, metrics->prom_interval_ms);
+	return 0;
+}
+
+void metrics_init(struct Metrics *metrics, struct wl_event_loop *loop)
+{
+	memset(metrics, 0, sizeof(*metrics));
+	wl_list_init(&metrics->outputs);
+	wl_list_init(&metrics->clients);
+	metrics->started_ns = metrics_now_ns();
+
+	metrics->prom_path = getenv("SCOWL_METRICS_FILE");
+	if (metrics->prom_path == NULL)
+	{
+		return;
+	}
+
+	const char *interval = getenv("SCOWL_METRICS_INTERVAL");
+	metrics->prom_interval_ms = interval ? atoi(interval) : PROM_DEFAULT_INTERVAL_MS;
+	if (metrics->prom_interval_ms <= 0)
+	{
+		metrics->prom_interval_ms = PROM_DEFAULT_INTERVAL_MS;
+	}
+
+	wlr_log(WLR_INFO, "Writing Prometheus metrics to %s every %ims",
+		metrics->prom_path, metrics->prom_interval_ms);
+	metrics->prom_timer = wl_event_loop_add_timer(loop, metrics_handle_prom_timer, metrics);
+	wl_event_source_timer_update(metrics->prom_timer, metrics->prom_interval_ms);
+}
+
+void metrics_finish(struct Metrics *metrics)
+{
+	if (metrics->prom_timer != NULL)
+	{
+		wl_event_source_remove(metrics->prom_timer);
+		metrics->prom_timer = NULL;
+	}
+}
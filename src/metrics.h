@@ -0,0 +1,103 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include "wayland.h"
+#include "latency.h"
+
+/* Power-of-two buckets: bucket 0 holds 0, bucket i holds [2^(i-1), 2^i). */
+#define HISTOGRAM_BUCKETS 32
+#define CONFIGURES_TRACKED 8
+
+/*
+ * All counters are updated with relaxed atomics, so they may be read from any
+ * thread (the IPC query, the Prometheus writer or a watchdog) without locking
+ * the event loop.
+ */
+struct Histogram
+{
+	_Atomic uint64_t buckets[HISTOGRAM_BUCKETS];
+	_Atomic uint64_t count;
+	_Atomic uint64_t sum;
+	_Atomic uint64_t max;
+};
+
+struct OutputMetrics
+{
+	struct wl_list link;
+	char name[32];
+	struct Histogram render_time;    /* ns spent in wlr_scene_output_commit */
+	struct Histogram commit_latency; /* ns from commit to presentation */
+	_Atomic uint64_t frames;
+	_Atomic uint64_t missed_frames;
+	uint64_t commit_ns;
+	uint64_t last_present_ns;
+	uint32_t commit_seq;
+};
+
+struct ClientMetrics
+{
+	struct wl_list link;
+	uint32_t id;
+	pid_t pid;
+	char app_id[64];
+	uint64_t created_ns;
+	_Atomic uint64_t commits;
+	_Atomic uint64_t property_changes;    /* title and app_id requests */
+	_Atomic uint64_t property_suppressed; /* overwritten before anyone saw them */
+	struct Histogram buffer_bytes;
+	struct Histogram configure_rtt; /* ns from configure to ack_configure */
+	struct Histogram input_latency; /* ns from kernel input event to present */
+	struct InputLatency input;
+	struct {
+		uint32_t serial;
+		uint64_t sent_ns;
+	} configures[CONFIGURES_TRACKED];
+	size_t configure_head;
+};
+
+struct Metrics
+{
+	struct wl_list outputs;
+	struct wl_list clients;
+	uint32_t next_client_id;
+	struct Histogram dispatch_time; /* ns per event-loop dispatch */
+	_Atomic uint64_t solid_buffers;        /* 1x1 buffers committed to cover a bigger surface */
+	_Atomic uint64_t upload_bytes_avoided; /* what full-size buffers would have cost */
+	uint64_t started_ns;
+
+	const char *prom_path;
+	int prom_interval_ms;
+	struct wl_event_source *prom_timer;
+};
+
+uint64_t metrics_now_ns(void);
+uint64_t timespec_to_ns(const struct timespec *ts);
+
+void histogram_record(struct Histogram *hist, uint64_t value);
+uint64_t histogram_percentile(struct Histogram *hist, double percentile);
+
+void metrics_init(struct Metrics *metrics, struct wl_event_loop *loop);
+void metrics_finish(struct Metrics *metrics);
+
+void metrics_output_init(struct Metrics *metrics, struct OutputMetrics *output,
+	const char *name);
+void metrics_output_present(struct OutputMetrics *output,
+	const struct wlr_output_event_present *event);
+void metrics_output_finish(struct OutputMetrics *output);
+
+void metrics_client_init(struct Metrics *metrics, struct ClientMetrics *client,
+	pid_t pid);
+void metrics_client_commit(struct ClientMetrics *client, struct wlr_surface *surface);
+void metrics_client_configure(struct ClientMetrics *client, uint32_t serial);
+void metrics_client_ack_configure(struct ClientMetrics *client, uint32_t serial);
+void metrics_client_finish(struct ClientMetrics *client);
+/* Called for a surface that committed a 1x1 buffer; counts the bytes a
+ * buffer of the surface's full size would have taken. */
+void metrics_solid_buffer(struct Metrics *metrics, struct wlr_surface *surface);
+
+void metrics_write_summary(struct Metrics *metrics, FILE *out);
+void metrics_write_prometheus(struct Metrics *metrics, FILE *out);
+
+#endif
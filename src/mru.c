@@ -0,0 +1,63 @@
+#include "mru.h"
+
+void mru_init(struct Mru *mru)
+{
+	wl_list_init(&mru->stack);
+	mru->count = 0;
+}
+
+void mru_push(struct Mru *mru, struct MruEntry *entry)
+{
+	wl_list_insert(&mru->stack, &entry->link);
+	mru->count++;
+}
+
+void mru_remove(struct Mru *mru, struct MruEntry *entry)
+{
+	wl_list_remove(&entry->link);
+	wl_list_init(&entry->link);
+	mru->count--;
+}
+
+void mru_touch(struct Mru *mru, struct MruEntry *entry)
+{
+	if (mru->stack.next == &entry->link)
+	{
+		return;
+	}
+
+	wl_list_remove(&entry->link);
+	wl_list_insert(&mru->stack, &entry->link);
+}
+
+struct MruEntry *mru_step(struct Mru *mru, struct MruEntry *from, int direction,
+	mru_filter_func_t filter, void *data)
+{
+	struct wl_list *start = from != NULL ? &from->link : &mru->stack;
+	struct wl_list *pos = start;
+
+	/* At most one full lap; the sentinel is skipped, not counted. */
+	for (size_t i = 0; i <= mru->count; i++)
+	{
+		pos = direction >= 0 ? pos->next : pos->prev;
+		if (pos == &mru->stack)
+		{
+			pos = direction >= 0 ? pos->next : pos->prev;
+		}
+		if (pos == &mru->stack)
+		{
+			return NULL;
+		}
+
+		struct MruEntry *entry = wl_container_of(pos, entry, link);
+		if (filter == NULL || filter(entry, data))
+		{
+			return entry;
+		}
+		if (pos == start)
+		{
+			return NULL;
+		}
+	}
+	return NULL;
+}
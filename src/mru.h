@@ -0,0 +1,57 @@
+#ifndef MRU_H_
+#define MRU_H_
+
+#include <stddef.h>
+#include "wayland.h"
+
+/*
+ * Most-recently-used stack of windows. The front is the most recently
+ * focused entry; pushing, removing and touching are O(1) and the length is
+ * kept alongside, so nothing has to walk the list to count it.
+ *
+ * Cycling walks the stack from a given entry in either direction, wrapping
+ * around, and skips entries the caller's filter rejects; that is how the
+ * per-output view is built without keeping a stack for each output.
+ */
+struct MruEntry
+{
+	struct wl_list link;
+};
+
+struct Mru
+{
+	struct wl_list stack; /* MruEntry.link, most recent first */
+	size_t count;
+};
+
+typedef bool (*mru_filter_func_t)(struct MruEntry *entry, void *data);
+
+void mru_init(struct Mru *mru);
+void mru_push(struct Mru *mru, struct MruEntry *entry);
+void mru_remove(struct Mru *mru, struct MruEntry *entry);
+void mru_touch(struct Mru *mru, struct MruEntry *entry);
+
+/* Returns the first entry after `from` in `direction` (1 towards older, -1
+ * towards newer) that `filter` accepts, or NULL if there is none. With a NULL
+ * `from` the walk starts at the front or back of the stack. `from` itself is
+ * only returned if it is the sole match; a NULL filter accepts everything. */
+struct MruEntry *mru_step(struct Mru *mru, struct MruEntry *from, int direction,
+	mru_filter_func_t filter, void *data);
+
+static inline size_t mru_count(const struct Mru *mru)
+{
+	return mru->count;
+}
+
+static inline struct MruEntry *mru_front(const struct Mru *mru)
+{
+	if (mru->count == 0)
+	{
+		return NULL;
+	}
+
+	struct MruEntry *entry = wl_container_of(mru->stack.next, entry, link);
+	return entry;
+}
+
+#endif
@@ -0,0 +1,117 @@
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+
+#define POOL_SLAB_BYTES 16384
+
+static size_t pool_align(size_t size)
+{
+	size_t align = _Alignof(max_align_t);
+	return (size + align - 1) / align * align;
+}
+
+void pool_init(struct Pool *pool, struct wl_list *pools, const char *name,
+	size_t object_size)
+{
+	memset(pool, 0, sizeof(*pool));
+	pool->name = name;
+	/* Free objects hold the free-list pointer in their first bytes. */
+	pool->object_size = pool_align(object_size > sizeof(void *) ? object_size : sizeof(void *));
+	pool->per_slab = POOL_SLAB_BYTES / pool->object_size;
+	if (pool->per_slab < 8)
+	{
+		pool->per_slab = 8;
+	}
+	wl_list_insert(pools->prev, &pool->link);
+}
+
+void pool_finish(struct Pool *pool)
+{
+	if (pool->live > 0)
+	{
+		wlr_log(WLR_ERROR, "Pool %s: %" PRIu64 " objects still alive at exit",
+			pool->name, pool->live);
+	}
+
+	struct PoolSlab *slab = pool->slabs;
+	while (slab != NULL)
+	{
+		struct PoolSlab *next = slab->next;
+		free(slab);
+		slab = next;
+	}
+	pool->slabs = NULL;
+	pool->free_list = NULL;
+	wl_list_remove(&pool->link);
+}
+
+static bool pool_grow(struct Pool *pool)
+{
+	size_t header = pool_align(sizeof(struct PoolSlab));
+	struct PoolSlab *slab = malloc(header + pool->per_slab * pool->object_size);
+	if (slab == NULL)
+	{
+		wlr_log(WLR_ERROR, "Pool %s: failed to allocate a slab", pool->name);
+		return false;
+	}
+
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+	pool->slab_count++;
+
+	/* Thread the new objects onto the free list back to front, so they are
+	 * handed out in address order. */
+	char *objects = (char *)slab + header;
+	for (size_t i = pool->per_slab; i > 0; i--)
+	{
+		void **object = (void **)(objects + (i - 1) * pool->object_size);
+		*object = pool->free_list;
+		pool->free_list = object;
+	}
+	return true;
+}
+
+void *pool_alloc(struct Pool *pool)
+{
+	if (pool->free_list == NULL && !pool_grow(pool))
+	{
+		return NULL;
+	}
+
+	void **object = pool->free_list;
+	pool->free_list = *object;
+	memset(object, 0, pool->object_size);
+
+	pool->allocations++;
+	if (++pool->live > pool->peak)
+	{
+		pool->peak = pool->live;
+	}
+	return object;
+}
+
+void pool_free(struct Pool *pool, void *object)
+{
+	if (object == NULL)
+	{
+		return;
+	}
+
+	*(void **)object = pool->free_list;
+	pool->free_list = object;
+	pool->live--;
+}
+
+void pool_write_summary(struct wl_list *pools, FILE *out)
+{
+	struct Pool *pool;
+	wl_list_for_each(pool, pools, link)
+	{
+		fprintf(out, "pool %-10s live %" PRIu64 " peak %" PRIu64 " allocations %" PRIu64
+			" slabs %zu bytes %zu\n", pool->name, pool->live, pool->peak, pool->allocations,
+			pool->slab_count, pool->slab_count * pool->per_slab * pool->object_size);
+	}
+}
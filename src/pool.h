@@ -0,0 +1,46 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <stdio.h>
+#include "wayland.h"
+
+/*
+ * Fixed-size object pools for the compositor's short-lived per-surface
+ * objects (windows, popups, layer surfaces, keyboards), listeners included
+ * since those are embedded in the objects. Objects are carved out of slabs
+ * and recycled through a free list, so a client that opens and closes
+ * menus all day reuses the same few slots instead of churning malloc.
+ * Slabs are kept until the pool is finished.
+ *
+ * Every pool counts its live objects; pool_finish reports any still alive,
+ * and the "objects" IPC command prints the counts while running.
+ */
+struct PoolSlab
+{
+	struct PoolSlab *next;
+};
+
+struct Pool
+{
+	struct wl_list link;
+	const char *name;
+	size_t object_size;
+	size_t per_slab;
+	void *free_list;
+	struct PoolSlab *slabs;
+	size_t slab_count;
+	uint64_t live;
+	uint64_t peak;
+	uint64_t allocations;
+};
+
+void pool_init(struct Pool *pool, struct wl_list *pools, const char *name,
+	size_t object_size);
+void pool_finish(struct Pool *pool);
+/* Returns a zeroed object, or NULL if a new slab could not be allocated. */
+void *pool_alloc(struct Pool *pool);
+void pool_free(struct Pool *pool, void *object);
+
+void pool_write_summary(struct wl_list *pools, FILE *out);
+
+#endif
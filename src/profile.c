@@ -0,0 +1,82 @@
+#include <execinfo.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "profile.h"
+
+#define SLOW_LISTENER_DEFAULT_MS 8
+#define BACKTRACE_DEPTH 32
+
+static struct wl_list profiles = { &profiles, &profiles };
+static _Atomic(const char *) current;
+static uint64_t slow_threshold_ns = SLOW_LISTENER_DEFAULT_MS * 1000000ull;
+
+void profile_init(void)
+{
+	const char *threshold = getenv("SCOWL_SLOW_LISTENER_MS");
+	if (threshold != NULL && atoi(threshold) > 0)
+	{
+		slow_threshold_ns = atoi(threshold) * 1000000ull;
+	}
+}
+
+const char *profile_current(void)
+{
+	return atomic_load_explicit(&current, memory_order_relaxed);
+}
+
+#ifdef SCOWL_PROFILE
+
+uint64_t profile_begin(struct ListenerProfile *profile)
+{
+	/* Profiles register themselves the first time they run. */
+	if (profile->link.next == NULL)
+	{
+		wl_list_insert(profiles.prev, &profile->link);
+	}
+
+	atomic_store_explicit(&current, profile->name, memory_order_relaxed);
+	return metrics_now_ns();
+}
+
+void profile_end(struct ListenerProfile *profile, uint64_t start)
+{
+	uint64_t elapsed = metrics_now_ns() - start;
+
+	histogram_record(&profile->time, elapsed);
+	atomic_store_explicit(&current, NULL, memory_order_relaxed);
+
+	if (elapsed > slow_threshold_ns)
+	{
+		/* The backtrace is taken after the fact, so it shows who emitted the
+		 * signal rather than where the handler spent its time. */
+		void *frames[BACKTRACE_DEPTH];
+		int depth = backtrace(frames, BACKTRACE_DEPTH);
+
+		wlr_log(WLR_ERROR, "Slow listener: %s took %.2fms (threshold %.2fms), emitted from:",
+			profile->name, elapsed / 1e6, slow_threshold_ns / 1e6);
+		backtrace_symbols_fd(frames + 1, depth - 1, STDERR_FILENO);
+	}
+}
+
+#endif
+
+void profile_write(FILE *out)
+{
+#ifndef SCOWL_PROFILE
+	fprintf(out, "listener profiling is not compiled in (configure -p)\n");
+#endif
+
+	struct ListenerProfile *profile;
+	wl_list_for_each(profile, &profiles, link)
+	{
+		uint64_t count = atomic_load_explicit(&profile->time.count, memory_order_relaxed);
+		uint64_t sum = atomic_load_explicit(&profile->time.sum, memory_order_relaxed);
+		uint64_t max = atomic_load_explicit(&profile->time.max, memory_order_relaxed);
+
+		fprintf(out, "%-32s n=%-8" PRIu64 " avg=%.1fus p99<=%.1fus max=%.1fus\n",
+			profile->name, count, count ? sum / (double)count / 1e3 : 0.0,
+			histogram_percentile(&profile->time, 0.99) / 1e3, max / 1e3);
+	}
+}
@@ -0,0 +1,48 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdio.h>
+#include "wayland.h"
+#include "metrics.h"
+
+/*
+ * Per-listener timing. Listeners are wrapped at registration time with
+ * PROFILED(fn), after the wrapper has been generated with PROFILE_LISTENER(fn)
+ * next to the handler. Without SCOWL_PROFILE (configure -p) both expand to the
+ * bare handler, so release builds pay nothing.
+ */
+struct ListenerProfile
+{
+	struct wl_list link;
+	const char *name;
+	struct Histogram time;
+};
+
+#ifdef SCOWL_PROFILE
+
+uint64_t profile_begin(struct ListenerProfile *profile);
+void profile_end(struct ListenerProfile *profile, uint64_t start);
+
+#define PROFILE_LISTENER(fn) \
+	static struct ListenerProfile fn##_profile = { .name = #fn }; \
+	static void fn##_profiled(struct wl_listener *listener, void *data) \
+	{ \
+		uint64_t start = profile_begin(&fn##_profile); \
+		fn(listener, data); \
+		profile_end(&fn##_profile, start); \
+	}
+#define PROFILED(fn) fn##_profiled
+
+#else
+
+#define PROFILE_LISTENER(fn)
+#define PROFILED(fn) fn
+
+#endif
+
+void profile_init(void);
+/* Name of the profiled listener currently running on the main thread, if any. */
+const char *profile_current(void);
+void profile_write(FILE *out);
+
+#endif
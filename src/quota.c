@@ -0,0 +1,522 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "quota.h"
+
+static const char *const action_names[] = {
+	[QUOTA_LOG] = "log",
+	[QUOTA_THROTTLE] = "throttle",
+	[QUOTA_DISCONNECT] = "disconnect",
+};
+
+static uint64_t quota_now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+bool quota_parse_limits(struct QuotaLimits *limits, const char *spec)
+{
+	char *copy = strdup(spec);
+	char *save = NULL;
+	bool ok = true;
+
+	for (char *item = strtok_r(copy, ",", &save); item != NULL;
+		item = strtok_r(NULL, ",", &save))
+	{
+		char *value = strchr(item, '=');
+		if (value == NULL)
+		{
+			wlr_log(WLR_ERROR, "Quota '%s' has no value", item);
+			ok = false;
+			continue;
+		}
+		*value++ = '\0';
+
+		if (strcmp(item, "action") == 0)
+		{
+			size_t i;
+			for (i = 0; i < sizeof(action_names) / sizeof(action_names[0]); i++)
+			{
+				if (strcmp(value, action_names[i]) == 0)
+				{
+					limits->action = i;
+					break;
+				}
+			}
+			if (i == sizeof(action_names) / sizeof(action_names[0]))
+			{
+				wlr_log(WLR_ERROR, "Quota action wants log, throttle or disconnect, not '%s'",
+					value);
+				ok = false;
+			}
+			continue;
+		}
+
+		char *end;
+		unsigned long long n = strtoull(value, &end, 10);
+		if (*end != '\0' || value[0] == '\0')
+		{
+			wlr_log(WLR_ERROR, "Quota %s wants a number, not '%s'", item, value);
+			ok = false;
+		} else if (strcmp(item, "surfaces") == 0)
+		{
+			limits->surfaces = n;
+		} else if (strcmp(item, "subsurfaces") == 0)
+		{
+			limits->subsurfaces = n;
+		} else if (strcmp(item, "shm_mb") == 0)
+		{
+			limits->shm_bytes = n << 20;
+		} else if (strcmp(item, "commits") == 0)
+		{
+			limits->commits = n;
+		} else
+		{
+			wlr_log(WLR_ERROR, "Unknown quota '%s'", item);
+			ok = false;
+		}
+	}
+	free(copy);
+	return ok;
+}
+
+static uint32_t quota_exceeded(struct ClientQuota *quota)
+{
+	struct QuotaLimits *limits = &quota->quotas->limits;
+	uint32_t over = 0;
+
+	if (limits->surfaces > 0 && quota->surfaces > limits->surfaces)
+	{
+		over |= QUOTA_SURFACES;
+	}
+	if (limits->subsurfaces > 0 && quota->subsurfaces > limits->subsurfaces)
+	{
+		over |= QUOTA_SUBSURFACES;
+	}
+	if (limits->shm_bytes > 0 && quota->shm_bytes > limits->shm_bytes)
+	{
+		over |= QUOTA_SHM_BYTES;
+	}
+	if (limits->commits > 0 &&
+		(quota->commits > limits->commits || quota->commit_rate > limits->commits))
+	{
+		over |= QUOTA_COMMITS;
+	}
+	return over;
+}
+
+static void quota_set_throttled(struct ClientQuota *quota, bool throttled)
+{
+	if (quota->throttled != throttled)
+	{
+		quota->throttled = throttled;
+		quota->quotas->throttled += throttled ? 1 : -1;
+	}
+}
+
+static void quota_disconnect(void *data)
+{
+	/* Clients that were already gone, like those whose error was posted
+	 * during their own dispatch, have left the list by now. */
+	struct Quotas *quotas = data;
+	struct ClientQuota *quota, *tmp;
+
+	quotas->disconnect = NULL;
+	wl_list_for_each_safe(quota, tmp, &quotas->clients, link)
+	{
+		if (quota->disconnect)
+		{
+			wl_client_destroy(quota->client);
+		}
+	}
+}
+
+static void quota_check(struct ClientQuota *quota)
+{
+	/* Actions are taken when a limit is first crossed, not again for every
+	 * resource created while the client stays over it. */
+	struct Quotas *quotas = quota->quotas;
+	if (quota->exempt)
+	{
+		return;
+	}
+
+	uint32_t over = quota_exceeded(quota);
+	uint32_t crossed = over & ~quota->over;
+	quota->over = over;
+	if (crossed == 0)
+	{
+		if (over == 0)
+		{
+			quota_set_throttled(quota, false);
+		}
+		return;
+	}
+
+	quota->violations++;
+	quotas->violations++;
+	wlr_log(WLR_ERROR, "Client %d over quota: %u surfaces, %u subsurfaces, "
+		"%" PRIu64 " KiB shm, %u commits/s (%s)", (int)quota->pid, quota->surfaces,
+		quota->subsurfaces, quota->shm_bytes >> 10,
+		quota->commits > quota->commit_rate ? quota->commits : quota->commit_rate,
+		action_names[quotas->limits.action]);
+
+	switch (quotas->limits.action)
+	{
+	case QUOTA_LOG:
+		break;
+	case QUOTA_THROTTLE:
+		quota_set_throttled(quota, true);
+		break;
+	case QUOTA_DISCONNECT:
+		/* Posting the error is safe from anywhere, but libwayland only acts
+		 * on it after the client's next request; destroying the client is
+		 * not safe from inside one, so that waits for an idle source. */
+		quotas->disconnects++;
+		wl_client_post_implementation_error(quota->client, "resource quota exceeded");
+		quota->disconnect = true;
+		if (quotas->disconnect == NULL)
+		{
+			quotas->disconnect = wl_event_loop_add_idle(quotas->loop, quota_disconnect,
+				quotas);
+		}
+		break;
+	}
+}
+
+static void quota_resource_release(struct QuotaResource *res)
+{
+	wl_list_remove(&res->link);
+	wl_list_remove(&res->destroy.link);
+	wl_list_remove(&res->commit.link);
+	wl_list_remove(&res->pending_link);
+	pool_free(&res->quota->quotas->resource_pool, res);
+}
+
+static void quota_resource_destroy(struct wl_listener *listener, void *data)
+{
+	struct QuotaResource *res = wl_container_of(listener, res, destroy);
+	struct ClientQuota *quota = res->quota;
+
+	switch (res->kind)
+	{
+	case QUOTA_RESOURCE_SURFACE:
+		quota->surfaces--;
+		break;
+	case QUOTA_RESOURCE_SUBSURFACE:
+		quota->subsurfaces--;
+		break;
+	case QUOTA_RESOURCE_BUFFER:
+		quota->buffers--;
+		quota->shm_bytes -= res->bytes;
+		break;
+	}
+	quota_resource_release(res);
+	if (quota->over != 0)
+	{
+		quota_check(quota);
+	}
+}
+
+static void quota_surface_commit(struct wl_listener *listener, void *data)
+{
+	struct QuotaResource *res = wl_container_of(listener, res, commit);
+	struct ClientQuota *quota = res->quota;
+	uint64_t now_ns = quota_now_ns();
+
+	if (now_ns - quota->window_start_ns >= 1000000000ull)
+	{
+		/* A window that ended long ago counts as idle, not as the rate. */
+		quota->commit_rate = now_ns - quota->window_start_ns < 2000000000ull ?
+			quota->commits : 0;
+		if (quota->commit_rate > quota->peak_commit_rate)
+		{
+			quota->peak_commit_rate = quota->commit_rate;
+		}
+		quota->commits = 0;
+		quota->window_start_ns = now_ns;
+		if (quota->over & QUOTA_COMMITS)
+		{
+			quota_check(quota);
+		}
+	}
+
+	quota->commits++;
+	struct QuotaLimits *limits = &quota->quotas->limits;
+	if (limits->commits > 0 && quota->commits == limits->commits + 1)
+	{
+		quota_check(quota);
+	}
+}
+
+static void quota_measure(void *data)
+{
+	/* The buffers' implementations are set by now, so wlroots can tell
+	 * what they are. */
+	struct Quotas *quotas = data;
+	struct ClientQuota *quota;
+
+	quotas->measure = NULL;
+	wl_list_for_each(quota, &quotas->clients, link)
+	{
+		if (wl_list_empty(&quota->pending))
+		{
+			continue;
+		}
+
+		struct QuotaResource *res, *tmp;
+		wl_list_for_each_safe(res, tmp, &quota->pending, pending_link)
+		{
+			wl_list_remove(&res->pending_link);
+			wl_list_init(&res->pending_link);
+
+			struct wlr_buffer *buffer = wlr_buffer_try_from_resource(res->resource);
+			struct wlr_shm_attributes shm;
+			if (buffer == NULL)
+			{
+				continue;
+			}
+			if (wlr_buffer_get_shm(buffer, &shm))
+			{
+				res->bytes = (uint64_t)shm.stride * shm.height;
+				quota->shm_bytes += res->bytes;
+			}
+			wlr_buffer_unlock(buffer);
+		}
+
+		if (quota->shm_bytes > quota->peak_shm_bytes)
+		{
+			quota->peak_shm_bytes = quota->shm_bytes;
+		}
+		quota_check(quota);
+	}
+}
+
+static void quota_resource_created(struct wl_listener *listener, void *data)
+{
+	struct ClientQuota *quota = wl_container_of(listener, quota, resource_created);
+	struct Quotas *quotas = quota->quotas;
+	struct wl_resource *resource = data;
+	const char *class = wl_resource_get_class(resource);
+	enum QuotaResourceKind kind;
+
+	if (strcmp(class, "wl_buffer") == 0)
+	{
+		kind = QUOTA_RESOURCE_BUFFER;
+	} else if (strcmp(class, "wl_surface") == 0)
+	{
+		kind = QUOTA_RESOURCE_SURFACE;
+	} else if (strcmp(class, "wl_subsurface") == 0)
+	{
+		kind = QUOTA_RESOURCE_SUBSURFACE;
+	} else
+	{
+		return;
+	}
+
+	struct QuotaResource *res = pool_alloc(&quotas->resource_pool);
+	if (res == NULL)
+	{
+		return;
+	}
+	res->kind = kind;
+	res->quota = quota;
+	res->resource = resource;
+	wl_list_insert(&quota->resources, &res->link);
+	wl_list_init(&res->commit.link);
+	wl_list_init(&res->pending_link);
+	res->destroy.notify = quota_resource_destroy;
+	wl_resource_add_destroy_listener(resource, &res->destroy);
+
+	switch (kind)
+	{
+	case QUOTA_RESOURCE_SURFACE:
+		quota->surfaces++;
+		break;
+	case QUOTA_RESOURCE_SUBSURFACE:
+		quota->subsurfaces++;
+		break;
+	case QUOTA_RESOURCE_BUFFER:
+		quota->buffers++;
+		wl_list_insert(&quota->pending, &res->pending_link);
+		if (quotas->measure == NULL)
+		{
+			quotas->measure = wl_event_loop_add_idle(quotas->loop, quota_measure, quotas);
+		}
+		return;
+	}
+	quota_check(quota);
+}
+
+static void quota_new_surface(struct wl_listener *listener, void *data)
+{
+	/* The wl_surface resource was counted already; now that the
+	 * wlr_surface exists, its commits can be too. */
+	struct wlr_surface *surface = data;
+	struct wl_listener *destroy = wl_resource_get_destroy_listener(surface->resource,
+		quota_resource_destroy);
+	if (destroy == NULL)
+	{
+		return;
+	}
+
+	struct QuotaResource *res = wl_container_of(destroy, res, destroy);
+	res->commit.notify = quota_surface_commit;
+	wl_signal_add(&surface->events.commit, &res->commit);
+}
+
+static void quota_client_destroy(struct wl_listener *listener, void *data)
+{
+	/* Runs before libwayland destroys the client's resources, so they are
+	 * let go of here rather than one by one afterwards. */
+	struct ClientQuota *quota = wl_container_of(listener, quota, destroy);
+	struct QuotaResource *res, *tmp;
+
+	wl_list_for_each_safe(res, tmp, &quota->resources, link)
+	{
+		quota_resource_release(res);
+	}
+	quota_set_throttled(quota, false);
+	wl_list_remove(&quota->link);
+	wl_list_remove(&quota->destroy.link);
+	wl_list_remove(&quota->resource_created.link);
+	pool_free(&quota->quotas->client_pool, quota);
+}
+
+static struct ClientQuota *quota_from_client(struct wl_client *client)
+{
+	struct wl_listener *listener = wl_client_get_destroy_listener(client,
+		quota_client_destroy);
+	if (listener == NULL)
+	{
+		return NULL;
+	}
+
+	struct ClientQuota *quota = wl_container_of(listener, quota, destroy);
+	return quota;
+}
+
+static void quota_client_created(struct wl_listener *listener, void *data)
+{
+	struct Quotas *quotas = wl_container_of(listener, quotas, client_created);
+	struct wl_client *client = data;
+
+	struct ClientQuota *quota = pool_alloc(&quotas->client_pool);
+	if (quota == NULL)
+	{
+		return;
+	}
+	quota->quotas = quotas;
+	quota->client = client;
+	quota->window_start_ns = quota_now_ns();
+	wl_client_get_credentials(client, &quota->pid, NULL, NULL);
+	wl_list_init(&quota->resources);
+	wl_list_init(&quota->pending);
+	wl_list_insert(quotas->clients.prev, &quota->link);
+
+	quota->destroy.notify = quota_client_destroy;
+	wl_client_add_destroy_listener(client, &quota->destroy);
+	quota->resource_created.notify = quota_resource_created;
+	wl_client_add_resource_created_listener(client, &quota->resource_created);
+}
+
+void quota_init(struct Quotas *quotas, struct wl_display *display,
+	struct wlr_compositor *compositor, struct wl_list *pools,
+	const struct QuotaLimits *limits)
+{
+	quotas->limits = *limits;
+	quotas->loop = wl_display_get_event_loop(display);
+	quotas->measure = NULL;
+	quotas->disconnect = NULL;
+	quotas->throttled = 0;
+	quotas->violations = quotas->disconnects = 0;
+	wl_list_init(&quotas->clients);
+	pool_init(&quotas->client_pool, pools, "client quotas", sizeof(struct ClientQuota));
+	pool_init(&quotas->resource_pool, pools, "quota resources", sizeof(struct QuotaResource));
+
+	quotas->client_created.notify = quota_client_created;
+	wl_display_add_client_created_listener(display, &quotas->client_created);
+	quotas->new_surface.notify = quota_new_surface;
+	wl_signal_add(&compositor->events.new_surface, &quotas->new_surface);
+}
+
+void quota_finish(struct Quotas *quotas)
+{
+	/* After wl_display_destroy: every client, and with it every quota, is
+	 * gone by then. */
+	pool_finish(&quotas->resource_pool);
+	pool_finish(&quotas->client_pool);
+}
+
+void quota_set_limits(struct Quotas *quotas, const struct QuotaLimits *limits)
+{
+	/* Every client over the new limits is treated as having just crossed
+	 * them, so the new action applies to it too. */
+	quotas->limits = *limits;
+	struct ClientQuota *quota;
+	wl_list_for_each(quota, &quotas->clients, link)
+	{
+		quota->over = 0;
+		quota_set_throttled(quota, false);
+		quota_check(quota);
+	}
+}
+
+void quota_exempt(struct Quotas *quotas, struct wl_client *client)
+{
+	struct ClientQuota *quota = quota_from_client(client);
+	if (quota != NULL)
+	{
+		quota->exempt = true;
+		quota->over = 0;
+		quota_set_throttled(quota, false);
+	}
+}
+
+bool quota_frame_due(struct Quotas *quotas, struct wl_client *client, uint64_t now_ns,
+	uint64_t *due_ns)
+{
+	if (quotas->throttled == 0)
+	{
+		return true;
+	}
+
+	struct ClientQuota *quota = quota_from_client(client);
+	if (quota == NULL || !quota->throttled || quota->frame_done_ns == now_ns)
+	{
+		return true;
+	}
+	uint64_t elapsed = now_ns - quota->frame_done_ns;
+	if (elapsed < 1000000000ull / QUOTA_THROTTLE_FPS)
+	{
+		*due_ns = 1000000000ull / QUOTA_THROTTLE_FPS - elapsed;
+		return false;
+	}
+	quota->frame_done_ns = now_ns;
+	return true;
+}
+
+void quota_write_summary(struct Quotas *quotas, FILE *out)
+{
+	struct QuotaLimits *limits = &quotas->limits;
+	fprintf(out, "limits: surfaces %u subsurfaces %u shm %" PRIu64 " MiB commits %u/s "
+		"action %s (0 is unlimited)\n", limits->surfaces, limits->subsurfaces,
+		limits->shm_bytes >> 20, limits->commits, action_names[limits->action]);
+	fprintf(out, "violations %" PRIu64 " disconnects %" PRIu64 " throttled %u\n",
+		quotas->violations, quotas->disconnects, quotas->throttled);
+
+	struct ClientQuota *quota;
+	wl_list_for_each(quota, &quotas->clients, link)
+	{
+		fprintf(out, "pid %d: surfaces %u subsurfaces %u buffers %u shm %" PRIu64
+			" KiB (peak %" PRIu64 ") commits %u/s (peak %u) violations %" PRIu64 "%s%s\n",
+			(int)quota->pid, quota->surfaces, quota->subsurfaces, quota->buffers,
+			quota->shm_bytes >> 10, quota->peak_shm_bytes >> 10, quota->commit_rate,
+			quota->peak_commit_rate, quota->violations,
+			quota->exempt ? " exempt" : "", quota->throttled ? " throttled" : "");
+	}
+}
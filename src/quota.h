@@ -0,0 +1,143 @@
+#ifndef QUOTA_H_
+#define QUOTA_H_
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "wayland.h"
+#include "pool.h"
+
+#define QUOTA_THROTTLE_FPS 10
+
+/*
+ * Per-client resource accounting, with optional limits.
+ *
+ * Every wl_client gets a ClientQuota when it connects, and every wl_surface,
+ * wl_subsurface and wl_buffer it creates is counted through its
+ * resource-created listener, and uncounted again by a destroy listener on
+ * the resource. Buffer sizes are only known once the request creating them
+ * is done, so they are filled in from an idle source; only shm buffers
+ * count towards the byte total, since those are what the compositor maps
+ * and uploads. Surface commits are counted over one-second windows.
+ *
+ * Limits come from the config file's `quota` line, comma-separated:
+ *
+ *   quota surfaces=512,subsurfaces=1024,shm_mb=1024,commits=2000,action=throttle
+ *
+ * Anything left out is unlimited. When a client goes over a limit, the
+ * action decides what happens: `log` only says so, `throttle` cuts its
+ * frame callbacks to QUOTA_THROTTLE_FPS until it is back within limits,
+ * and `disconnect` posts a protocol error and drops the client from an idle
+ * source, since an error posted outside its own requests would otherwise
+ * wait for the next one it sends. Without limits the accounting
+ * still runs, and the "quotas" IPC command shows it along with peaks.
+ */
+enum QuotaAction
+{
+	QUOTA_LOG,
+	QUOTA_THROTTLE,
+	QUOTA_DISCONNECT,
+};
+
+enum QuotaLimit
+{
+	QUOTA_SURFACES = 1 << 0,
+	QUOTA_SUBSURFACES = 1 << 1,
+	QUOTA_SHM_BYTES = 1 << 2,
+	QUOTA_COMMITS = 1 << 3,
+};
+
+struct QuotaLimits
+{
+	unsigned int surfaces; /* 0 for unlimited, as for all of them */
+	unsigned int subsurfaces;
+	uint64_t shm_bytes;
+	unsigned int commits;  /* per second */
+	enum QuotaAction action;
+};
+
+enum QuotaResourceKind
+{
+	QUOTA_RESOURCE_SURFACE,
+	QUOTA_RESOURCE_SUBSURFACE,
+	QUOTA_RESOURCE_BUFFER,
+};
+
+/* One counted wl_resource. */
+struct QuotaResource
+{
+	enum QuotaResourceKind kind;
+	struct ClientQuota *quota;
+	struct wl_resource *resource;
+	struct wl_list link;         /* ClientQuota.resources */
+	struct wl_listener destroy;
+	struct wl_listener commit;   /* surfaces, once the wlr_surface exists */
+	struct wl_list pending_link; /* buffers not measured yet, ClientQuota.pending */
+	uint64_t bytes;
+};
+
+struct ClientQuota
+{
+	struct wl_list link; /* Quotas.clients */
+	struct Quotas *quotas;
+	struct wl_client *client;
+	pid_t pid;
+	bool exempt;
+	struct wl_listener destroy;
+	struct wl_listener resource_created;
+	struct wl_list resources; /* QuotaResource.link */
+	struct wl_list pending;   /* QuotaResource.pending_link */
+
+	unsigned int surfaces, subsurfaces, buffers;
+	uint64_t shm_bytes, peak_shm_bytes;
+	unsigned int commits;     /* in the current window */
+	unsigned int commit_rate; /* over the last full window */
+	unsigned int peak_commit_rate;
+	uint64_t window_start_ns;
+
+	uint32_t over;            /* QuotaLimit bits currently exceeded */
+	bool throttled;
+	bool disconnect;          /* to be dropped by Quotas.disconnect */
+	uint64_t frame_done_ns;   /* last frame callback sent while throttled */
+	uint64_t violations;
+};
+
+struct Quotas
+{
+	struct QuotaLimits limits;
+	struct wl_event_loop *loop;
+	struct wl_list clients; /* ClientQuota.link */
+	struct wl_listener client_created;
+	struct wl_listener new_surface;
+	struct wl_event_source *measure; /* idle source sizing new buffers */
+	struct wl_event_source *disconnect; /* idle source dropping clients over quota */
+	struct Pool client_pool;
+	struct Pool resource_pool;
+	unsigned int throttled; /* clients currently throttled */
+	uint64_t violations;
+	uint64_t disconnects;
+};
+
+/* Parses a `quota` list into `limits`, leaving keys that are not
+ * mentioned alone. Returns false, after logging, on anything malformed. */
+bool quota_parse_limits(struct QuotaLimits *limits, const char *spec);
+
+void quota_init(struct Quotas *quotas, struct wl_display *display,
+	struct wlr_compositor *compositor, struct wl_list *pools,
+	const struct QuotaLimits *limits);
+void quota_finish(struct Quotas *quotas);
+/* Clients already connected are checked against the new limits at once. */
+void quota_set_limits(struct Quotas *quotas, const struct QuotaLimits *limits);
+
+/* Limits never apply to `client` (Xwayland, which speaks for all X11
+ * clients at once); it is still accounted. */
+void quota_exempt(struct Quotas *quotas, struct wl_client *client);
+
+/* Whether a surface of `client` may get a frame callback at `now_ns`; if
+ * not, `due_ns` is set to how long until it may. The first surface of a
+ * throttled client asking in a frame decides for all of its surfaces. */
+bool quota_frame_due(struct Quotas *quotas, struct wl_client *client, uint64_t now_ns,
+	uint64_t *due_ns);
+
+void quota_write_summary(struct Quotas *quotas, FILE *out);
+
+#endif
@@ -0,0 +1,371 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/interfaces/wlr_keyboard.h>
+#include <wlr/interfaces/wlr_pointer.h>
+
+#include "record.h"
+#include "metrics.h"
+
+static const char record_magic[8] = "SCWLREC\1";
+
+static const size_t record_payload_size[RECORD_TYPE_LAST] = {
+	[RECORD_MOTION] = sizeof(((struct RecordEvent *)0)->motion),
+	[RECORD_MOTION_ABSOLUTE] = sizeof(((struct RecordEvent *)0)->absolute),
+	[RECORD_BUTTON] = sizeof(((struct RecordEvent *)0)->button),
+	[RECORD_AXIS] = sizeof(((struct RecordEvent *)0)->axis),
+	[RECORD_FRAME] = 0,
+	[RECORD_KEY] = sizeof(((struct RecordEvent *)0)->key),
+	[RECORD_MODIFIERS] = sizeof(((struct RecordEvent *)0)->modifiers),
+};
+
+bool recorder_open(struct Recorder *recorder, const char *path)
+{
+	recorder->events = 0;
+	recorder->file = fopen(path, "wb");
+	if (recorder->file == NULL)
+	{
+		wlr_log_errno(WLR_ERROR, "Failed to open input recording %s", path);
+		return false;
+	}
+
+	fwrite(record_magic, sizeof(record_magic), 1, recorder->file);
+	wlr_log(WLR_INFO, "Recording input events to %s", path);
+	return true;
+}
+
+void recorder_close(struct Recorder *recorder)
+{
+	if (recorder->file == NULL)
+	{
+		return;
+	}
+
+	fclose(recorder->file);
+	recorder->file = NULL;
+	wlr_log(WLR_INFO, "Recorded %" PRIu64 " input events", recorder->events);
+}
+
+void record_event(struct Recorder *recorder, const struct RecordEvent *event)
+{
+	/* Writes go into stdio's buffer; the file only sees a syscall every few
+	 * hundred events. */
+	if (recorder->file == NULL)
+	{
+		return;
+	}
+
+	fwrite(&event->type, sizeof(event->type), 1, recorder->file);
+	fwrite(&event->time_msec, sizeof(event->time_msec), 1, recorder->file);
+	if (record_payload_size[event->type] > 0)
+	{
+		fwrite(&event->motion, record_payload_size[event->type], 1, recorder->file);
+	}
+	recorder->events++;
+}
+
+void record_motion(struct Recorder *recorder, const struct wlr_pointer_motion_event *event)
+{
+	struct RecordEvent record = {
+		.type = RECORD_MOTION,
+		.time_msec = event->time_msec,
+		.motion = { event->delta_x, event->delta_y, event->unaccel_dx, event->unaccel_dy },
+	};
+	record_event(recorder, &record);
+}
+
+void record_motion_absolute(struct Recorder *recorder,
+	const struct wlr_pointer_motion_absolute_event *event)
+{
+	struct RecordEvent record = {
+		.type = RECORD_MOTION_ABSOLUTE,
+		.time_msec = event->time_msec,
+		.absolute = { event->x, event->y },
+	};
+	record_event(recorder, &record);
+}
+
+void record_button(struct Recorder *recorder, const struct wlr_pointer_button_event *event)
+{
+	struct RecordEvent record = {
+		.type = RECORD_BUTTON,
+		.time_msec = event->time_msec,
+		.button = { event->button, event->state },
+	};
+	record_event(recorder, &record);
+}
+
+void record_axis(struct Recorder *recorder, const struct wlr_pointer_axis_event *event)
+{
+	struct RecordEvent record = {
+		.type = RECORD_AXIS,
+		.time_msec = event->time_msec,
+		.axis = { event->delta, event->delta_discrete, event->orientation,
+			event->source, event->relative_direction },
+	};
+	record_event(recorder, &record);
+}
+
+void record_frame(struct Recorder *recorder)
+{
+	/* Frame events carry no timestamp of their own. */
+	struct RecordEvent record = {
+		.type = RECORD_FRAME,
+		.time_msec = (uint32_t)(metrics_now_ns() / 1000000),
+	};
+	record_event(recorder, &record);
+}
+
+void record_key(struct Recorder *recorder, const struct wlr_keyboard_key_event *event)
+{
+	struct RecordEvent record = {
+		.type = RECORD_KEY,
+		.time_msec = event->time_msec,
+		.key = { event->keycode, event->state },
+	};
+	record_event(recorder, &record);
+}
+
+void record_modifiers(struct Recorder *recorder, const struct wlr_keyboard_modifiers *modifiers)
+{
+	struct RecordEvent record = {
+		.type = RECORD_MODIFIERS,
+		.time_msec = (uint32_t)(metrics_now_ns() / 1000000),
+		.modifiers = { modifiers->depressed, modifiers->latched, modifiers->locked,
+			modifiers->group },
+	};
+	record_event(recorder, &record);
+}
+
+static const struct wlr_pointer_impl replay_pointer_impl = {
+	.name = "scowl-replay-pointer",
+};
+
+static const struct wlr_keyboard_impl replay_keyboard_impl = {
+	.name = "scowl-replay-keyboard",
+};
+
+static bool replay_read(struct Replay *replay)
+{
+	struct RecordEvent *event = &replay->next;
+
+	if (fread(&event->type, sizeof(event->type), 1, replay->file) != 1 ||
+		fread(&event->time_msec, sizeof(event->time_msec), 1, replay->file) != 1)
+	{
+		return false;
+	}
+
+	if (event->type == 0 || event->type >= RECORD_TYPE_LAST)
+	{
+		wlr_log(WLR_ERROR, "Corrupt input recording (record type %u)", event->type);
+		return false;
+	}
+
+	size_t size = record_payload_size[event->type];
+	return size == 0 || fread(&event->motion, size, 1, replay->file) == 1;
+}
+
+static void replay_inject(struct Replay *replay, const struct RecordEvent *event)
+{
+	/* Events are stamped with the current time rather than the recorded one,
+	 * so latency measurements during a replay stay meaningful. */
+	uint32_t now_msec = (uint32_t)(metrics_now_ns() / 1000000);
+
+	switch (event->type)
+	{
+	case RECORD_MOTION:
+	{
+		struct wlr_pointer_motion_event motion = {
+			.pointer = &replay->pointer,
+			.time_msec = now_msec,
+			.delta_x = event->motion.dx,
+			.delta_y = event->motion.dy,
+			.unaccel_dx = event->motion.unaccel_dx,
+			.unaccel_dy = event->motion.unaccel_dy,
+		};
+		wl_signal_emit_mutable(&replay->pointer.events.motion, &motion);
+		break;
+	}
+	case RECORD_MOTION_ABSOLUTE:
+	{
+		struct wlr_pointer_motion_absolute_event absolute = {
+			.pointer = &replay->pointer,
+			.time_msec = now_msec,
+			.x = event->absolute.x,
+			.y = event->absolute.y,
+		};
+		wl_signal_emit_mutable(&replay->pointer.events.motion_absolute, &absolute);
+		break;
+	}
+	case RECORD_BUTTON:
+	{
+		struct wlr_pointer_button_event button = {
+			.pointer = &replay->pointer,
+			.time_msec = now_msec,
+			.button = event->button.button,
+			.state = event->button.state,
+		};
+		wl_signal_emit_mutable(&replay->pointer.events.button, &button);
+		break;
+	}
+	case RECORD_AXIS:
+	{
+		struct wlr_pointer_axis_event axis = {
+			.pointer = &replay->pointer,
+			.time_msec = now_msec,
+			.source = event->axis.source,
+			.orientation = event->axis.orientation,
+			.relative_direction = event->axis.relative_direction,
+			.delta = event->axis.delta,
+			.delta_discrete = event->axis.discrete,
+		};
+		wl_signal_emit_mutable(&replay->pointer.events.axis, &axis);
+		break;
+	}
+	case RECORD_FRAME:
+		wl_signal_emit_mutable(&replay->pointer.events.frame, &replay->pointer);
+		break;
+	case RECORD_KEY:
+	{
+		struct wlr_keyboard_key_event key = {
+			.time_msec = now_msec,
+			.keycode = event->key.keycode,
+			.update_state = true,
+			.state = event->key.state,
+		};
+		wlr_keyboard_notify_key(&replay->keyboard, &key);
+		break;
+	}
+	case RECORD_MODIFIERS:
+		/* Usually a no-op, as replayed keys already updated the xkb state;
+		 * this catches modifiers latched or locked by other means. */
+		wlr_keyboard_notify_modifiers(&replay->keyboard, event->modifiers.depressed,
+			event->modifiers.latched, event->modifiers.locked, event->modifiers.group);
+		break;
+	}
+
+	replay->injected++;
+}
+
+static int replay_handle_timer(void *data)
+{
+	struct Replay *replay = data;
+	uint64_t elapsed_ns = metrics_now_ns() - replay->start_ns;
+
+	for (;;)
+	{
+		/* Records with a timestamp from before the first one (frame and
+		 * modifier records use the compositor's clock, which a nested backend
+		 * may not share) are due immediately. */
+		int32_t offset_ms = (int32_t)(replay->next.time_msec - replay->first_msec);
+		uint64_t due_ns = 0;
+		if (replay->speed > 0 && offset_ms > 0)
+		{
+			due_ns = (uint64_t)(offset_ms * 1e6 / replay->speed);
+		}
+
+		if (due_ns > elapsed_ns)
+		{
+			int delay_ms = (int)((due_ns - elapsed_ns) / 1000000);
+			wl_event_source_timer_update(replay->timer, delay_ms > 0 ? delay_ms : 1);
+			return 0;
+		}
+
+		replay_inject(replay, &replay->next);
+		if (!replay_read(replay))
+		{
+			break;
+		}
+
+		if (replay->speed == 0 && replay->injected % 256 == 0)
+		{
+			/* Even at full speed, give clients a chance to respond. */
+			wl_event_source_timer_update(replay->timer, 1);
+			return 0;
+		}
+	}
+
+	wlr_log(WLR_INFO, "Replay finished: %" PRIu64 " events in %.3fs", replay->injected,
+		(metrics_now_ns() - replay->start_ns) / 1e9);
+	fclose(replay->file);
+	replay->file = NULL;
+
+	if (replay->running != NULL)
+	{
+		*replay->running = false;
+		wl_display_terminate(replay->display);
+	}
+	return 0;
+}
+
+bool replay_start(struct Replay *replay, const char *path, double speed,
+	struct wl_display *display, struct wlr_backend *backend, bool *running)
+{
+	char magic[sizeof(record_magic)];
+
+	replay->file = fopen(path, "rb");
+	if (replay->file == NULL)
+	{
+		wlr_log_errno(WLR_ERROR, "Failed to open input recording %s", path);
+		return false;
+	}
+
+	if (fread(magic, sizeof(magic), 1, replay->file) != 1 ||
+		memcmp(magic, record_magic, sizeof(magic)) != 0)
+	{
+		wlr_log(WLR_ERROR, "%s is not an input recording", path);
+		fclose(replay->file);
+		replay->file = NULL;
+		return false;
+	}
+
+	if (!replay_read(replay))
+	{
+		wlr_log(WLR_ERROR, "Input recording %s is empty", path);
+		fclose(replay->file);
+		replay->file = NULL;
+		return false;
+	}
+
+	/* The virtual devices are announced like any hotplugged device, so they
+	 * get the same cursor attachment and keymap as real ones. */
+	wlr_pointer_init(&replay->pointer, &replay_pointer_impl, replay_pointer_impl.name);
+	wlr_keyboard_init(&replay->keyboard, &replay_keyboard_impl, replay_keyboard_impl.name);
+	wl_signal_emit_mutable(&backend->events.new_input, &replay->pointer.base);
+	wl_signal_emit_mutable(&backend->events.new_input, &replay->keyboard.base);
+	replay->devices_created = true;
+
+	replay->display = display;
+	replay->running = running;
+	replay->speed = speed;
+	replay->injected = 0;
+	replay->first_msec = replay->next.time_msec;
+	replay->start_ns = metrics_now_ns();
+	replay->timer = wl_event_loop_add_timer(wl_display_get_event_loop(display),
+		replay_handle_timer, replay);
+	wl_event_source_timer_update(replay->timer, 1);
+
+	wlr_log(WLR_INFO, "Replaying input from %s at %gx speed", path, speed);
+	return true;
+}
+
+void replay_finish(struct Replay *replay)
+{
+	if (replay->timer != NULL)
+	{
+		wl_event_source_remove(replay->timer);
+		replay->timer = NULL;
+	}
+	if (replay->file != NULL)
+	{
+		fclose(replay->file);
+		replay->file = NULL;
+	}
+	if (replay->devices_created)
+	{
+		wlr_pointer_finish(&replay->pointer);
+		wlr_keyboard_finish(&replay->keyboard);
+		replay->devices_created = false;
+	}
+}
@@ -0,0 +1,84 @@
+#ifndef RECORD_H_
+#define RECORD_H_
+
+#include <stdio.h>
+#include "wayland.h"
+
+/*
+ * Input recording and replay, for repeatable benchmark workloads.
+ *
+ * The log starts with an 8 byte magic, followed by one record per event: a
+ * type byte, the event's time_msec and a fixed-size payload for that type, in
+ * host byte order. Replay injects the log through a virtual pointer and
+ * keyboard, paced by the recorded timestamps and scaled by a speed factor,
+ * typically on the headless backend (WLR_BACKENDS=headless).
+ */
+
+enum RecordType
+{
+	RECORD_MOTION = 1,
+	RECORD_MOTION_ABSOLUTE,
+	RECORD_BUTTON,
+	RECORD_AXIS,
+	RECORD_FRAME,
+	RECORD_KEY,
+	RECORD_MODIFIERS,
+	RECORD_TYPE_LAST,
+};
+
+struct RecordEvent
+{
+	uint8_t type;
+	uint32_t time_msec;
+	union {
+		struct { float dx, dy, unaccel_dx, unaccel_dy; } motion;
+		struct { float x, y; } absolute;
+		struct { uint32_t button; uint8_t state; } button;
+		struct { float delta; int32_t discrete; uint8_t orientation, source, relative_direction; } axis;
+		struct { uint32_t keycode; uint8_t state; } key;
+		struct { uint32_t depressed, latched, locked, group; } modifiers;
+	};
+};
+
+struct Recorder
+{
+	FILE *file;
+	uint64_t events;
+};
+
+struct Replay
+{
+	FILE *file;
+	struct wl_display *display;
+	struct wl_event_source *timer;
+	struct wlr_pointer pointer;
+	struct wlr_keyboard keyboard;
+	bool devices_created;
+	double speed;
+	bool *running; /* cleared when the replay ends, if set */
+	uint64_t start_ns;
+	uint32_t first_msec;
+	struct RecordEvent next;
+	uint64_t injected;
+};
+
+bool recorder_open(struct Recorder *recorder, const char *path);
+void recorder_close(struct Recorder *recorder);
+void record_event(struct Recorder *recorder, const struct RecordEvent *event);
+
+void record_motion(struct Recorder *recorder, const struct wlr_pointer_motion_event *event);
+void record_motion_absolute(struct Recorder *recorder,
+	const struct wlr_pointer_motion_absolute_event *event);
+void record_button(struct Recorder *recorder, const struct wlr_pointer_button_event *event);
+void record_axis(struct Recorder *recorder, const struct wlr_pointer_axis_event *event);
+void record_frame(struct Recorder *recorder);
+void record_key(struct Recorder *recorder, const struct wlr_keyboard_key_event *event);
+void record_modifiers(struct Recorder *recorder, const struct wlr_keyboard_modifiers *modifiers);
+
+/* `speed` scales playback (2.0 is twice as fast); 0 replays without waiting.
+ * If `running` is given, the compositor is stopped once the log runs out. */
+bool replay_start(struct Replay *replay, const char *path, double speed,
+	struct wl_display *display, struct wlr_backend *backend, bool *running);
+void replay_finish(struct Replay *replay);
+
+#endif
@@ -0,0 +1,440 @@
+#include <errno.h>
+#include <fnmatch.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "content.h"
+#include "rules.h"
+#include "xwayland.h"
+
+static const char *const window_type_names[NetLast] = {
+	[NetWMWindowTypeDialog] = "dialog",
+	[NetWMWindowTypeSplash] = "splash",
+	[NetWMWindowTypeToolbar] = "toolbar",
+	[NetWMWindowTypeUtility] = "utility",
+};
+
+static uint64_t rules_hash(const char *s)
+{
+	/* FNV-1a; NULL hashes like the empty string. */
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (; s != NULL && *s != '\0'; s++)
+	{
+		hash = (hash ^ (unsigned char)*s) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+static bool matcher_compile(struct RuleMatcher *matcher, const char *pattern,
+	const char *where)
+{
+	size_t len = strlen(pattern);
+
+	if (len >= 2 && pattern[0] == '/' && pattern[len - 1] == '/')
+	{
+		matcher->pattern = strndup(pattern + 1, len - 2);
+		int err = regcomp(&matcher->regex, matcher->pattern, REG_EXTENDED | REG_NOSUB);
+		if (err != 0)
+		{
+			char message[128];
+			regerror(err, &matcher->regex, message, sizeof(message));
+			wlr_log(WLR_ERROR, "%s: bad regex /%s/: %s", where, matcher->pattern, message);
+			free(matcher->pattern);
+			matcher->pattern = NULL;
+			return false;
+		}
+		matcher->kind = RULE_MATCH_REGEX;
+		return true;
+	}
+
+	matcher->pattern = strdup(pattern);
+	matcher->kind = strpbrk(pattern, "*?[") != NULL ? RULE_MATCH_GLOB : RULE_MATCH_EXACT;
+	return true;
+}
+
+static void matcher_finish(struct RuleMatcher *matcher)
+{
+	if (matcher->kind == RULE_MATCH_REGEX)
+	{
+		regfree(&matcher->regex);
+	}
+	free(matcher->pattern);
+	matcher->pattern = NULL;
+	matcher->kind = RULE_MATCH_ANY;
+}
+
+static bool matcher_match(const struct RuleMatcher *matcher, const char *s)
+{
+	if (s == NULL)
+	{
+		s = "";
+	}
+
+	switch (matcher->kind)
+	{
+	case RULE_MATCH_ANY:
+		return true;
+	case RULE_MATCH_EXACT:
+		return strcmp(matcher->pattern, s) == 0;
+	case RULE_MATCH_GLOB:
+		return fnmatch(matcher->pattern, s, 0) == 0;
+	case RULE_MATCH_REGEX:
+		return regexec(&matcher->regex, s, 0, NULL, 0) == 0;
+	}
+	return false;
+}
+
+static void rule_finish(struct Rule *rule)
+{
+	matcher_finish(&rule->app_id);
+	matcher_finish(&rule->title);
+	free((char *)rule->result.output);
+}
+
+void rules_init(struct RuleSet *rules)
+{
+	memset(rules, 0, sizeof(*rules));
+	rules->generation = 1;
+}
+
+void rules_finish(struct RuleSet *rules)
+{
+	for (size_t i = 0; i < rules->count; i++)
+	{
+		rule_finish(&rules->rules[i]);
+	}
+	free(rules->rules);
+	rules->rules = NULL;
+	rules->count = 0;
+	rules->match_title = false;
+	rules->generation++;
+}
+
+/*
+ * Splits off the next `key[=value]` word. Values may be double-quoted to
+ * hold spaces; a lone ":" comes back as its own key.
+ */
+static bool next_word(const char **cursor, char *key, size_t key_size,
+	char *value, size_t value_size)
+{
+	const char *p = *cursor;
+	while (*p == ' ' || *p == '\t')
+	{
+		p++;
+	}
+	if (*p == '\0' || *p == '\n' || *p == '#')
+	{
+		return false;
+	}
+
+	size_t k = 0;
+	while (*p != '\0' && *p != '=' && *p != ' ' && *p != '\t' && *p != '\n')
+	{
+		if (k + 1 < key_size)
+		{
+			key[k++] = *p;
+		}
+		p++;
+	}
+	key[k] = '\0';
+
+	size_t v = 0;
+	if (*p == '=')
+	{
+		p++;
+		bool quoted = *p == '"';
+		if (quoted)
+		{
+			p++;
+		}
+		while (*p != '\0' && *p != '\n' &&
+			(quoted ? *p != '"' : (*p != ' ' && *p != '\t')))
+		{
+			if (quoted && *p == '\\' && p[1] == '"')
+			{
+				p++;
+			}
+			if (v + 1 < value_size)
+			{
+				value[v++] = *p;
+			}
+			p++;
+		}
+		if (quoted && *p == '"')
+		{
+			p++;
+		}
+	}
+	value[v] = '\0';
+
+	*cursor = p;
+	return true;
+}
+
+static bool rule_parse_action(struct Rule *rule, const char *key, const char *value,
+	const char *where)
+{
+	struct RuleResult *result = &rule->result;
+	char *end;
+
+	if (strcmp(key, "output") == 0 && value[0] != '\0')
+	{
+		free((char *)result->output);
+		result->output = strdup(value);
+		result->set |= RULE_OUTPUT;
+	} else if (strcmp(key, "opacity") == 0)
+	{
+		result->opacity = strtof(value, &end);
+		if (*end != '\0' || result->opacity < 0.0f || result->opacity > 1.0f)
+		{
+			wlr_log(WLR_ERROR, "%s: opacity must be between 0 and 1, not '%s'", where, value);
+			return false;
+		}
+		result->set |= RULE_OPACITY;
+	} else if (strcmp(key, "tearing") == 0)
+	{
+		result->set |= RULE_TEARING;
+		result->tearing = strcmp(value, "no") != 0 && strcmp(value, "false") != 0;
+	} else if (strcmp(key, "throttle") == 0)
+	{
+		/* throttle=0 lifts a throttle set by an earlier rule. */
+		result->throttle_fps = strtoul(value, &end, 10);
+		if (*end != '\0' || value[0] == '\0')
+		{
+			wlr_log(WLR_ERROR, "%s: throttle wants frames per second, not '%s'", where, value);
+			return false;
+		}
+		result->set |= RULE_THROTTLE;
+	} else if (strcmp(key, "content") == 0)
+	{
+		if (!content_type_parse(value, &result->content))
+		{
+			wlr_log(WLR_ERROR, "%s: content wants none, photo, video or game, not '%s'",
+				where, value);
+			return false;
+		}
+		result->set |= RULE_CONTENT;
+	} else if (strcmp(key, "hidden_fps") == 0)
+	{
+		result->hidden_fps = strtoul(value, &end, 10);
+		if (*end != '\0' || value[0] == '\0')
+		{
+			wlr_log(WLR_ERROR, "%s: hidden_fps wants frames per second, not '%s'", where, value);
+			return false;
+		}
+		result->set |= RULE_HIDDEN_FPS;
+	} else
+	{
+		wlr_log(WLR_ERROR, "%s: unknown action '%s'", where, key);
+		return false;
+	}
+	return true;
+}
+
+static bool rule_parse_match(struct Rule *rule, const char *key, const char *value,
+	const char *where)
+{
+	if (strcmp(key, "app_id") == 0 || strcmp(key, "class") == 0)
+	{
+		matcher_finish(&rule->app_id);
+		return matcher_compile(&rule->app_id, value, where);
+	} else if (strcmp(key, "title") == 0)
+	{
+		matcher_finish(&rule->title);
+		return matcher_compile(&rule->title, value, where);
+	} else if (strcmp(key, "type") == 0)
+	{
+		for (int i = 0; i < NetLast; i++)
+		{
+			if (strcmp(value, window_type_names[i]) == 0)
+			{
+				rule->window_type = i;
+				return true;
+			}
+		}
+		wlr_log(WLR_ERROR, "%s: unknown window type '%s'", where, value);
+		return false;
+	}
+
+	wlr_log(WLR_ERROR, "%s: unknown matcher '%s'", where, key);
+	return false;
+}
+
+bool rules_parse_line(struct RuleSet *rules, const char *line, const char *where)
+{
+	struct Rule rule = { .window_type = -1 };
+	char key[32], value[256];
+	bool words = false;
+	bool actions = false;
+	bool ok = true;
+
+	const char *cursor = line;
+	while (ok && next_word(&cursor, key, sizeof(key), value, sizeof(value)))
+	{
+		words = true;
+		if (strcmp(key, ":") == 0)
+		{
+			actions = true;
+		} else if (actions)
+		{
+			ok = rule_parse_action(&rule, key, value, where);
+		} else
+		{
+			ok = rule_parse_match(&rule, key, value, where);
+		}
+	}
+
+	if (!words)
+	{
+		/* Blank line or comment. */
+		return true;
+	}
+	if (ok && !actions)
+	{
+		wlr_log(WLR_ERROR, "%s: rule has no ':' before its actions", where);
+		ok = false;
+	}
+	if (!ok)
+	{
+		rule_finish(&rule);
+		return false;
+	}
+
+	struct Rule *grown = realloc(rules->rules, (rules->count + 1) * sizeof(*grown));
+	if (grown == NULL)
+	{
+		rule_finish(&rule);
+		return false;
+	}
+	rules->rules = grown;
+	rules->rules[rules->count++] = rule;
+	rules->match_title |= rule.title.kind != RULE_MATCH_ANY;
+	rules->generation++;
+	return true;
+}
+
+static void result_apply(struct RuleResult *result, const struct RuleResult *rule)
+{
+	if (rule->set & RULE_OUTPUT)
+	{
+		result->output = rule->output;
+	}
+	if (rule->set & RULE_OPACITY)
+	{
+		result->opacity = rule->opacity;
+	}
+	if (rule->set & RULE_TEARING)
+	{
+		result->tearing = rule->tearing;
+	}
+	if (rule->set & RULE_THROTTLE)
+	{
+		result->throttle_fps = rule->throttle_fps;
+	}
+	if (rule->set & RULE_CONTENT)
+	{
+		result->content = rule->content;
+	}
+	if (rule->set & RULE_HIDDEN_FPS)
+	{
+		result->hidden_fps = rule->hidden_fps;
+	}
+	result->set |= rule->set;
+}
+
+bool rules_evaluate(struct RuleSet *rules, struct RuleCache *cache, struct RuleResult *result,
+	const char *app_id, const char *title, uint32_t window_types)
+{
+	/* Hashing is far cheaper than running every regex again, and titles
+	 * are not even hashed unless some rule looks at them. */
+	uint64_t app_id_hash = rules_hash(app_id);
+	uint64_t title_hash = rules->match_title ? rules_hash(title) : 0;
+	if (cache->generation == rules->generation && cache->app_id_hash == app_id_hash &&
+		cache->title_hash == title_hash && cache->window_types == window_types)
+	{
+		rules->cached++;
+		return false;
+	}
+	cache->generation = rules->generation;
+	cache->app_id_hash = app_id_hash;
+	cache->title_hash = title_hash;
+	cache->window_types = window_types;
+
+	rules->evaluations++;
+	memset(result, 0, sizeof(*result));
+	for (size_t i = 0; i < rules->count; i++)
+	{
+		struct Rule *rule = &rules->rules[i];
+		if ((rule->window_type >= 0 && !(window_types & (1u << rule->window_type))) ||
+			!matcher_match(&rule->app_id, app_id) ||
+			!matcher_match(&rule->title, title))
+		{
+			continue;
+		}
+		rule->matches++;
+		result_apply(result, &rule->result);
+	}
+	return true;
+}
+
+static void matcher_write(const char *name, const struct RuleMatcher *matcher, FILE *out)
+{
+	switch (matcher->kind)
+	{
+	case RULE_MATCH_ANY:
+		break;
+	case RULE_MATCH_REGEX:
+		fprintf(out, " %s=/%s/", name, matcher->pattern);
+		break;
+	default:
+		fprintf(out, " %s=%s", name, matcher->pattern);
+		break;
+	}
+}
+
+void rules_write_summary(struct RuleSet *rules, FILE *out)
+{
+	fprintf(out, "%zu rules, %" PRIu64 " evaluations, %" PRIu64 " skipped by cache\n",
+		rules->count, rules->evaluations, rules->cached);
+
+	for (size_t i = 0; i < rules->count; i++)
+	{
+		struct Rule *rule = &rules->rules[i];
+		struct RuleResult *result = &rule->result;
+
+		fprintf(out, "%6" PRIu64 " matches:", rule->matches);
+		matcher_write("app_id", &rule->app_id, out);
+		matcher_write("title", &rule->title, out);
+		if (rule->window_type >= 0)
+		{
+			fprintf(out, " type=%s", window_type_names[rule->window_type]);
+		}
+		fprintf(out, " :");
+		if (result->set & RULE_OUTPUT)
+		{
+			fprintf(out, " output=%s", result->output);
+		}
+		if (result->set & RULE_OPACITY)
+		{
+			fprintf(out, " opacity=%.2f", result->opacity);
+		}
+		if (result->set & RULE_TEARING)
+		{
+			fprintf(out, " tearing=%s", result->tearing ? "yes" : "no");
+		}
+		if (result->set & RULE_THROTTLE)
+		{
+			fprintf(out, " throttle=%u", result->throttle_fps);
+		}
+		if (result->set & RULE_CONTENT)
+		{
+			fprintf(out, " content=%s", content_policy(result->content)->name);
+		}
+		if (result->set & RULE_HIDDEN_FPS)
+		{
+			fprintf(out, " hidden_fps=%u", result->hidden_fps);
+		}
+		fprintf(out, "\n");
+	}
+}
@@ -0,0 +1,105 @@
+#ifndef RULES_H_
+#define RULES_H_
+
+#include <regex.h>
+#include <stdio.h>
+#include "wayland.h"
+
+/*
+ * Per-application window rules, matched against a window's app_id (WM_CLASS
+ * for X11 windows), its title and its X11 window types. Patterns are
+ * compiled once, when the rules are loaded: a pattern between slashes is an
+ * extended regex, one containing *, ? or [ is a glob, and anything else is
+ * compared as a plain string.
+ *
+ * Rules come from `rule` lines in the config file, matchers before the
+ * colon and actions after it:
+ *
+ *   app_id=firefox title="/^Picture-in-Picture$/" : opacity=0.9
+ *   app_id=mpv : output=HDMI-A-1 tearing
+ *   app_id=steam_app_* : throttle=30
+ *   app_id=imv : content=photo hidden_fps=0
+ *
+ * Every matching rule applies, in file order, so later rules win.
+ */
+enum RuleMatchKind
+{
+	RULE_MATCH_ANY,
+	RULE_MATCH_EXACT,
+	RULE_MATCH_GLOB,
+	RULE_MATCH_REGEX,
+};
+
+struct RuleMatcher
+{
+	enum RuleMatchKind kind;
+	char *pattern;
+	regex_t regex;
+};
+
+enum RuleAction
+{
+	RULE_OUTPUT = 1 << 0,
+	RULE_OPACITY = 1 << 1,
+	RULE_TEARING = 1 << 2,
+	RULE_THROTTLE = 1 << 3,
+	RULE_CONTENT = 1 << 4,
+	RULE_HIDDEN_FPS = 1 << 5,
+};
+
+/* What a rule sets, or the combined effect of every rule matching a window. */
+struct RuleResult
+{
+	uint32_t set; /* RuleAction bits */
+	const char *output; /* owned by the rule set */
+	float opacity;
+	bool tearing;
+	unsigned int throttle_fps;
+	enum wp_content_type_v1_type content; /* instead of what the client reports */
+	unsigned int hidden_fps;              /* instead of the content type's rate */
+};
+
+struct Rule
+{
+	struct RuleMatcher app_id;
+	struct RuleMatcher title;
+	int window_type; /* NetWMWindowType*, or -1 for any */
+	struct RuleResult result;
+	uint64_t matches;
+};
+
+struct RuleSet
+{
+	struct Rule *rules;
+	size_t count;
+	bool match_title;    /* some rule looks at titles */
+	uint64_t generation; /* bumped whenever the rules change */
+	uint64_t evaluations;
+	uint64_t cached;     /* evaluations skipped because nothing changed */
+};
+
+/* The inputs a window's rules were last evaluated against. */
+struct RuleCache
+{
+	uint64_t generation;
+	uint64_t app_id_hash;
+	uint64_t title_hash;
+	uint32_t window_types;
+};
+
+void rules_init(struct RuleSet *rules);
+void rules_finish(struct RuleSet *rules);
+/* Adds one rule; one that does not parse is logged and left out. */
+bool rules_parse_line(struct RuleSet *rules, const char *line, const char *where);
+
+/*
+ * Recomputes `result` unless the window's app_id, title (if any rule cares)
+ * and window types (bitmask of NetWMWindowType*) are the same as the last
+ * time. Returns whether `result` was recomputed.
+ */
+bool rules_evaluate(struct RuleSet *rules, struct RuleCache *cache, struct RuleResult *result,
+	const char *app_id, const char *title, uint32_t window_types);
+
+void rules_write_summary(struct RuleSet *rules, FILE *out);
+
+#endif
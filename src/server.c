@@ -1,11 +1,302 @@
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <math.h>
+#include <poll.h>
 
 #include "server.h"
 #include "xwayland.h"
+#include "logger.h"
+#include "profile.h"
 
-static void focus_toplevel(struct Toplevel *toplevel, struct wlr_surface *surface) 
+static struct Client *toplevel_from_surface(struct wlr_surface *surface)
+{
+	/* Popups are walked up to the toplevel they belong to. */
+	struct wlr_xdg_surface *xdg_surface;
+	while (surface != NULL && (xdg_surface = wlr_xdg_surface_try_from_wlr_surface(
+			wlr_surface_get_root_surface(surface))) != NULL)
+	{
+		if (xdg_surface->role == WLR_XDG_SURFACE_ROLE_TOPLEVEL)
+		{
+			struct wlr_scene_tree *tree = xdg_surface->data;
+			return tree != NULL ? tree->node.data : NULL;
+		}
+		if (xdg_surface->role != WLR_XDG_SURFACE_ROLE_POPUP)
+		{
+			break;
+		}
+		surface = xdg_surface->popup->parent;
+	}
+	return NULL;
+}
+
+static const float border_color[] = { 0.27f, 0.27f, 0.27f, 1.0f };
+static const float focus_color[] = { 0.37f, 0.51f, 0.67f, 1.0f };
+
+static void server_schedule_frames(struct Server *server)
+{
+	struct Output *output;
+	wl_list_for_each(output, &server->outputs, link)
+	{
+		wlr_output_schedule_frame(output->wlr_output);
+	}
+}
+
+static void hidden_frames_invalidate(struct Server *server)
+{
+	/* Windows are only checked for being hidden after something that can
+	 * hide or show one; walking every buffer on every frame is too much. */
+	server->hidden_frames_dirty = true;
+}
+
+static struct wlr_output *toplevel_output(struct Client *toplevel);
+
+static bool toplevel_refresh_title(struct Client *toplevel)
+{
+	/* Returns true if this made the title bar the first dirty one. */
+	struct Server *server = toplevel->server;
+
+	if (toplevel->title_height == 0)
+	{
+		return false;
+	}
+
+	/* Rendered for the output the window is (mostly) on. */
+	struct wlr_output *output = toplevel_output(toplevel);
+	return titlebar_set(&server->title_cache, &server->dirty_titlebars, &toplevel->titlebar,
+			toplevel->xdg_toplevel->title, toplevel->geom.width, toplevel->focused,
+			output != NULL ? output->scale : 1.0f) &&
+		toplevel->titlebar.dirty_link.prev == &server->dirty_titlebars;
+}
+
+static void toplevel_update_title(struct Client *toplevel)
+{
+	/* Nothing is rendered here; the first dirty title bar asks every output
+	 * for a frame, and output_frame renders them all at once. */
+	if (toplevel_refresh_title(toplevel))
+	{
+		server_schedule_frames(toplevel->server);
+	}
+}
+
+static void toplevel_set_focused(struct Client *toplevel, bool focused)
+{
+	/* Only the border rects and title bar are damaged; client content is not
+	 * re-rendered. */
+	const float *color = focused ? focus_color : border_color;
+	for (size_t i = 0; i < 4; i++)
+	{
+		wlr_scene_rect_set_color(toplevel->border[i], color);
+	}
+
+	toplevel->focused = focused;
+	toplevel_update_title(toplevel);
+}
+
+static void toplevel_update_borders(struct Client *toplevel)
+{
+	/* Called on every commit, but the rects are only touched when the
+	 * window geometry actually changed. */
+	struct wlr_box geo;
+	wlr_xdg_surface_get_geometry(toplevel->xdg_toplevel->base, &geo);
+	if (wlr_box_equal(&geo, &toplevel->geom))
+	{
+		return;
+	}
+	toplevel->geom = geo;
+	hidden_frames_invalidate(toplevel->server);
+
+	/* The title bar, if any, sits between the top border and the surface. */
+	int bw = toplevel->bw;
+	int th = toplevel->title_height;
+	int width = geo.width + 2 * bw;
+	int height = geo.height + 2 * bw + th;
+
+	wlr_scene_node_set_position(&toplevel->scene_surface->node, bw - geo.x, bw + th - geo.y);
+	wlr_scene_rect_set_size(toplevel->border[0], width, bw);
+	wlr_scene_rect_set_size(toplevel->border[1], width, bw);
+	wlr_scene_node_set_position(&toplevel->border[1]->node, 0, height - bw);
+	wlr_scene_rect_set_size(toplevel->border[2], bw, geo.height + th);
+	wlr_scene_node_set_position(&toplevel->border[2]->node, 0, bw);
+	wlr_scene_rect_set_size(toplevel->border[3], bw, geo.height + th);
+	wlr_scene_node_set_position(&toplevel->border[3]->node, width - bw, bw);
+
+	if (th > 0)
+	{
+		wlr_scene_node_set_position(&toplevel->titlebar.scene->node, bw, bw);
+		toplevel_update_title(toplevel);
+	}
+}
+
+static uint32_t client_window_types(struct Client *client)
+{
+	/* An X11 window may list several _NET_WM_WINDOW_TYPEs. */
+	uint32_t types = 0;
+	if (client->kind != X11)
+	{
+		return 0;
+	}
+
+	struct wlr_xwayland_surface *xsurface = client->surface.xwayland;
+	for (size_t i = 0; i < xsurface->window_type_len; i++)
+	{
+		for (int type = 0; type < NetLast; type++)
+		{
+			if (xsurface->window_type[i] == client->server->netatom[type])
+			{
+				types |= 1u << type;
+			}
+		}
+	}
+	return types;
+}
+
+static void set_buffer_opacity(struct wlr_scene_buffer *buffer, int sx, int sy, void *data)
+{
+	wlr_scene_buffer_set_opacity(buffer, *(float *)data);
+}
+
+static void client_apply_opacity(struct Client *client)
+{
+	/* Only the client's own buffers; borders and the title bar stay opaque. */
+	float opacity = client->rules.set & RULE_OPACITY ? client->rules.opacity : 1.0f;
+	if (client->scene_surface != NULL)
+	{
+		wlr_scene_node_for_each_buffer(&client->scene_surface->node, set_buffer_opacity,
+			&opacity);
+	}
+}
+
+static void client_update_rules(struct Client *client)
+{
+	/* Cheap unless the app_id, title or window type changed since the last
+	 * call; only then are the matchers run again. */
+	struct Server *server = client->server;
+	const char *app_id, *title;
+
+	if (client->kind == X11)
+	{
+		app_id = client->surface.xwayland->class;
+		title = client->surface.xwayland->title;
+	} else
+	{
+		app_id = client->xdg_toplevel->app_id;
+		title = client->xdg_toplevel->title;
+	}
+
+	if (!rules_evaluate(&server->rules, &client->rule_cache, &client->rules, app_id, title,
+			client_window_types(client)))
+	{
+		return;
+	}
+
+	uint64_t interval = client->rules.throttle_fps > 0 ?
+		1000000000ull / client->rules.throttle_fps : 0;
+	if ((interval > 0) != (client->frame_interval_ns > 0))
+	{
+		server->throttled += interval > 0 ? 1 : -1;
+	}
+	client->frame_interval_ns = interval;
+
+	client_apply_opacity(client);
+	hidden_frames_invalidate(server);
+}
+
+static void client_place(struct Client *client)
+{
+	/* The output only applies before the first map; moving a window the
+	 * user can already see is not the rules' job. */
+	struct Server *server = client->server;
+	struct RuleResult *rules = &client->rules;
+
+	client->placed = true;
+	if ((rules->set & RULE_OUTPUT) && client->scene_tree != NULL)
+	{
+		struct Output *output;
+		wl_list_for_each(output, &server->outputs, link)
+		{
+			if (strcmp(output->wlr_output->name, rules->output) == 0)
+			{
+				struct wlr_box box;
+				wlr_output_layout_get_box(server->output_layout, output->wlr_output, &box);
+				wlr_scene_node_set_position(&client->scene_tree->node, box.x, box.y);
+				return;
+			}
+		}
+		wlr_log(WLR_ERROR, "Rule output %s is not connected", rules->output);
+	}
+}
+
+static void client_mark_dirty(struct Client *client, uint32_t what)
+{
+	/* Title and app_id changes are only noted here. Whoever cares hears
+	 * about them once, with the latest value, at the start of the next
+	 * frame; anything the client sent in between is dropped. */
+	struct Server *server = client->server;
+
+	atomic_fetch_add_explicit(&client->metrics.property_changes, 1, memory_order_relaxed);
+	if (client->dirty & what)
+	{
+		atomic_fetch_add_explicit(&client->metrics.property_suppressed, 1,
+			memory_order_relaxed);
+		return;
+	}
+	if (client->dirty == 0)
+	{
+		bool first = wl_list_empty(&server->dirty_clients);
+		wl_list_insert(server->dirty_clients.prev, &client->dirty_link);
+		if (first)
+		{
+			server_schedule_frames(server);
+		}
+	}
+	client->dirty |= what;
+}
+
+static void clients_flush(struct Server *server)
+{
+	/* Runs before titlebar_flush, so retitled bars render in this frame. */
+	struct Client *client, *tmp;
+	wl_list_for_each_safe(client, tmp, &server->dirty_clients, dirty_link)
+	{
+		uint32_t dirty = client->dirty;
+		client->dirty = 0;
+		wl_list_remove(&client->dirty_link);
+		wl_list_init(&client->dirty_link);
+
+		if (client->kind != X11)
+		{
+			if (dirty & CLIENT_DIRTY_APP_ID)
+			{
+				const char *app_id = client->xdg_toplevel->app_id;
+				snprintf(client->metrics.app_id, sizeof(client->metrics.app_id), "%s",
+					app_id ? app_id : "");
+				foreign_toplevel_update(&server->foreign, &client->foreign, FOREIGN_APP_ID);
+			}
+			if (dirty & CLIENT_DIRTY_TITLE)
+			{
+				toplevel_refresh_title(client);
+				foreign_toplevel_update(&server->foreign, &client->foreign, FOREIGN_TITLE);
+			}
+		}
+		client_update_rules(client);
+	}
+}
+
+static struct wlr_output *toplevel_output(struct Client *toplevel)
+{
+	/* The output under the centre of the window. */
+	struct wlr_scene_node *node = &toplevel->scene_tree->node;
+	return wlr_output_layout_output_at(toplevel->server->output_layout,
+		node->x + (toplevel->geom.width + 2 * toplevel->bw) / 2.0,
+		node->y + (toplevel->geom.height + 2 * toplevel->bw + toplevel->title_height) / 2.0);
+}
+
+static void focus_toplevel(struct Client *toplevel, struct wlr_surface *surface) 
 {
 	/* Note: this function only deals with keyboard focus. */
 	if (toplevel == NULL) 
@@ -33,15 +324,22 @@ static void focus_toplevel(struct Toplevel *toplevel, struct wlr_surface *surfac
 		if (prev_toplevel != NULL) {
 			wlr_xdg_toplevel_set_activated(prev_toplevel, false);
 		}
+		struct Client *prev = toplevel_from_surface(prev_surface);
+		if (prev != NULL && prev != toplevel) {
+			toplevel_set_focused(prev, false);
+			foreign_toplevel_set_activated(&server->foreign, &prev->foreign, false);
+		}
 	}
 
 	struct wlr_keyboard *keyboard = wlr_seat_get_keyboard(seat);
 	/* Move the toplevel to the front */
 	wlr_scene_node_raise_to_top(&toplevel->scene_tree->node);
-	wl_list_remove(&toplevel->link);
-	wl_list_insert(&server->toplevels, &toplevel->link);
+	hidden_frames_invalidate(server);
+	mru_touch(&server->toplevels, &toplevel->mru);
 	/* Activate the new surface */
 	wlr_xdg_toplevel_set_activated(toplevel->xdg_toplevel, true);
+	toplevel_set_focused(toplevel, true);
+	foreign_toplevel_set_activated(&server->foreign, &toplevel->foreign, true);
 	/*
 	 * Tell the seat to have the keyboard enter this surface. wlroots will keep
 	 * track of this and automatically send key events to the appropriate
@@ -54,21 +352,433 @@ static void focus_toplevel(struct Toplevel *toplevel, struct wlr_surface *surfac
 	}
 }
 
+static bool toplevel_in_view(struct MruEntry *entry, void *data)
+{
+	struct Client *toplevel = wl_container_of(entry, toplevel, mru);
+	struct MruView *view = data;
+
+	if (view->output != NULL)
+	{
+		struct wlr_box box = {
+			.x = toplevel->scene_tree->node.x,
+			.y = toplevel->scene_tree->node.y,
+			.width = toplevel->geom.width + 2 * toplevel->bw,
+			.height = toplevel->geom.height + 2 * toplevel->bw + toplevel->title_height,
+		};
+		return wlr_output_layout_intersects(view->server->output_layout, view->output, &box);
+	}
+	return true;
+}
+
+static void cycle_toplevel(struct Server *server, int direction)
+{
+	/*
+	 * Alt-tab: step through the toplevels on the output under the cursor in
+	 * MRU order, only highlighting the candidate. Nothing is raised, focused
+	 * or reordered until Alt is released (see keyboard_handle_modifiers), so
+	 * the stack keeps its order while the user is still choosing.
+	 */
+	struct MruView view = {
+		.server = server,
+		.output = wlr_output_layout_output_at(server->output_layout,
+			server->cursor->x, server->cursor->y),
+	};
+	struct MruEntry *from = server->cycle != NULL ?
+		&server->cycle->mru : mru_front(&server->toplevels);
+	struct MruEntry *entry = mru_step(&server->toplevels, from, direction,
+		toplevel_in_view, &view);
+	if (entry == NULL)
+	{
+		return;
+	}
+
+	struct Client *next = wl_container_of(entry, next, mru);
+	if (server->cycle != NULL && server->cycle != next)
+	{
+		toplevel_set_focused(server->cycle, false);
+	} else if (server->cycle == NULL && from != NULL && from != entry)
+	{
+		struct Client *focused = wl_container_of(from, focused, mru);
+		toplevel_set_focused(focused, false);
+	}
+	server->cycle = next;
+	toplevel_set_focused(next, true);
+}
+
+static void cycle_commit(struct Server *server)
+{
+	struct Client *toplevel = server->cycle;
+	server->cycle = NULL;
+	focus_toplevel(toplevel, toplevel->xdg_toplevel->base->surface);
+}
+
+static void cycle_cancel(struct Server *server)
+{
+	/* Keyboard focus never left the front window, but it was drawn as
+	 * unfocused while another one was highlighted. */
+	struct Client *toplevel = server->cycle;
+	struct MruEntry *front = mru_front(&server->toplevels);
+	server->cycle = NULL;
+	toplevel_set_focused(toplevel, false);
+	if (front != NULL && front != &toplevel->mru)
+	{
+		struct Client *focused = wl_container_of(front, focused, mru);
+		toplevel_set_focused(focused, true);
+	}
+}
+
+static void tag_input(struct wlr_surface *surface, uint32_t time_msec)
+{
+	/* Start an input-to-present latency measurement for whoever received
+	 * this event. */
+	struct Client *toplevel = toplevel_from_surface(surface);
+	if (toplevel != NULL)
+	{
+		latency_input(&toplevel->metrics.input, time_msec);
+	}
+}
+
+static enum wp_content_type_v1_type client_content_type(struct Client *client)
+{
+	/* A rule overrides what the client says about itself. */
+	if (client->rules.set & RULE_CONTENT)
+	{
+		return client->rules.content;
+	}
+	return wlr_surface_get_content_type_v1(client->server->content_type_mgr,
+		client->xdg_toplevel->base->surface);
+}
+
+static unsigned int client_hidden_fps(struct Client *client)
+{
+	if (client->rules.set & RULE_HIDDEN_FPS)
+	{
+		return client->rules.hidden_fps;
+	}
+	return content_policy(client_content_type(client))->hidden_fps;
+}
+
+static bool client_covers_output(struct Client *client, struct wlr_output *wlr_output)
+{
+	struct wlr_box output_box, box = {
+		.x = client->scene_tree->node.x,
+		.y = client->scene_tree->node.y,
+		.width = client->geom.width + 2 * client->bw,
+		.height = client->geom.height + 2 * client->bw + client->title_height,
+	};
+	wlr_output_layout_get_box(client->server->output_layout, wlr_output, &output_box);
+	return box.x <= output_box.x && box.y <= output_box.y &&
+		box.x + box.width >= output_box.x + output_box.width &&
+		box.y + box.height >= output_box.y + output_box.height;
+}
+
+static enum ContentSchedule output_schedule(struct Output *output, bool *adaptive_sync)
+{
+	/* The focused window decides, while it is on this output. A tearing
+	 * rule still has the last word on tearing. */
+	struct Server *server = output->server;
+	struct MruEntry *front = mru_front(&server->toplevels);
+	struct MruView view = { .server = server, .output = output->wlr_output };
+	*adaptive_sync = false;
+	if (front == NULL || !toplevel_in_view(front, &view))
+	{
+		return CONTENT_SCHEDULE_VSYNC;
+	}
+
+	struct Client *toplevel = wl_container_of(front, toplevel, mru);
+	enum ContentSchedule schedule = content_policy(client_content_type(toplevel))->schedule;
+	if (toplevel->rules.set & RULE_TEARING)
+	{
+		if (toplevel->rules.tearing)
+		{
+			schedule = CONTENT_SCHEDULE_TEARING;
+		} else if (schedule == CONTENT_SCHEDULE_TEARING)
+		{
+			schedule = CONTENT_SCHEDULE_ADAPTIVE;
+		}
+	}
+	*adaptive_sync = schedule != CONTENT_SCHEDULE_VSYNC &&
+		client_covers_output(toplevel, output->wlr_output);
+	return schedule;
+}
+
+static bool output_commit_scheduled(struct Output *output, struct wlr_scene_output *scene_output)
+{
+	/*
+	 * wlr_scene_output_commit, but with an async page flip where the
+	 * backend can do one and the schedule asks for it, and with adaptive
+	 * sync switched in the same commit as the frame that needs it.
+	 */
+	struct wlr_output *wlr_output = scene_output->output;
+	bool adaptive_sync;
+	enum ContentSchedule schedule = output_schedule(output, &adaptive_sync);
+	bool sync_change = adaptive_sync !=
+		(wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED) &&
+		!(adaptive_sync &&
+			(!wlr_output->adaptive_sync_supported || output->adaptive_sync_failed));
+
+	output->schedule = schedule;
+	if (schedule != CONTENT_SCHEDULE_TEARING && !sync_change)
+	{
+		return wlr_scene_output_commit(scene_output, NULL);
+	}
+	if (!sync_change && !wlr_output->needs_frame &&
+		!pixman_region32_not_empty(&scene_output->pending_commit_damage))
+	{
+		return true;
+	}
+
+	struct wlr_output_state state;
+	wlr_output_state_init(&state);
+	bool ok = wlr_scene_output_build_state(scene_output, &state, NULL);
+	if (ok && sync_change)
+	{
+		wlr_output_state_set_adaptive_sync_enabled(&state, adaptive_sync);
+		if (!wlr_output_test_state(wlr_output, &state))
+		{
+			state.committed &= ~WLR_OUTPUT_STATE_ADAPTIVE_SYNC_ENABLED;
+			if (adaptive_sync)
+			{
+				wlr_log(WLR_INFO, "Output %s does not support adaptive sync",
+					wlr_output->name);
+				output->adaptive_sync_failed = true;
+			}
+		}
+	}
+	if (ok && schedule == CONTENT_SCHEDULE_TEARING && (state.committed & WLR_OUTPUT_STATE_BUFFER))
+	{
+		state.tearing_page_flip = true;
+		if (!wlr_output_test_state(wlr_output, &state))
+		{
+			state.tearing_page_flip = false;
+		}
+	}
+	ok = ok && wlr_output_commit_state(wlr_output, &state);
+	wlr_output_state_finish(&state);
+	return ok;
+}
+
+static void buffer_shown(struct wlr_scene_buffer *buffer, int sx, int sy, void *data)
+{
+	if (buffer->primary_output != NULL)
+	{
+		*(bool *)data = true;
+	}
+}
+
+static bool client_hidden(struct Client *client)
+{
+	/* Hidden: disabled, on no output, or entirely covered; the scene
+	 * leaves out buffers of disabled nodes and those it does not draw. */
+	bool shown = false;
+	wlr_scene_node_for_each_buffer(&client->scene_tree->node, buffer_shown, &shown);
+	return !shown;
+}
+
+static void surface_send_frame_done(struct wlr_surface *surface, int sx, int sy, void *data)
+{
+	wlr_surface_send_frame_done(surface, data);
+}
+
+static uint64_t hidden_frames_send(struct Server *server)
+{
+	/* Sends what is due and returns the time until the next one is, or 0
+	 * if no hidden window wants any. */
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	uint64_t now_ns = (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+	uint64_t next_ns = 0;
+
+	struct MruEntry *entry;
+	wl_list_for_each(entry, &server->toplevels.stack, link)
+	{
+		struct Client *client = wl_container_of(entry, client, mru);
+		unsigned int fps = client_hidden_fps(client);
+		if (fps == 0 || !client_hidden(client))
+		{
+			continue;
+		}
+
+		uint64_t interval = 1000000000ull / fps;
+		uint64_t due_ns = interval;
+		if (now_ns - client->frame_done_ns >= interval)
+		{
+			wlr_surface_for_each_surface(client->xdg_toplevel->base->surface,
+				surface_send_frame_done, &now);
+			client->frame_done_ns = now_ns;
+		} else
+		{
+			due_ns = interval - (now_ns - client->frame_done_ns);
+		}
+		if (next_ns == 0 || due_ns < next_ns)
+		{
+			next_ns = due_ns;
+		}
+	}
+	return next_ns;
+}
+
+static int hidden_frames_timer(void *data)
+{
+	/* Keeps going for as long as some hidden window wants callbacks, then
+	 * stops until something changes again. */
+	struct Server *server = data;
+	uint64_t next_ns = hidden_frames_send(server);
+	server->hidden_frames_armed = next_ns > 0;
+	if (next_ns > 0)
+	{
+		wl_event_source_timer_update(server->hidden_frames, (next_ns + 999999) / 1000000);
+	}
+	return 0;
+}
+
+static void hidden_frames_schedule(struct Server *server)
+{
+	/* Windows only go into hiding when something on screen changes, and
+	 * that always draws a frame; the first frame after a change is when to
+	 * look. While armed, the timer looks again on every tick itself. */
+	if (!server->hidden_frames_armed && server->hidden_frames_dirty)
+	{
+		server->hidden_frames_dirty = false;
+		hidden_frames_timer(server);
+	}
+}
+
+struct FrameDone
+{
+	struct wlr_scene_output *scene_output;
+	struct timespec *now;
+	uint64_t now_ns;
+	struct Quotas *quotas;
+	uint64_t next_ns; /* until the first skipped callback is due, or 0 */
+};
+
+static void frame_done_defer(struct FrameDone *done, uint64_t due_ns)
+{
+	if (done->next_ns == 0 || due_ns < done->next_ns)
+	{
+		done->next_ns = due_ns;
+	}
+}
+
+static void send_frame_done_throttled(struct wlr_scene_buffer *buffer, int sx, int sy,
+	void *data)
+{
+	struct FrameDone *done = data;
+	if (buffer->primary_output != done->scene_output)
+	{
+		return;
+	}
+
+	struct wlr_scene_surface *scene_surface = wlr_scene_surface_try_from_buffer(buffer);
+	uint64_t due_ns;
+	if (scene_surface != NULL && !quota_frame_due(done->quotas,
+			wl_resource_get_client(scene_surface->surface->resource), done->now_ns, &due_ns))
+	{
+		frame_done_defer(done, due_ns);
+		return;
+	}
+
+	struct Client *client = scene_surface != NULL ?
+		toplevel_from_surface(scene_surface->surface) : NULL;
+	if (client != NULL && client->frame_interval_ns > 0 &&
+		client->frame_done_ns != done->now_ns)
+	{
+		/* The first surface of a window decides for all of its surfaces
+		 * this frame. */
+		uint64_t elapsed = done->now_ns - client->frame_done_ns;
+		if (elapsed < client->frame_interval_ns)
+		{
+			frame_done_defer(done, client->frame_interval_ns - elapsed);
+			return;
+		}
+		client->frame_done_ns = done->now_ns;
+	}
+	wlr_scene_buffer_send_frame_done(buffer, done->now);
+}
+
 static void output_frame(struct wl_listener *listener, void *data) {
 	/* This function is called every time an output is ready to display a frame,
 	 * generally at the output's refresh rate (e.g. 60Hz). */
 	struct Output *output = wl_container_of(listener, output, frame);
 	struct wlr_scene *scene = output->server->scene;
+	struct Trace *trace = &output->server->trace;
+	uint64_t frame_start = trace_begin(trace);
+
+	clients_flush(output->server);
+	titlebar_flush(&output->server->title_cache, &output->server->dirty_titlebars);
 
 	struct wlr_scene_output *scene_output = wlr_scene_get_scene_output(
 		scene, output->wlr_output);
 
 	/* Render the scene if needed and commit the output */
-	wlr_scene_output_commit(scene_output, NULL);
+	uint64_t start = metrics_now_ns();
+	bool committed = output_commit_scheduled(output, scene_output);
+	trace_span(trace, "wlr_scene_output_commit", "output", TRACE_TID_COMPOSITOR,
+		trace->active ? start : 0);
+	if (!committed)
+	{
+		atomic_fetch_add_explicit(&output->metrics.missed_frames, 1, memory_order_relaxed);
+	} else if (output->wlr_output->commit_seq != output->metrics.commit_seq)
+	{
+		/* Only count frames where something was actually rendered; the scene
+		 * skips the commit entirely when there is no damage. */
+		output->metrics.commit_ns = metrics_now_ns();
+		output->metrics.commit_seq = output->wlr_output->commit_seq;
+		startup_output_commit(&output->server->startup);
+		atomic_fetch_add_explicit(&output->metrics.frames, 1, memory_order_relaxed);
+		histogram_record(&output->metrics.render_time, output->metrics.commit_ns - start);
+		latency_output_commit(&output->server->latency_pending, output->wlr_output);
+	}
 
 	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC, &now);
-	wlr_scene_output_send_frame_done(scene_output, &now);
+	uint64_t frame_done_start = trace_begin(trace);
+	if (output->server->throttled == 0 && output->server->quotas.throttled == 0)
+	{
+		wlr_scene_output_send_frame_done(scene_output, &now);
+	} else
+	{
+		struct FrameDone done = {
+			.scene_output = scene_output,
+			.now = &now,
+			.now_ns = (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec,
+			.quotas = &output->server->quotas,
+		};
+		wlr_scene_output_for_each_buffer(scene_output, send_frame_done_throttled, &done);
+		if (done.next_ns > 0)
+		{
+			/* On a static screen nothing else would draw a frame, and a
+			 * client waiting for its callback would wait forever. */
+			wl_event_source_timer_update(output->throttle_timer,
+				(done.next_ns + 999999) / 1000000);
+		}
+	}
+	hidden_frames_schedule(output->server);
+	trace_span(trace, "frame_done", "output", TRACE_TID_COMPOSITOR, frame_done_start);
+
+	trace_span(trace, "output_frame", "output", TRACE_TID_COMPOSITOR, frame_start);
+}
+PROFILE_LISTENER(output_frame)
+
+static int output_throttle_timer(void *data)
+{
+	/* A frame without damage renders nothing, but still sends the frame
+	 * callbacks that fell due. */
+	struct Output *output = data;
+	if (output->wlr_output->enabled)
+	{
+		wlr_output_schedule_frame(output->wlr_output);
+	}
+	return 0;
+}
+
+static void output_present(struct wl_listener *listener, void *data) {
+	/* Called once the last commit has actually reached the screen (or failed to). */
+	struct Output *output = wl_container_of(listener, output, present);
+	trace_instant(&output->server->trace, "present", "output", TRACE_TID_COMPOSITOR);
+	metrics_output_present(&output->metrics, data);
+	latency_output_present(&output->server->latency_pending, data);
 }
 
 static void output_request_state(struct wl_listener *listener, void *data) {
@@ -78,6 +788,7 @@ static void output_request_state(struct wl_listener *listener, void *data) {
 	struct Output *output = wl_container_of(listener, output, request_state);
 	const struct wlr_output_event_request_state *event = data;
 	wlr_output_commit_state(output->wlr_output, event->state);
+	hidden_frames_invalidate(output->server);
 }
 
 static void output_destroy(struct wl_listener *listener, void *data) {
@@ -85,12 +796,131 @@ static void output_destroy(struct wl_listener *listener, void *data) {
 	struct Output *output = wl_container_of(listener, output, destroy);
 
 	wl_list_remove(&output->frame.link);
+	wl_list_remove(&output->present.link);
 	wl_list_remove(&output->request_state.link);
 	wl_list_remove(&output->destroy.link);
 	wl_list_remove(&output->link);
+	wl_event_source_remove(output->throttle_timer);
+	for (int layer = 0; layer < 4; layer++)
+	{
+		struct LayerSurface *lsrf, *tmp;
+		wl_list_for_each_safe(lsrf, tmp, &output->server->layers[layer], link)
+		{
+			if (lsrf->layer_surface->output == output->wlr_output)
+			{
+				lsrf->layer_surface->output = NULL;
+				wlr_layer_surface_v1_destroy(lsrf->layer_surface);
+			}
+		}
+	}
+	/* Windows that were on this output may now be over another one; the
+	 * layout would only drop it after this handler. */
+	wlr_output_layout_remove(output->server->output_layout, output->wlr_output);
+	foreign_toplevels_output_destroyed(&output->server->foreign, output->wlr_output);
+	struct MruEntry *entry;
+	wl_list_for_each(entry, &output->server->toplevels.stack, link)
+	{
+		struct Client *toplevel = wl_container_of(entry, toplevel, mru);
+		foreign_toplevel_set_output(&output->server->foreign, &toplevel->foreign,
+			toplevel_output(toplevel));
+	}
+	metrics_output_finish(&output->metrics);
+	latency_output_destroy(&output->server->latency_pending, output->wlr_output);
+	hidden_frames_invalidate(output->server);
 	free(output);
 }
 
+static void output_config_state(struct Server *server, struct wlr_output *wlr_output,
+	struct wlr_output_state *state)
+{
+	/*
+	 * The configured scale and mode, or scale 1 and the preferred mode. The
+	 * scale is rounded to the 1/120 steps wp_fractional_scale_v1 can
+	 * express, so clients can render buffers of exactly the output's
+	 * physical size.
+	 */
+	const struct ConfigOutput *config = config_output(&server->config, wlr_output->name);
+	float scale = config != NULL && config->scale > 0.0f ? config->scale : 1.0f;
+	wlr_output_state_set_scale(state, roundf(scale * 120.0f) / 120.0f);
+
+	struct wlr_output_mode *mode = NULL;
+	if (config != NULL && config->width > 0)
+	{
+		struct wlr_output_mode *candidate;
+		wl_list_for_each(candidate, &wlr_output->modes, link)
+		{
+			if (candidate->width != config->width || candidate->height != config->height)
+			{
+				continue;
+			}
+			/* Without a refresh rate, the fastest; with one, the closest. */
+			if (mode == NULL || (config->refresh_mhz == 0 ?
+					candidate->refresh > mode->refresh :
+					abs(candidate->refresh - config->refresh_mhz) <
+						abs(mode->refresh - config->refresh_mhz)))
+			{
+				mode = candidate;
+			}
+		}
+		if (mode == NULL)
+		{
+			wlr_log(WLR_ERROR, "Output %s has no %dx%d mode", wlr_output->name,
+				config->width, config->height);
+		}
+	}
+	if (mode == NULL)
+	{
+		mode = wlr_output_preferred_mode(wlr_output);
+	}
+	if (mode != NULL)
+	{
+		wlr_log(WLR_INFO, "Output %s mode %dx%d@%.3f scale %.3f", wlr_output->name,
+			mode->width, mode->height, mode->refresh / 1000.0, state->scale);
+		wlr_output_state_set_mode(state, mode);
+	} else {
+		wlr_log(WLR_INFO, "This output does not have a particular mode.");
+	}
+}
+
+static void server_set_idle(void *data, bool idle)
+{
+	/* A disabled output gets no frame events, so the scene stops rendering
+	 * and clients stop getting frame callbacks; hidden windows too, as
+	 * their timer only starts again from the first frame after waking.
+	 * Waking reapplies the configured mode, as the backend may have
+	 * dropped it. */
+	struct Server *server = data;
+	struct Output *output;
+
+	if (idle)
+	{
+		wl_event_source_timer_update(server->hidden_frames, 0);
+		server->hidden_frames_armed = false;
+	}
+
+	wl_list_for_each(output, &server->outputs, link)
+	{
+		struct wlr_output_state state;
+		wlr_output_state_init(&state);
+		wlr_output_state_set_enabled(&state, !idle);
+		if (!idle)
+		{
+			output_config_state(server, output->wlr_output, &state);
+		}
+		if (!wlr_output_commit_state(output->wlr_output, &state))
+		{
+			wlr_log(WLR_ERROR, "Output %s failed to turn %s", output->wlr_output->name,
+				idle ? "off" : "on");
+		}
+		wlr_output_state_finish(&state);
+		if (!idle)
+		{
+			wlr_output_schedule_frame(output->wlr_output);
+		}
+	}
+	hidden_frames_invalidate(server);
+}
+
 static void server_new_output(struct wl_listener *listener, void *data)
 {
 	struct Server *server = wl_container_of(listener, server, new_output);
@@ -103,31 +933,40 @@ static void server_new_output(struct wl_listener *listener, void *data)
 	wlr_output_state_init(&state);
 	wlr_output_state_set_enabled(&state, true);
 
-	struct wlr_output_mode *mode = wlr_output_preferred_mode(wlr_output);
-	if (mode != NULL)
-	{
-		wlr_log(WLR_INFO, "Output mode: %s", (char *)mode);
-		wlr_output_state_set_mode(&state, mode);
-	} else {
-		wlr_log(WLR_INFO, "This output does not have a particular mode.");
-	}
+	/* Layout, cursor and window positions are all in logical coordinates;
+	 * the scale only matters for how big buffers are. */
+	output_config_state(server, wlr_output, &state);
 
 	wlr_output_commit_state(wlr_output, &state);
 	wlr_output_state_finish(&state);
 
+	/* The cursor theme must be loaded before the cursor shows up here, and
+	 * at this output's scale, so the first motion onto it doesn't stall. */
+	startup_preload_wait(&server->startup);
+	if (!wlr_xcursor_manager_load(server->cursor_mgr, wlr_output->scale))
+	{
+		wlr_log(WLR_ERROR, "Failed to load cursor theme at scale %.2f", wlr_output->scale);
+	}
+
 	struct Output *output = calloc(1, sizeof(*output));
 	output->wlr_output = wlr_output;
 	output->server = server;
 	
 	wlr_log(WLR_INFO, "Setting up event triggers for output");
-	output->frame.notify = output_frame;
+	output->frame.notify = PROFILED(output_frame);
 	wl_signal_add(&wlr_output->events.frame, &output->frame);
 
+	output->present.notify = output_present;
+	wl_signal_add(&wlr_output->events.present, &output->present);
+	metrics_output_init(&server->metrics, &output->metrics, wlr_output->name);
+
 	output->request_state.notify = output_request_state;
 	wl_signal_add(&wlr_output->events.request_state, &output->request_state);
 
 	output->destroy.notify = output_destroy;
 	wl_signal_add(&wlr_output->events.destroy, &output->destroy);
+	output->throttle_timer = wl_event_loop_add_timer(
+		wl_display_get_event_loop(server->display), output_throttle_timer, output);
 
 	wl_list_insert(&server->outputs, &output->link);
 
@@ -135,17 +974,57 @@ static void server_new_output(struct wl_listener *listener, void *data)
 		wlr_output);
 	struct wlr_scene_output *scene_output = wlr_scene_output_create(server->scene, wlr_output);
 	wlr_scene_output_layout_add_output(server->scene_layout, l_output, scene_output);
+	hidden_frames_invalidate(server);
+}
+
+static void foreign_request_activate(struct wl_listener *listener, void *data)
+{
+	/* A taskbar entry was clicked. */
+	struct Client *toplevel = wl_container_of(listener, toplevel, foreign_activate);
+	focus_toplevel(toplevel, toplevel->xdg_toplevel->base->surface);
+}
+
+static void foreign_request_close(struct wl_listener *listener, void *data)
+{
+	struct Client *toplevel = wl_container_of(listener, toplevel, foreign_close);
+	wlr_xdg_toplevel_send_close(toplevel->xdg_toplevel);
 }
 
 static void xdg_toplevel_map(struct wl_listener *listener, void *data) 
 {
 	/* Called when the surface is mapped, or ready to display on-screen. */
-	struct Toplevel *toplevel = wl_container_of(listener, toplevel, map);
+	struct Client *toplevel = wl_container_of(listener, toplevel, map);
 
-	wl_list_insert(&toplevel->server->toplevels, &toplevel->link);
+	client_update_rules(toplevel);
+	if (!toplevel->placed)
+	{
+		/* Only a window's first map can be the one a launch waits for. */
+		client_place(toplevel);
+		spawn_mapped(&toplevel->server->spawner, toplevel->metrics.pid);
+	}
+	mru_push(&toplevel->server->toplevels, &toplevel->mru);
+	if (toplevel->bw != toplevel->server->config.border_width)
+	{
+		/* The border width was reloaded while this window was unmapped. */
+		toplevel->bw = toplevel->server->config.border_width;
+		toplevel->geom = (struct wlr_box){0};
+	}
+	toplevel_update_borders(toplevel);
+	wlr_scene_node_set_enabled(&toplevel->scene_tree->node, true);
+	hidden_frames_invalidate(toplevel->server);
+
+	struct Server *server = toplevel->server;
+	foreign_toplevel_create(&server->foreign, &toplevel->foreign, toplevel->xdg_toplevel);
+	toplevel->foreign_activate.notify = foreign_request_activate;
+	wl_signal_add(&toplevel->foreign.handle->events.request_activate,
+		&toplevel->foreign_activate);
+	toplevel->foreign_close.notify = foreign_request_close;
+	wl_signal_add(&toplevel->foreign.handle->events.request_close, &toplevel->foreign_close);
+	foreign_toplevel_set_output(&server->foreign, &toplevel->foreign, toplevel_output(toplevel));
 
 	focus_toplevel(toplevel, toplevel->xdg_toplevel->base->surface);
 }
+PROFILE_LISTENER(xdg_toplevel_map)
 
 static void reset_cursor_mode(struct Server *server) 
 {
@@ -157,20 +1036,31 @@ static void reset_cursor_mode(struct Server *server)
 static void xdg_toplevel_unmap(struct wl_listener *listener, void *data) 
 {
 	/* Called when the surface is unmapped, and should no longer be shown. */
-	struct Toplevel *toplevel = wl_container_of(listener, toplevel, unmap);
+	struct Client *toplevel = wl_container_of(listener, toplevel, unmap);
 
 	/* Reset the cursor mode if the grabbed toplevel was unmapped. */
 	if (toplevel == toplevel->server->grabbed_toplevel) {
 		reset_cursor_mode(toplevel->server);
 	}
 
-	wl_list_remove(&toplevel->link);
+	if (toplevel == toplevel->server->cycle) {
+		cycle_cancel(toplevel->server);
+	}
+
+	wlr_scene_node_set_enabled(&toplevel->scene_tree->node, false);
+	hidden_frames_invalidate(toplevel->server);
+	mru_remove(&toplevel->server->toplevels, &toplevel->mru);
+
+	wl_list_remove(&toplevel->foreign_activate.link);
+	wl_list_remove(&toplevel->foreign_close.link);
+	foreign_toplevel_destroy(&toplevel->server->foreign, &toplevel->foreign);
+	toplevel->foreign.activated = false;
 }
 
 static void xdg_toplevel_destroy(struct wl_listener *listener, void *data) 
 {
 	/* Called when the xdg_toplevel is destroyed. */
-	struct Toplevel *toplevel = wl_container_of(listener, toplevel, destroy);
+	struct Client *toplevel = wl_container_of(listener, toplevel, destroy);
 
 	wl_list_remove(&toplevel->map.link);
 	wl_list_remove(&toplevel->unmap.link);
@@ -180,15 +1070,35 @@ static void xdg_toplevel_destroy(struct wl_listener *listener, void *data)
 	wl_list_remove(&toplevel->request_resize.link);
 	wl_list_remove(&toplevel->request_maximize.link);
 	wl_list_remove(&toplevel->request_fullscreen.link);
+	wl_list_remove(&toplevel->set_app_id.link);
+	wl_list_remove(&toplevel->set_title.link);
+	wl_list_remove(&toplevel->configure.link);
+	wl_list_remove(&toplevel->ack_configure.link);
+	if (toplevel->decoration != NULL)
+	{
+		wl_list_remove(&toplevel->set_decoration_mode.link);
+		wl_list_remove(&toplevel->destroy_decoration.link);
+	}
+	metrics_client_finish(&toplevel->metrics);
+	wl_list_remove(&toplevel->dirty_link);
+	if (toplevel->frame_interval_ns > 0)
+	{
+		toplevel->server->throttled--;
+	}
+	if (toplevel->title_height > 0)
+	{
+		titlebar_finish(&toplevel->titlebar);
+	}
 
-	free(toplevel);
+	wlr_scene_node_destroy(&toplevel->scene_tree->node);
+	pool_free(&toplevel->server->client_pool, toplevel);
 }
 
 static void xdg_toplevel_request_fullscreen(
 		struct wl_listener *listener, void *data) 
 {
 	/* Just as with request_maximize, we must send a configure here. */
-	struct Toplevel *toplevel =
+	struct Client *toplevel =
 		wl_container_of(listener, toplevel, request_fullscreen);
 	if (toplevel->xdg_toplevel->base->initialized) {
 		wlr_xdg_surface_schedule_configure(toplevel->xdg_toplevel->base);
@@ -205,7 +1115,7 @@ static void xdg_toplevel_request_maximize(
 	 * wlr_xdg_surface_schedule_configure() is used to send an empty reply.
 	 * However, if the request was sent before an initial commit, we don't do
 	 * anything and let the client finish the initial surface setup. */
-	struct Toplevel *toplevel =
+	struct Client *toplevel =
 		wl_container_of(listener, toplevel, request_maximize);
 	if (toplevel->xdg_toplevel->base->initialized) {
 		wlr_xdg_surface_schedule_configure(toplevel->xdg_toplevel->base);
@@ -219,6 +1129,7 @@ static void keyboard_handle_modifiers(
 	 * pressed. We simply communicate this to the client. */
 	struct Keyboard *keyboard =
 		wl_container_of(listener, keyboard, modifiers);
+	record_modifiers(&keyboard->server->recorder, &keyboard->wlr_keyboard->modifiers);
 	/*
 	 * A seat can only have one keyboard, but this is a limitation of the
 	 * Wayland protocol - not wlroots. We assign all connected keyboards to the
@@ -229,12 +1140,40 @@ static void keyboard_handle_modifiers(
 	/* Send modifiers to the client. */
 	wlr_seat_keyboard_notify_modifiers(keyboard->server->seat,
 		&keyboard->wlr_keyboard->modifiers);
+
+	/* Releasing Alt ends an alt-tab cycle on the window it stopped at. */
+	if (keyboard->server->cycle != NULL &&
+		!(wlr_keyboard_get_modifiers(keyboard->wlr_keyboard) & WLR_MODIFIER_ALT))
+	{
+		cycle_commit(keyboard->server);
+	}
+}
+PROFILE_LISTENER(keyboard_handle_modifiers)
+
+static bool surface_committed_single_pixel(struct wlr_surface *surface)
+{
+	/* surface->current.buffer is let go of once it is uploaded, before the
+	 * commit signal; the client buffer keeps its size. */
+	return (surface->current.committed & WLR_SURFACE_STATE_BUFFER) &&
+		surface->buffer != NULL && surface->buffer->base.width == 1 &&
+		surface->buffer->base.height == 1;
 }
 
 static void xdg_toplevel_commit(struct wl_listener *listener, void *data) 
 {
 	/* Called when a new surface state is committed. */
-	struct Toplevel *toplevel = wl_container_of(listener, toplevel, commit);
+	struct Client *toplevel = wl_container_of(listener, toplevel, commit);
+
+	metrics_client_commit(&toplevel->metrics, toplevel->xdg_toplevel->base->surface);
+	latency_commit(&toplevel->server->latency_pending, &toplevel->metrics.input,
+		toplevel->xdg_toplevel->base->surface);
+	trace_instant(&toplevel->server->trace, "commit", "client", toplevel->metrics.id);
+
+	struct wlr_surface *surface = toplevel->xdg_toplevel->base->surface;
+	if (surface_committed_single_pixel(surface))
+	{
+		metrics_solid_buffer(&toplevel->server->metrics, surface);
+	}
 
 	if (toplevel->xdg_toplevel->base->initial_commit) {
 		/* When an xdg_surface performs an initial commit, the compositor must
@@ -242,9 +1181,107 @@ static void xdg_toplevel_commit(struct wl_listener *listener, void *data)
 		 * configures the xdg_toplevel with 0,0 size to let the client pick the
 		 * dimensions itself. */
 		wlr_xdg_toplevel_set_size(toplevel->xdg_toplevel, 0, 0);
+		/* Clients set their app_id before the initial commit, so rules are
+		 * known before the first configure goes out. */
+		client_update_rules(toplevel);
+		if (toplevel->decoration != NULL)
+		{
+			wlr_xdg_toplevel_decoration_v1_set_mode(toplevel->decoration,
+				WLR_XDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE);
+		}
+		return;
+	}
+
+	toplevel_update_borders(toplevel);
+	if (toplevel->rules.set & RULE_OPACITY)
+	{
+		/* Subsurfaces may have appeared. */
+		client_apply_opacity(toplevel);
+	}
+
+	enum wp_content_type_v1_type content_type = client_content_type(toplevel);
+	if (content_type != toplevel->content_type)
+	{
+		toplevel->content_type = content_type;
+		hidden_frames_invalidate(toplevel->server);
+	}
+}
+PROFILE_LISTENER(xdg_toplevel_commit)
+
+static void xdg_toplevel_set_app_id(struct wl_listener *listener, void *data)
+{
+	struct Client *toplevel = wl_container_of(listener, toplevel, set_app_id);
+	client_mark_dirty(toplevel, CLIENT_DIRTY_APP_ID);
+}
+
+static void xdg_toplevel_set_title(struct wl_listener *listener, void *data)
+{
+	struct Client *toplevel = wl_container_of(listener, toplevel, set_title);
+	client_mark_dirty(toplevel, CLIENT_DIRTY_TITLE);
+}
+
+static void xdg_toplevel_configure(struct wl_listener *listener, void *data)
+{
+	/* Called whenever a configure is actually sent to the client; remember when,
+	 * so that the matching ack_configure tells us the round-trip time. */
+	struct Client *toplevel = wl_container_of(listener, toplevel, configure);
+	struct wlr_xdg_surface_configure *configure = data;
+	metrics_client_configure(&toplevel->metrics, configure->serial);
+	trace_async(&toplevel->server->trace, 'b', "configure", "client",
+		toplevel->metrics.id, configure->serial);
+}
+
+static void xdg_toplevel_ack_configure(struct wl_listener *listener, void *data)
+{
+	struct Client *toplevel = wl_container_of(listener, toplevel, ack_configure);
+	struct wlr_xdg_surface_configure *configure = data;
+	metrics_client_ack_configure(&toplevel->metrics, configure->serial);
+	trace_async(&toplevel->server->trace, 'e', "configure", "client",
+		toplevel->metrics.id, configure->serial);
+}
+
+static void xdg_decoration_request_mode(struct wl_listener *listener, void *data)
+{
+	/* Whatever the client asks for, we answer with server-side decorations:
+	 * our borders are scene rects, while client-side decorations have every
+	 * client render and upload its own title bar and shadows. The mode can
+	 * only be sent once the surface is initialized; until then the initial
+	 * commit takes care of it. */
+	struct Client *toplevel = wl_container_of(listener, toplevel, set_decoration_mode);
+	if (toplevel->xdg_toplevel->base->initialized)
+	{
+		wlr_xdg_toplevel_decoration_v1_set_mode(toplevel->decoration,
+			WLR_XDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE);
 	}
 }
 
+static void xdg_decoration_destroy(struct wl_listener *listener, void *data)
+{
+	struct Client *toplevel = wl_container_of(listener, toplevel, destroy_decoration);
+
+	wl_list_remove(&toplevel->set_decoration_mode.link);
+	wl_list_remove(&toplevel->destroy_decoration.link);
+	toplevel->decoration = NULL;
+}
+
+static void server_new_decoration(struct wl_listener *listener, void *data)
+{
+	struct wlr_xdg_toplevel_decoration_v1 *decoration = data;
+	struct Client *toplevel = toplevel_from_surface(decoration->toplevel->base->surface);
+	if (toplevel == NULL)
+	{
+		return;
+	}
+
+	toplevel->decoration = decoration;
+	toplevel->set_decoration_mode.notify = xdg_decoration_request_mode;
+	wl_signal_add(&decoration->events.request_mode, &toplevel->set_decoration_mode);
+	toplevel->destroy_decoration.notify = xdg_decoration_destroy;
+	wl_signal_add(&decoration->events.destroy, &toplevel->destroy_decoration);
+
+	xdg_decoration_request_mode(&toplevel->set_decoration_mode, decoration);
+}
+
 static void xdg_popup_destroy(struct wl_listener *listener, void *data) 
 {
 	/* Called when the xdg_popup is destroyed. */
@@ -253,10 +1290,10 @@ static void xdg_popup_destroy(struct wl_listener *listener, void *data)
 	wl_list_remove(&popup->commit.link);
 	wl_list_remove(&popup->destroy.link);
 
-	free(popup);
+	pool_free(&popup->server->popup_pool, popup);
 }
 
-static void begin_interactive(struct Toplevel *toplevel, enum CursorMode mode, uint32_t edges)
+static void begin_interactive(struct Client *toplevel, enum CursorMode mode, uint32_t edges)
 {
 	struct Server *server = toplevel->server;
 	struct wlr_surface *focused_surface = 
@@ -277,20 +1314,19 @@ static void begin_interactive(struct Toplevel *toplevel, enum CursorMode mode, u
 		server->grab_y = server->cursor->y - toplevel->scene_tree->node.y;
 	} else
 	{
-		struct wlr_box geo_box;
-		wlr_xdg_surface_get_geometry(toplevel->xdg_toplevel->base, &geo_box);
-
-		double border_x = (toplevel->scene_tree->node.x + geo_box.x) +
-			((edges & WLR_EDGE_RIGHT) ? geo_box.width : 0);
-		double border_y = (toplevel->scene_tree->node.y + geo_box.y) +
-			((edges & WLR_EDGE_BOTTOM) ? geo_box.height : 0);
+		/* The window geometry starts one border width into the scene tree. */
+		wlr_xdg_surface_get_geometry(toplevel->xdg_toplevel->base, &server->grab_geobox);
+		server->grab_geobox.x = toplevel->scene_tree->node.x + toplevel->bw;
+		server->grab_geobox.y = toplevel->scene_tree->node.y + toplevel->bw +
+			toplevel->title_height;
+
+		double border_x = server->grab_geobox.x +
+			((edges & WLR_EDGE_RIGHT) ? server->grab_geobox.width : 0);
+		double border_y = server->grab_geobox.y +
+			((edges & WLR_EDGE_BOTTOM) ? server->grab_geobox.height : 0);
 		server->grab_x = server->cursor->x - border_x;
 		server->grab_y = server->cursor->y - border_y;
 
-		server->grab_geobox = geo_box;
-		server->grab_geobox.x += toplevel->scene_tree->node.x;
-		server->grab_geobox.y += toplevel->scene_tree->node.y;
-
 		server->resize_edges = edges;
 	}
 }
@@ -303,7 +1339,7 @@ static void xdg_toplevel_request_move(
 	 * decorations. Note that a more sophisticated compositor should check the
 	 * provided serial against a list of button press serials sent to this
 	 * client, to prevent the client from requesting this whenever they want. */
-	struct Toplevel *toplevel = wl_container_of(listener, toplevel, request_move);
+	struct Client *toplevel = wl_container_of(listener, toplevel, request_move);
 	begin_interactive(toplevel, SCOWL_CURSOR_MOVE, 0);
 }
 
@@ -321,6 +1357,7 @@ static void xdg_popup_commit(struct wl_listener *listener, void *data)
 		wlr_xdg_surface_schedule_configure(popup->xdg_popup->base);
 	}
 }
+PROFILE_LISTENER(xdg_popup_commit)
 
 static void xdg_toplevel_request_resize(
 		struct wl_listener *listener, void *data) 
@@ -331,16 +1368,22 @@ static void xdg_toplevel_request_resize(
 	 * provided serial against a list of button press serials sent to this
 	 * client, to prevent the client from requesting this whenever they want. */
 	struct wlr_xdg_toplevel_resize_event *event = data;
-	struct Toplevel *toplevel = wl_container_of(listener, toplevel, request_resize);
+	struct Client *toplevel = wl_container_of(listener, toplevel, request_resize);
 	begin_interactive(toplevel, SCOWL_CURSOR_RESIZE, event->edges);
 }
 
 static void server_new_xdg_popup(struct wl_listener *listener, void *data) 
 {
 	/* This event is raised when a client creates a new popup. */
+	struct Server *server = wl_container_of(listener, server, new_xdg_popup);
 	struct wlr_xdg_popup *xdg_popup = data;
 
-	struct Popup *popup = calloc(1, sizeof(*popup));
+	struct Popup *popup = pool_alloc(&server->popup_pool);
+	if (popup == NULL)
+	{
+		return;
+	}
+	popup->server = server;
 	popup->xdg_popup = xdg_popup;
 
 	/* We must add xdg popups to the scene graph so they get rendered. The
@@ -349,11 +1392,22 @@ static void server_new_xdg_popup(struct wl_listener *listener, void *data)
 	 * we always set the user data field of xdg_surfaces to the corresponding
 	 * scene node. */
 	struct wlr_xdg_surface *parent = wlr_xdg_surface_try_from_wlr_surface(xdg_popup->parent);
-	assert(parent != NULL);
-	struct wlr_scene_tree *parent_tree = parent->data;
+	struct wlr_scene_tree *parent_tree;
+	if (parent != NULL)
+	{
+		parent_tree = parent->data;
+	} else
+	{
+		/* Popups of layer surfaces (panel menus) go above the top layer. */
+		struct wlr_layer_surface_v1 *layer_surface =
+			wlr_layer_surface_v1_try_from_wlr_surface(xdg_popup->parent);
+		assert(layer_surface != NULL);
+		struct LayerSurface *lsrf = layer_surface->data;
+		parent_tree = lsrf->popups;
+	}
 	xdg_popup->base->data = wlr_scene_xdg_surface_create(parent_tree, xdg_popup->base);
 
-	popup->commit.notify = xdg_popup_commit;
+	popup->commit.notify = PROFILED(xdg_popup_commit);
 	wl_signal_add(&xdg_popup->base->surface->events.commit, &popup->commit);
 
 	popup->destroy.notify = xdg_popup_destroy;
@@ -372,6 +1426,19 @@ static void seat_request_set_selection(struct wl_listener *listener, void *data)
 	wlr_seat_set_selection(server->seat, event->source, event->serial);
 }
 
+static void set_cursor_image(struct Server *server, const char *name)
+{
+	/* Setting the same xcursor again still has wlroots look it up and
+	 * re-upload it to every output, so skip that when nothing changed. */
+	if (server->cursor_image != NULL && strcmp(server->cursor_image, name) == 0)
+	{
+		return;
+	}
+
+	wlr_cursor_set_xcursor(server->cursor, server->cursor_mgr, name);
+	server->cursor_image = name;
+}
+
 static void seat_request_cursor(struct wl_listener *listener, void *data) 
 {
 	struct Server *server = wl_container_of(
@@ -389,6 +1456,21 @@ static void seat_request_cursor(struct wl_listener *listener, void *data)
 		 * cursor moves between outputs. */
 		wlr_cursor_set_surface(server->cursor, event->surface,
 				event->hotspot_x, event->hotspot_y);
+		server->cursor_image = NULL;
+	}
+}
+
+static void seat_request_set_shape(struct wl_listener *listener, void *data)
+{
+	/* Raised when a client asks for a named cursor through
+	 * wp_cursor_shape_v1 instead of attaching a buffer of its own. */
+	struct Server *server = wl_container_of(listener, server, request_set_shape);
+	struct wlr_cursor_shape_manager_v1_request_set_shape_event *event = data;
+
+	if (event->device_type == WLR_CURSOR_SHAPE_MANAGER_V1_DEVICE_TYPE_POINTER &&
+		server->seat->pointer_state.focused_client == event->seat_client)
+	{
+		set_cursor_image(server, wlr_cursor_shape_v1_name(event->shape));
 	}
 }
 
@@ -400,9 +1482,13 @@ static void server_cursor_frame(struct wl_listener *listener, void *data)
 	 * same time, in which case a frame event won't be sent in between. */
 	struct Server *server =
 		wl_container_of(listener, server, cursor_frame);
+	uint64_t start = trace_begin(&server->trace);
+	record_frame(&server->recorder);
 	/* Notify the client with pointer focus of the frame event. */
 	wlr_seat_pointer_notify_frame(server->seat);
+	trace_span(&server->trace, "pointer_frame", "input", TRACE_TID_COMPOSITOR, start);
 }
+PROFILE_LISTENER(server_cursor_frame)
 
 static void server_cursor_axis(struct wl_listener *listener, void *data) 
 {
@@ -411,28 +1497,16 @@ static void server_cursor_axis(struct wl_listener *listener, void *data)
 	struct Server *server =
 		wl_container_of(listener, server, cursor_axis);
 	struct wlr_pointer_axis_event *event = data;
+	uint64_t start = trace_begin(&server->trace);
+	record_axis(&server->recorder, event);
+	idle_activity(&server->idle);
 	/* Notify the client with pointer focus of the axis event. */
 	wlr_seat_pointer_notify_axis(server->seat,
 			event->time_msec, event->orientation, event->delta,
 			event->delta_discrete, event->source, event->relative_direction);
+	trace_span(&server->trace, "pointer_axis", "input", TRACE_TID_COMPOSITOR, start);
 }
-
-static void server_cursor_motion(struct wl_listener *listener, void *data) 
-{
-	/* This event is forwarded by the cursor when a pointer emits a _relative_
-	 * pointer motion event (i.e. a delta) */
-	struct Server *server =
-		wl_container_of(listener, server, cursor_motion);
-	struct wlr_pointer_motion_event *event = data;
-	/* The cursor doesn't move unless we tell it to. The cursor automatically
-	 * handles constraining the motion to the output layout, as well as any
-	 * special configuration applied for the specific input device which
-	 * generated the event. You can pass NULL for the device if you want to move
-	 * the cursor around without any input. */
-	wlr_cursor_move(server->cursor, &event->pointer->base,
-			event->delta_x, event->delta_y);
-	//process_cursor_motion(server, event->time_msec);
-}
+PROFILE_LISTENER(server_cursor_axis)
 
 static void process_cursor_resize(struct Server *server, uint32_t time) 
 {
@@ -446,7 +1520,7 @@ static void process_cursor_resize(struct Server *server, uint32_t time)
 	 * compositor, you'd wait for the client to prepare a buffer at the new
 	 * size, then commit any movement that was prepared.
 	 */
-	struct Toplevel *toplevel = server->grabbed_toplevel;
+	struct Client *toplevel = server->grabbed_toplevel;
 	double border_x = server->cursor->x - server->grab_x;
 	double border_y = server->cursor->y - server->grab_y;
 	int new_left = server->grab_geobox.x;
@@ -477,10 +1551,8 @@ static void process_cursor_resize(struct Server *server, uint32_t time)
 		}
 	}
 
-	struct wlr_box geo_box;
-	wlr_xdg_surface_get_geometry(toplevel->xdg_toplevel->base, &geo_box);
 	wlr_scene_node_set_position(&toplevel->scene_tree->node,
-		new_left - geo_box.x, new_top - geo_box.y);
+		new_left - toplevel->bw, new_top - toplevel->bw - toplevel->title_height);
 
 	int new_width = new_right - new_left;
 	int new_height = new_bottom - new_top;
@@ -490,13 +1562,17 @@ static void process_cursor_resize(struct Server *server, uint32_t time)
 static void process_cursor_move(struct Server *server, uint32_t time) 
 {
 	/* Move the grabbed toplevel to the new position. */
-	struct Toplevel *toplevel = server->grabbed_toplevel;
+	struct Client *toplevel = server->grabbed_toplevel;
 	wlr_scene_node_set_position(&toplevel->scene_tree->node,
 		server->cursor->x - server->grab_x,
 		server->cursor->y - server->grab_y);
+	hidden_frames_invalidate(server);
+	foreign_toplevel_set_output(&server->foreign, &toplevel->foreign, toplevel_output(toplevel));
+	/* Dragged onto an output with another scale, the title is redrawn. */
+	toplevel_update_title(toplevel);
 }
 
-static struct Toplevel *desktop_toplevel_at(
+static struct Client *desktop_toplevel_at(
 		struct Server *server, double lx, double ly,
 		struct wlr_surface **surface, double *sx, double *sy) 
 {
@@ -522,31 +1598,40 @@ static struct Toplevel *desktop_toplevel_at(
 	while (tree != NULL && tree->node.data == NULL) {
 		tree = tree->node.parent;
 	}
-	return tree->node.data;
+	return tree != NULL ? tree->node.data : NULL;
 }
 
+static void process_cursor_passthrough(struct Server *server, uint32_t time);
+
 static void process_cursor_motion(struct Server *server, uint32_t time) 
 {
+	uint64_t start = trace_begin(&server->trace);
+
 	/* If the mode is non-passthrough, delegate to those functions. */
 	if (server->cursor_mode == SCOWL_CURSOR_MOVE) {
 		process_cursor_move(server, time);
-		return;
 	} else if (server->cursor_mode == SCOWL_CURSOR_RESIZE) {
 		process_cursor_resize(server, time);
-		return;
+	} else {
+		process_cursor_passthrough(server, time);
 	}
 
+	trace_span(&server->trace, "process_cursor_motion", "input", TRACE_TID_COMPOSITOR, start);
+}
+
+static void process_cursor_passthrough(struct Server *server, uint32_t time)
+{
 	/* Otherwise, find the toplevel under the pointer and send the event along. */
 	double sx, sy;
 	struct wlr_seat *seat = server->seat;
 	struct wlr_surface *surface = NULL;
-	struct Toplevel *toplevel = desktop_toplevel_at(server,
+	struct Client *toplevel = desktop_toplevel_at(server,
 			server->cursor->x, server->cursor->y, &surface, &sx, &sy);
 	if (!toplevel) {
 		/* If there's no toplevel under the cursor, set the cursor image to a
 		 * default. This is what makes the cursor image appear when you move it
 		 * around the screen, not over any toplevels. */
-		wlr_cursor_set_xcursor(server->cursor, server->cursor_mgr, "default");
+		set_cursor_image(server, "default");
 	}
 	if (surface) {
 		/*
@@ -569,6 +1654,38 @@ static void process_cursor_motion(struct Server *server, uint32_t time)
 	}
 }
 
+static void server_cursor_motion(struct wl_listener *listener, void *data) 
+{
+	/* This event is forwarded by the cursor when a pointer emits a _relative_
+	 * pointer motion event (i.e. a delta) */
+	struct Server *server =
+		wl_container_of(listener, server, cursor_motion);
+	struct wlr_pointer_motion_event *event = data;
+	uint64_t start = trace_begin(&server->trace);
+	record_motion(&server->recorder, event);
+	idle_activity(&server->idle);
+	/* A locked pointer only feeds the client's relative pointer; the cursor
+	 * stays where it is, so there is nothing to hit-test. */
+	double dx = event->delta_x, dy = event->delta_y;
+	if (pointer_constraints_motion(&server->constraints, event->time_msec, &dx, &dy,
+			event->unaccel_dx, event->unaccel_dy,
+			server->cursor_mode == SCOWL_CURSOR_PASSTHROUGH))
+	{
+		trace_span(&server->trace, "pointer_motion_locked", "input", TRACE_TID_COMPOSITOR,
+			start);
+		return;
+	}
+	/* The cursor doesn't move unless we tell it to. The cursor automatically
+	 * handles constraining the motion to the output layout, as well as any
+	 * special configuration applied for the specific input device which
+	 * generated the event. You can pass NULL for the device if you want to move
+	 * the cursor around without any input. */
+	wlr_cursor_move(server->cursor, &event->pointer->base, dx, dy);
+	process_cursor_motion(server, event->time_msec);
+	trace_span(&server->trace, "pointer_motion", "input", TRACE_TID_COMPOSITOR, start);
+}
+PROFILE_LISTENER(server_cursor_motion)
+
 static void server_cursor_motion_absolute(
 		struct wl_listener *listener, void *data) 
 {
@@ -581,10 +1698,27 @@ static void server_cursor_motion_absolute(
 	struct Server *server =
 		wl_container_of(listener, server, cursor_motion_absolute);
 	struct wlr_pointer_motion_absolute_event *event = data;
-	wlr_cursor_warp_absolute(server->cursor, &event->pointer->base, event->x,
-		event->y);
+	uint64_t start = trace_begin(&server->trace);
+	record_motion_absolute(&server->recorder, event);
+	idle_activity(&server->idle);
+	/* Turned into the motion it amounts to, so that locks, confinement and
+	 * relative pointers see it just as they see relative motion. */
+	double lx, ly;
+	wlr_cursor_absolute_to_layout_coords(server->cursor, &event->pointer->base, event->x,
+		event->y, &lx, &ly);
+	double dx = lx - server->cursor->x, dy = ly - server->cursor->y;
+	if (pointer_constraints_motion(&server->constraints, event->time_msec, &dx, &dy,
+			dx, dy, server->cursor_mode == SCOWL_CURSOR_PASSTHROUGH))
+	{
+		trace_span(&server->trace, "pointer_motion_locked", "input", TRACE_TID_COMPOSITOR,
+			start);
+		return;
+	}
+	wlr_cursor_move(server->cursor, &event->pointer->base, dx, dy);
 	process_cursor_motion(server, event->time_msec);
+	trace_span(&server->trace, "pointer_motion_absolute", "input", TRACE_TID_COMPOSITOR, start);
 }
+PROFILE_LISTENER(server_cursor_motion_absolute)
 
 static void server_cursor_button(struct wl_listener *listener, void *data) 
 {
@@ -593,12 +1727,16 @@ static void server_cursor_button(struct wl_listener *listener, void *data)
 	struct Server *server =
 		wl_container_of(listener, server, cursor_button);
 	struct wlr_pointer_button_event *event = data;
+	uint64_t start = trace_begin(&server->trace);
+	record_button(&server->recorder, event);
+	idle_activity(&server->idle);
 	/* Notify the client with pointer focus that a button press has occurred */
 	wlr_seat_pointer_notify_button(server->seat,
 			event->time_msec, event->button, event->state);
+	tag_input(server->seat->pointer_state.focused_surface, event->time_msec);
 	double sx, sy;
 	struct wlr_surface *surface = NULL;
-	struct Toplevel *toplevel = desktop_toplevel_at(server,
+	struct Client *toplevel = desktop_toplevel_at(server,
 			server->cursor->x, server->cursor->y, &surface, &sx, &sy);
 	if (event->state == WL_POINTER_BUTTON_STATE_RELEASED) {
 		/* If you released any buttons, we exit interactive move/resize mode. */
@@ -607,7 +1745,10 @@ static void server_cursor_button(struct wl_listener *listener, void *data)
 		/* Focus that client if the button was _pressed_ */
 		focus_toplevel(toplevel, surface);
 	}
+
+	trace_span(&server->trace, "pointer_button", "input", TRACE_TID_COMPOSITOR, start);
 }
+PROFILE_LISTENER(server_cursor_button)
 
 static void server_new_pointer(struct Server *server,
 		struct wlr_input_device *device) 
@@ -631,37 +1772,87 @@ static void keyboard_handle_destroy(struct wl_listener *listener, void *data)
 	wl_list_remove(&keyboard->key.link);
 	wl_list_remove(&keyboard->destroy.link);
 	wl_list_remove(&keyboard->link);
-	free(keyboard);
+	pool_free(&keyboard->server->keyboard_pool, keyboard);
 }
 
-static bool handle_keybinding(struct Server *server, xkb_keysym_t sym) 
+static bool handle_keybinding(struct Server *server, uint32_t modifiers, xkb_keysym_t sym)
 {
 	/*
 	 * Here we handle compositor keybindings. This is when the compositor is
 	 * processing keys, rather than passing them on to the client for its own
 	 * processing.
-	 *
-	 * This function assumes Alt is held down.
 	 */
-	switch (sym) {
-	case XKB_KEY_Escape:
+	const struct ConfigBinding *binding = config_binding(&server->config, modifiers, sym);
+	if (binding == NULL)
+	{
+		return false;
+	}
+
+	switch (binding->action) {
+	case BIND_QUIT:
+		server->running = false;
 		wl_display_terminate(server->display);
 		break;
-	case XKB_KEY_F1:
-		/* Cycle to the next toplevel */
-		if (wl_list_length(&server->toplevels) < 2) {
+	case BIND_FOCUS_LAST:
+		/* Focus the least recently used toplevel */
+		if (mru_count(&server->toplevels) < 2) {
 			break;
 		}
-		struct Toplevel *next_toplevel =
-			wl_container_of(server->toplevels.prev, next_toplevel, link);
+		struct MruEntry *last = mru_step(&server->toplevels, NULL, -1, NULL, NULL);
+		struct Client *next_toplevel = wl_container_of(last, next_toplevel, mru);
 		focus_toplevel(next_toplevel, next_toplevel->xdg_toplevel->base->surface);
 		break;
-	default:
+	case BIND_CYCLE_NEXT:
+		cycle_toplevel(server, 1);
+		break;
+	case BIND_CYCLE_PREV:
+		cycle_toplevel(server, -1);
+		break;
+	case BIND_TERMINAL:
+		spawn(&server->spawner, server->config.terminal);
+		break;
+	case BIND_SPAWN:
+		spawn(&server->spawner, binding->command);
+		break;
+	case BIND_NONE:
 		return false;
 	}
 	return true;
 }
 
+static uint32_t keyboard_binding_modifiers(struct wlr_keyboard *wlr_keyboard, uint32_t keycode)
+{
+	/* The held modifiers, less those the keysym already used up, so Shift
+	 * on Shift+Tab (ISO_Left_Tab) does not count twice. */
+	static const struct
+	{
+		uint32_t modifier;
+		const char *name;
+	} names[] = {
+		{ WLR_MODIFIER_SHIFT, XKB_MOD_NAME_SHIFT },
+		{ WLR_MODIFIER_CTRL, XKB_MOD_NAME_CTRL },
+		{ WLR_MODIFIER_ALT, XKB_MOD_NAME_ALT },
+		{ WLR_MODIFIER_LOGO, XKB_MOD_NAME_LOGO },
+	};
+	uint32_t held = wlr_keyboard_get_modifiers(wlr_keyboard);
+	uint32_t modifiers = 0;
+
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+	{
+		if (!(held & names[i].modifier))
+		{
+			continue;
+		}
+		xkb_mod_index_t index = xkb_keymap_mod_get_index(wlr_keyboard->keymap, names[i].name);
+		if (index == XKB_MOD_INVALID ||
+			xkb_state_mod_index_is_consumed(wlr_keyboard->xkb_state, keycode, index) != 1)
+		{
+			modifiers |= names[i].modifier;
+		}
+	}
+	return modifiers;
+}
+
 static void keyboard_handle_key(
 		struct wl_listener *listener, void *data) 
 {
@@ -671,6 +1862,9 @@ static void keyboard_handle_key(
 	struct Server *server = keyboard->server;
 	struct wlr_keyboard_key_event *event = data;
 	struct wlr_seat *seat = server->seat;
+	uint64_t start = trace_begin(&server->trace);
+	record_key(&server->recorder, event);
+	idle_activity(&server->idle);
 
 	/* Translate libinput keycode -> xkbcommon */
 	uint32_t keycode = event->keycode + 8;
@@ -680,13 +1874,12 @@ static void keyboard_handle_key(
 			keyboard->wlr_keyboard->xkb_state, keycode, &syms);
 
 	bool handled = false;
-	uint32_t modifiers = wlr_keyboard_get_modifiers(keyboard->wlr_keyboard);
-	if ((modifiers & WLR_MODIFIER_ALT) &&
-			event->state == WL_KEYBOARD_KEY_STATE_PRESSED) {
-		/* If alt is held down and this button was _pressed_, we attempt to
-		 * process it as a compositor keybinding. */
+	if (event->state == WL_KEYBOARD_KEY_STATE_PRESSED) {
+		/* If this button was _pressed_, we attempt to process it as a
+		 * compositor keybinding. */
+		uint32_t modifiers = keyboard_binding_modifiers(keyboard->wlr_keyboard, keycode);
 		for (int i = 0; i < nsyms; i++) {
-			handled = handle_keybinding(server, syms[i]);
+			handled = handle_keybinding(server, modifiers, syms[i]);
 		}
 	}
 
@@ -695,33 +1888,48 @@ static void keyboard_handle_key(
 		wlr_seat_set_keyboard(seat, keyboard->wlr_keyboard);
 		wlr_seat_keyboard_notify_key(seat, event->time_msec,
 			event->keycode, event->state);
+		tag_input(seat->keyboard_state.focused_surface, event->time_msec);
 	}
+
+	trace_span(&server->trace, "key", "input", TRACE_TID_COMPOSITOR, start);
 }
+PROFILE_LISTENER(keyboard_handle_key)
 
 static void server_new_keyboard(struct Server *server,
 		struct wlr_input_device *device) 
 {
 	struct wlr_keyboard *wlr_keyboard = wlr_keyboard_from_input_device(device);
 
-	struct Keyboard *keyboard = calloc(1, sizeof(*keyboard));
+	struct Keyboard *keyboard = pool_alloc(&server->keyboard_pool);
+	if (keyboard == NULL)
+	{
+		return;
+	}
 	keyboard->server = server;
 	keyboard->wlr_keyboard = wlr_keyboard;
 
-	/* We need to prepare an XKB keymap and assign it to the keyboard. This
-	 * assumes the defaults (e.g. layout = "us"). */
-	struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-	struct xkb_keymap *keymap = xkb_keymap_new_from_names(context, NULL,
-		XKB_KEYMAP_COMPILE_NO_FLAGS);
+	/* We need to prepare an XKB keymap and assign it to the keyboard. The
+	 * configured keymap was compiled during startup, or on the last config
+	 * change, and is shared by all keyboards. */
+	struct xkb_keymap *keymap = server->keymap != NULL ?
+		xkb_keymap_ref(server->keymap) : startup_keymap(&server->startup);
+	if (keymap == NULL)
+	{
+		struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+		keymap = xkb_keymap_new_from_names(context, &server->config.keymap,
+			XKB_KEYMAP_COMPILE_NO_FLAGS);
+		xkb_context_unref(context);
+	}
 
 	wlr_keyboard_set_keymap(wlr_keyboard, keymap);
 	xkb_keymap_unref(keymap);
-	xkb_context_unref(context);
-	wlr_keyboard_set_repeat_info(wlr_keyboard, 25, 600);
+	wlr_keyboard_set_repeat_info(wlr_keyboard, server->config.repeat_rate,
+		server->config.repeat_delay);
 
 	/* Here we set up listeners for keyboard events. */
-	keyboard->modifiers.notify = keyboard_handle_modifiers;
+	keyboard->modifiers.notify = PROFILED(keyboard_handle_modifiers);
 	wl_signal_add(&wlr_keyboard->events.modifiers, &keyboard->modifiers);
-	keyboard->key.notify = keyboard_handle_key;
+	keyboard->key.notify = PROFILED(keyboard_handle_key);
 	wl_signal_add(&wlr_keyboard->events.key, &keyboard->key);
 	keyboard->destroy.notify = keyboard_handle_destroy;
 	wl_signal_add(&device->events.destroy, &keyboard->destroy);
@@ -746,6 +1954,7 @@ static void server_new_input(struct wl_listener *listener, void *data)
 		break;
 	case WLR_INPUT_DEVICE_POINTER:
 		wlr_log(WLR_INFO, "New pointer device attached");
+		startup_preload_wait(&server->startup);
 		server_new_pointer(server, device);
 		break;
 	default:
@@ -767,26 +1976,53 @@ static void server_new_xdg_toplevel(struct wl_listener *listener, void *data)
 {
 	struct Server *server = wl_container_of(listener, server, new_xdg_toplevel);
 	struct wlr_xdg_toplevel *xdg_toplevel = data;
-	struct Client *client = NULL;
-
-	client = xdg_toplevel->base->data = calloc(1, sizeof(*client));
-	client->surface.xdg = xdg_toplevel->base;
-	client->bw = 4;
 
-	wlr_log(WLR_DEBUG, "Allocate Toplevel for new surface");
+	DEBUG_LOG("Allocate Client for new toplevel");
 
-	struct Toplevel *toplevel = calloc(1, sizeof(*toplevel));
+	struct Client *toplevel = pool_alloc(&server->client_pool);
+	if (toplevel == NULL)
+	{
+		wl_resource_post_no_memory(xdg_toplevel->resource);
+		return;
+	}
+	toplevel->kind = Wayland;
 	toplevel->server = server;
+	toplevel->surface.xdg = xdg_toplevel->base;
 	toplevel->xdg_toplevel = xdg_toplevel;
-	toplevel->scene_tree = wlr_scene_xdg_surface_create(&toplevel->server->scene->tree, xdg_toplevel->base);
+
+	pid_t pid;
+	wl_client_get_credentials(xdg_toplevel->base->client->client, &pid, NULL, NULL);
+	metrics_client_init(&server->metrics, &toplevel->metrics, pid);
+
+	/* The borders sit in a tree of their own next to the surface, so that
+	 * neither has to be redrawn when the other changes. Both trees point back
+	 * at the toplevel; it stays hidden until mapped. */
+	toplevel->bw = server->config.border_width;
+	toplevel->tags = 1;
+	wl_list_init(&toplevel->mru.link);
+	wl_list_init(&toplevel->dirty_link);
+	toplevel->scene_tree = wlr_scene_tree_create(server->window_tree);
 	toplevel->scene_tree->node.data = toplevel;
-	xdg_toplevel->base->data = toplevel->scene_tree;
+	for (size_t i = 0; i < 4; i++)
+	{
+		toplevel->border[i] = wlr_scene_rect_create(toplevel->scene_tree, 0, 0, border_color);
+	}
+	if (server->titlebars)
+	{
+		toplevel->title_height = TITLE_HEIGHT;
+		titlebar_init(&toplevel->titlebar, toplevel->scene_tree);
+	}
+	toplevel->scene_surface = wlr_scene_xdg_surface_create(toplevel->scene_tree,
+		xdg_toplevel->base);
+	toplevel->scene_surface->node.data = toplevel;
+	xdg_toplevel->base->data = toplevel->scene_surface;
+	wlr_scene_node_set_enabled(&toplevel->scene_tree->node, false);
 
-	toplevel->map.notify = xdg_toplevel_map;
+	toplevel->map.notify = PROFILED(xdg_toplevel_map);
 	wl_signal_add(&xdg_toplevel->base->surface->events.map, &toplevel->map);
 	toplevel->unmap.notify = xdg_toplevel_unmap;
 	wl_signal_add(&xdg_toplevel->base->surface->events.unmap, &toplevel->unmap);
-	toplevel->commit.notify = xdg_toplevel_commit;
+	toplevel->commit.notify = PROFILED(xdg_toplevel_commit);
 	wl_signal_add(&xdg_toplevel->base->surface->events.commit, &toplevel->commit);
 
 	toplevel->destroy.notify = xdg_toplevel_destroy;
@@ -801,6 +2037,15 @@ static void server_new_xdg_toplevel(struct wl_listener *listener, void *data)
 	wl_signal_add(&xdg_toplevel->events.request_maximize, &toplevel->request_maximize);
 	toplevel->request_fullscreen.notify = xdg_toplevel_request_fullscreen;
 	wl_signal_add(&xdg_toplevel->events.request_fullscreen, &toplevel->request_fullscreen);
+
+	toplevel->set_app_id.notify = xdg_toplevel_set_app_id;
+	wl_signal_add(&xdg_toplevel->events.set_app_id, &toplevel->set_app_id);
+	toplevel->set_title.notify = xdg_toplevel_set_title;
+	wl_signal_add(&xdg_toplevel->events.set_title, &toplevel->set_title);
+	toplevel->configure.notify = xdg_toplevel_configure;
+	wl_signal_add(&xdg_toplevel->base->events.configure, &toplevel->configure);
+	toplevel->ack_configure.notify = xdg_toplevel_ack_configure;
+	wl_signal_add(&xdg_toplevel->base->events.ack_configure, &toplevel->ack_configure);
 }
 
 void xwayland_ready(struct wl_listener *listener, void *data)
@@ -818,6 +2063,9 @@ void xwayland_ready(struct wl_listener *listener, void *data)
 		return;
 	}
 
+	/* One client for every X11 window; per-client limits make no sense. */
+	quota_exempt(&server->quotas, server->xwayland->server->client);
+
 	server->netatom[NetWMWindowTypeDialog] = get_x11_atom(xc, "_NET_WM_WINDOW_TYPE_DIALOG");
 	server->netatom[NetWMWindowTypeSplash] = get_x11_atom(xc, "_NET_WM_WINDOW_TYPE_SPLASH");
 	server->netatom[NetWMWindowTypeToolbar] = get_x11_atom(xc, "_NET_WM_WINDOW_TYPE_TOOLBAR");
@@ -825,6 +2073,7 @@ void xwayland_ready(struct wl_listener *listener, void *data)
 
 	wlr_log(WLR_INFO, "Assigning seat to XWayland server");
 	wlr_xwayland_set_seat(server->xwayland, server->seat);
+	startup_preload_wait(&server->startup);
 
 	if ((xcursor = wlr_xcursor_manager_get_xcursor(server->cursor_mgr, "default", 1)))
 		wlr_xwayland_set_cursor(server->xwayland,
@@ -841,28 +2090,25 @@ void xwayland_surface_destroy(struct wl_listener *listener, void *data)
 	struct Client *client = wl_container_of(listener, client, destroy);
 	wlr_log(WLR_INFO, "Destroying XWayland surface");
 
-	if (client->surface.xwayland)
-	{
-		wl_list_remove(&client->commit.link);
-	}
-
-	client->surface.xwayland = NULL;
-	
+	/* Only the listeners xwayland_new_surface added; the commit listener is
+	 * self-linked while the surface is not associated. */
+	wl_list_remove(&client->commit.link);
 	wl_list_remove(&client->destroy.link);
-	wl_list_remove(&client->configure.link);
-	wl_list_remove(&client->fullscreen.link);
-	wl_list_remove(&client->maximize.link);
-	wl_list_remove(&client->activate.link);
-	wl_list_remove(&client->set_title.link);
-	wl_list_remove(&client->set_hints.link);
-	wl_list_remove(&client->set_decoration_mode.link);
 	wl_list_remove(&client->associate.link);
 	wl_list_remove(&client->dissociate.link);
+	wl_list_remove(&client->dirty_link);
+	if (client->frame_interval_ns > 0)
+	{
+		client->server->throttled--;
+	}
+
+	client->surface.xwayland->data = NULL;
+	pool_free(&client->server->client_pool, client);
 }
 
 void xwayland_surface_commit(struct wl_listener *listener, void *data)
 {
-	wlr_log(WLR_DEBUG, "Commit XWayland surface");
+	DEBUG_LOG("Commit XWayland surface");
 
 	struct Client *client = wl_container_of(listener, client, commit);
 	assert(client->kind == X11);
@@ -873,7 +2119,7 @@ void xwayland_surface_commit(struct wl_listener *listener, void *data)
 	new_geo.width = state->width;
 	new_geo.height = state->height;
 
-	wlr_log(WLR_INFO, "XWayland surface dimensions: %ix%i", new_geo.width, new_geo.height);
+	DEBUG_LOG("XWayland surface dimensions: %ix%i", new_geo.width, new_geo.height);
 
 	bool new_size = new_geo.width != client->geom.width ||
 		new_geo.height != client->geom.height;
@@ -883,51 +2129,235 @@ void xwayland_surface_commit(struct wl_listener *listener, void *data)
 		memcpy(&client->geom, &new_geo, sizeof(struct wlr_box));
 	}
 }
+PROFILE_LISTENER(xwayland_surface_commit)
 
 void xwayland_surface_associate(struct wl_listener *listener, void *data)
 {
+	/* The wlr_surface only exists from here on, so this is the earliest the
+	 * commit listener can be added. */
 	struct Client *client = wl_container_of(listener, client, associate);
+
+	wl_signal_add(&client->surface.xwayland->surface->events.commit, &client->commit);
+	client_update_rules(client);
+	if (!client->placed)
+	{
+		client_place(client);
+	}
+}
+
+void xwayland_surface_dissociate(struct wl_listener *listener, void *data)
+{
+	struct Client *client = wl_container_of(listener, client, dissociate);
+
+	wl_list_remove(&client->commit.link);
+	wl_list_init(&client->commit.link);
 }
 
 void xwayland_new_surface(struct wl_listener *listener, void *data)
 {
+	struct Server *server = wl_container_of(listener, server, xwayland_surface);
 	struct wlr_xwayland_surface *xsurface = data;
 	struct Client *client;
 
-	client = xsurface->data = calloc(1, sizeof(*client));
+	client = xsurface->data = pool_alloc(&server->client_pool);
+	if (client == NULL)
+	{
+		return;
+	}
+	client->server = server;
 	client->surface.xwayland = xsurface;
 	client->kind = X11;
 	client->bw = 0;
+	client->tags = 1;
+	wl_list_init(&client->dirty_link);
 
 	wl_signal_add(&xsurface->events.associate, &client->associate);
 	client->associate.notify = xwayland_surface_associate;
 
+	wl_signal_add(&xsurface->events.dissociate, &client->dissociate);
+	client->dissociate.notify = xwayland_surface_dissociate;
+
 	wl_signal_add(&xsurface->events.destroy, &client->destroy);
 
 	client->destroy.notify = xwayland_surface_destroy;
 	
-	wl_signal_add(&xsurface->surface->events.commit, &client->commit); // segfaults
+	wl_list_init(&client->commit.link);
+	client->commit.notify = PROFILED(xwayland_surface_commit);
+}
+
+static void arrange_layers(struct Server *server, struct wlr_output *wlr_output)
+{
+	hidden_frames_invalidate(server);
+
+	/* Exclusive zones are handed out from the overlay layer down, so panels
+	 * above claim their space before anything below is placed. */
+	struct wlr_box full_area, usable_area;
+	wlr_output_layout_get_box(server->output_layout, wlr_output, &full_area);
+	usable_area = full_area;
+
+	for (int layer = ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY; layer >= 0; layer--)
+	{
+		struct LayerSurface *lsrf;
+		wl_list_for_each(lsrf, &server->layers[layer], link)
+		{
+			if (lsrf->layer_surface->output != wlr_output ||
+				!lsrf->layer_surface->initialized)
+			{
+				continue;
+			}
+			wlr_scene_layer_surface_v1_configure(lsrf->scene_layer, &full_area, &usable_area);
+			wlr_scene_node_set_position(&lsrf->popups->node,
+				lsrf->scene->node.x, lsrf->scene->node.y);
+			if (lsrf->solid != NULL)
+			{
+				wlr_scene_rect_set_size(lsrf->solid,
+					lsrf->layer_surface->surface->current.width,
+					lsrf->layer_surface->surface->current.height);
+			}
+		}
+	}
+}
+
+static bool buffer_solid_color(struct wlr_buffer *buffer, float color[4])
+{
+	/* wp_single_pixel_buffer_v1 buffers (and 1x1 shm ones) are readable
+	 * from the CPU; either way one pixel covers the whole surface. This is
+	 * the client's own buffer, the source of the uploaded one, which lives
+	 * on until the client destroys it. */
+	void *data;
+	uint32_t format;
+	size_t stride;
+
+	if (buffer == NULL || buffer->width != 1 || buffer->height != 1 ||
+		!wlr_buffer_begin_data_ptr_access(buffer, WLR_BUFFER_DATA_PTR_ACCESS_READ,
+			&data, &format, &stride))
+	{
+		return false;
+	}
+
+	bool solid = format == DRM_FORMAT_ARGB8888 || format == DRM_FORMAT_XRGB8888;
+	if (solid)
+	{
+		/* Little-endian, premultiplied like scene rect colours. */
+		const uint8_t *pixel = data;
+		color[0] = pixel[2] / 255.0f;
+		color[1] = pixel[1] / 255.0f;
+		color[2] = pixel[0] / 255.0f;
+		color[3] = format == DRM_FORMAT_ARGB8888 ? pixel[3] / 255.0f : 1.0f;
+	}
+	wlr_buffer_end_data_ptr_access(buffer);
+	return solid;
+}
+
+static void find_surface_buffer(struct wlr_scene_buffer *buffer, int sx, int sy, void *data)
+{
+	struct LayerSurface *lsrf = data;
+	struct wlr_scene_surface *scene_surface = wlr_scene_surface_try_from_buffer(buffer);
+	if (scene_surface != NULL && scene_surface->surface == lsrf->layer_surface->surface)
+	{
+		lsrf->surface_buffer = buffer;
+	}
+}
+
+static void layer_update_solid(struct LayerSurface *lsrf)
+{
+	/*
+	 * A background that is a single colour is drawn as a scene rect
+	 * instead of the client's buffer, which is then left out of rendering
+	 * altogether: no texture to sample, and nothing to composite but a
+	 * solid fill. Backgrounds take no input worth keeping.
+	 */
+	struct wlr_surface *surface = lsrf->layer_surface->surface;
+	float color[4];
+	bool solid = lsrf->layer_surface->current.layer == ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND &&
+		wl_list_empty(&surface->current.subsurfaces_above) &&
+		wl_list_empty(&surface->current.subsurfaces_below) && surface->buffer != NULL &&
+		buffer_solid_color(surface->buffer->source, color);
+
+	if (lsrf->surface_buffer == NULL)
+	{
+		wlr_scene_node_for_each_buffer(&lsrf->scene->node, find_surface_buffer, lsrf);
+		if (lsrf->surface_buffer == NULL)
+		{
+			return;
+		}
+	}
 
-	client->commit.notify = xwayland_surface_commit;
+	if (solid)
+	{
+		if (lsrf->solid == NULL)
+		{
+			lsrf->solid = wlr_scene_rect_create(lsrf->scene, 0, 0, color);
+			wlr_scene_node_lower_to_bottom(&lsrf->solid->node);
+		}
+		wlr_scene_rect_set_color(lsrf->solid, color);
+		wlr_scene_rect_set_size(lsrf->solid, surface->current.width, surface->current.height);
+	}
+	if (lsrf->solid != NULL)
+	{
+		wlr_scene_node_set_enabled(&lsrf->solid->node, solid);
+	}
+	wlr_scene_node_set_enabled(&lsrf->surface_buffer->node, !solid);
 }
 
 void layer_shell_commit(struct wl_listener *listener, void *data)
 {
 	struct LayerSurface *lsrf = wl_container_of(listener, lsrf, surface_commit);
 	struct wlr_layer_surface_v1 *layer_surface = lsrf->layer_surface;
+	struct Server *server = lsrf->server;
 	struct wlr_layer_surface_v1_state old_state;
-	
-	if (lsrf->layer_surface->initial_commit)
+	struct wlr_surface *surface = layer_surface->surface;
+
+	if (layer_surface->output == NULL)
+	{
+		return;
+	}
+
+	if (layer_surface->initial_commit)
+	{
+		/* Arrange with the pending state, so the very first configure
+		 * already has the size the surface asked for. */
+		old_state = layer_surface->current;
+		layer_surface->current = layer_surface->pending;
+		arrange_layers(server, layer_surface->output);
+		layer_surface->current = old_state;
+		return;
+	}
+
+	if (surface->current.committed & WLR_SURFACE_STATE_BUFFER)
+	{
+		if (surface_committed_single_pixel(surface))
+		{
+			metrics_solid_buffer(&server->metrics, surface);
+		}
+		layer_update_solid(lsrf);
+	}
+
+	if (layer_surface->current.committed & WLR_LAYER_SURFACE_V1_STATE_LAYER)
 	{
-		// arrangement logic
+		enum zwlr_layer_shell_v1_layer layer = layer_surface->current.layer;
+		wlr_scene_node_reparent(&lsrf->scene->node, server->layer_trees[layer]);
+		wl_list_remove(&lsrf->link);
+		wl_list_insert(&server->layers[layer], &lsrf->link);
+		layer_update_solid(lsrf);
 	}
 
-	if (layer_surface->current.committed == 0 && lsrf->mapped == layer_surface->surface->mapped)
+	if (layer_surface->current.committed == 0)
 		return;
 
-	lsrf->mapped = layer_surface->surface->mapped;
+	arrange_layers(server, layer_surface->output);
+}
+PROFILE_LISTENER(layer_shell_commit)
+
+void layer_shell_map(struct wl_listener *listener, void *data)
+{
+	struct LayerSurface *lsrf = wl_container_of(listener, lsrf, map);
 
-	// arrangement logic
+	lsrf->mapped = 1;
+	if (lsrf->layer_surface->output != NULL)
+	{
+		arrange_layers(lsrf->server, lsrf->layer_surface->output);
+	}
 }
 
 void layer_shell_unmap(struct wl_listener *listener, void *data)
@@ -936,20 +2366,34 @@ void layer_shell_unmap(struct wl_listener *listener, void *data)
 	struct LayerSurface *lsrf = wl_container_of(listener, lsrf, unmap);
 
 	lsrf->mapped = 0;
+	if (lsrf->layer_surface->output != NULL)
+	{
+		arrange_layers(lsrf->server, lsrf->layer_surface->output);
+	}
 }
 
 void layer_shell_destroy(struct wl_listener *listener, void *data)
 {
+	/*
+	 * The layer surface goes away here, also when the compositor destroys
+	 * it (see output_destroy) while the client's wlr_surface lives on, so
+	 * every listener, including those on the wlr_surface, is removed now.
+	 */
 	wlr_log(WLR_INFO, "Layer-shell surface is being destroyed");
 	struct LayerSurface *lsrf = wl_container_of(listener, lsrf, destroy);
 
 	wl_list_remove(&lsrf->link);
 	wl_list_remove(&lsrf->destroy.link);
+	wl_list_remove(&lsrf->map.link);
 	wl_list_remove(&lsrf->unmap.link);
 	wl_list_remove(&lsrf->surface_commit.link);
-	wlr_scene_node_destroy(&lsrf->scene->node);
+	/* The layer surface's own tree goes away with it. */
 	wlr_scene_node_destroy(&lsrf->popups->node);
-	free(lsrf);
+	if (lsrf->layer_surface->output != NULL)
+	{
+		arrange_layers(lsrf->server, lsrf->layer_surface->output);
+	}
+	pool_free(&lsrf->server->layer_pool, lsrf);
 }
 
 void server_new_layer_surface(struct wl_listener *listener, void *data)
@@ -961,25 +2405,402 @@ void server_new_layer_surface(struct wl_listener *listener, void *data)
 
 	wlr_log(WLR_INFO, "New layer-shell surface has been instantiated.");
 
-	lsrf = layer_surface->data = calloc(1, sizeof(*lsrf));
+	/* Surfaces that leave the choice to us go on the output under the
+	 * cursor. */
+	if (layer_surface->output == NULL)
+	{
+		layer_surface->output = wlr_output_layout_output_at(server->output_layout,
+			server->cursor->x, server->cursor->y);
+	}
+	if (layer_surface->output == NULL)
+	{
+		wlr_layer_surface_v1_destroy(layer_surface);
+		return;
+	}
+
+	lsrf = layer_surface->data = pool_alloc(&server->layer_pool);
+	if (lsrf == NULL)
+	{
+		wl_resource_post_no_memory(layer_surface->resource);
+		return;
+	}
 	lsrf->kind = LayerShell;
+	lsrf->server = server;
+	lsrf->layer_surface = layer_surface;
+
+	enum zwlr_layer_shell_v1_layer layer = layer_surface->pending.layer;
+	lsrf->scene_layer = wlr_scene_layer_surface_v1_create(server->layer_trees[layer],
+		layer_surface);
+	lsrf->scene = lsrf->scene_layer->tree;
+	lsrf->popups = wlr_scene_tree_create(server->layer_trees[ZWLR_LAYER_SHELL_V1_LAYER_TOP]);
+	wl_list_insert(&server->layers[layer], &lsrf->link);
 	
 	wl_signal_add(&surface->events.commit, &lsrf->surface_commit);
-	lsrf->surface_commit.notify = layer_shell_commit;
+	lsrf->surface_commit.notify = PROFILED(layer_shell_commit);
+
+	wl_signal_add(&surface->events.map, &lsrf->map);
+	lsrf->map.notify = layer_shell_map;
 
 	wl_signal_add(&surface->events.unmap, &lsrf->unmap);
 	lsrf->unmap.notify = layer_shell_unmap;
 
-	wl_signal_add(&surface->events.destroy, &lsrf->destroy);
+	wl_signal_add(&layer_surface->events.destroy, &lsrf->destroy);
 	lsrf->destroy.notify = layer_shell_destroy;
+}
 
-	lsrf->layer_surface = layer_surface;
-	wlr_surface_send_enter(surface, layer_surface->output);
+static void server_load_rules(struct Server *server)
+{
+	/* Rebuilding bumps the generation, so every window's rules are
+	 * evaluated afresh the next time they are looked at. */
+	rules_finish(&server->rules);
+	for (size_t i = 0; i < server->config.rule_count; i++)
+	{
+		char where[PATH_MAX + 16];
+		snprintf(where, sizeof(where), "%s:%u", server->config_path,
+			server->config.rules[i].lineno);
+		rules_parse_line(&server->rules, server->config.rules[i].line, where);
+	}
+}
+
+static void server_apply_config(struct Server *server, uint32_t changes)
+{
+	/* Each kind of change touches only what depends on it; windows,
+	 * keyboards and outputs are otherwise left as they are. */
+	struct Keyboard *keyboard;
+	struct Output *output;
+	struct MruEntry *entry;
+
+	if (changes & CONFIG_KEYMAP)
+	{
+		struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+		struct xkb_keymap *keymap = context != NULL ? xkb_keymap_new_from_names(context,
+			&server->config.keymap, XKB_KEYMAP_COMPILE_NO_FLAGS) : NULL;
+		xkb_context_unref(context);
+		if (keymap != NULL)
+		{
+			if (server->keymap != NULL)
+			{
+				xkb_keymap_unref(server->keymap);
+			}
+			server->keymap = keymap;
+			wl_list_for_each(keyboard, &server->keyboards, link)
+			{
+				wlr_keyboard_set_keymap(keyboard->wlr_keyboard, keymap);
+			}
+		} else
+		{
+			wlr_log(WLR_ERROR, "Failed to compile the new keymap, keeping the old one");
+		}
+	}
+
+	if (changes & CONFIG_REPEAT)
+	{
+		wl_list_for_each(keyboard, &server->keyboards, link)
+		{
+			wlr_keyboard_set_repeat_info(keyboard->wlr_keyboard, server->config.repeat_rate,
+				server->config.repeat_delay);
+		}
+	}
+
+	if (changes & CONFIG_BORDER)
+	{
+		/* Unmapped windows pick the new width up when they map. */
+		wl_list_for_each(entry, &server->toplevels.stack, link)
+		{
+			struct Client *toplevel = wl_container_of(entry, toplevel, mru);
+			toplevel->bw = server->config.border_width;
+			/* Forget the geometry, or the borders would not be resized. */
+			toplevel->geom = (struct wlr_box){0};
+			toplevel_update_borders(toplevel);
+		}
+	}
+
+	if (changes & CONFIG_CURSOR)
+	{
+		struct wlr_xcursor_manager *cursor_mgr = wlr_xcursor_manager_create(
+			server->config.cursor_theme, server->config.cursor_size);
+		wl_list_for_each(output, &server->outputs, link)
+		{
+			wlr_xcursor_manager_load(cursor_mgr, output->wlr_output->scale);
+		}
+		const char *image = server->cursor_image;
+		struct wlr_xcursor_manager *old = server->cursor_mgr;
+		server->cursor_mgr = cursor_mgr;
+		if (image != NULL)
+		{
+			server->cursor_image = NULL;
+			set_cursor_image(server, image);
+		}
+		wlr_xcursor_manager_destroy(old);
+	}
+
+	/* Asleep, the outputs pick up their configuration when they wake. */
+	if ((changes & CONFIG_OUTPUTS) && !server->idle.idle)
+	{
+		wl_list_for_each(output, &server->outputs, link)
+		{
+			struct wlr_output_state state;
+			wlr_output_state_init(&state);
+			output_config_state(server, output->wlr_output, &state);
+			if (state.scale == output->wlr_output->scale &&
+				state.mode == output->wlr_output->current_mode)
+			{
+				wlr_output_state_finish(&state);
+				continue;
+			}
+			if (!wlr_output_commit_state(output->wlr_output, &state))
+			{
+				wlr_log(WLR_ERROR, "Output %s rejected its new configuration",
+					output->wlr_output->name);
+			}
+			wlr_output_state_finish(&state);
+			wlr_xcursor_manager_load(server->cursor_mgr, output->wlr_output->scale);
+			arrange_layers(server, output->wlr_output);
+		}
+		wl_list_for_each(entry, &server->toplevels.stack, link)
+		{
+			struct Client *toplevel = wl_container_of(entry, toplevel, mru);
+			toplevel_update_title(toplevel);
+		}
+	}
+
+	if (changes & CONFIG_RULES)
+	{
+		server_load_rules(server);
+		wl_list_for_each(entry, &server->toplevels.stack, link)
+		{
+			struct Client *toplevel = wl_container_of(entry, toplevel, mru);
+			client_update_rules(toplevel);
+		}
+	}
+
+	if (changes & CONFIG_IDLE)
+	{
+		idle_set_timeout(&server->idle, server->config.idle_timeout);
+	}
+
+	if (changes & CONFIG_QUOTA)
+	{
+		struct QuotaLimits limits = { .action = QUOTA_LOG };
+		if (server->config.quota == NULL || quota_parse_limits(&limits, server->config.quota))
+		{
+			quota_set_limits(&server->quotas, &limits);
+		}
+	}
+}
+
+static void server_reload_config(void *data)
+{
+	/* A file that cannot be read (mid-save, or removed) leaves the running
+	 * configuration alone. */
+	struct Server *server = data;
+	struct Config config;
+	if (!config_load(&config, server->config_path))
+	{
+		config_finish(&config);
+		return;
+	}
+
+	/* The preload thread may still be reading the old keymap names. */
+	startup_preload_wait(&server->startup);
+	uint32_t changes = config_diff(&server->config, &config);
+	struct Config old = server->config;
+	server->config = config;
+	server_apply_config(server, changes);
+	config_finish(&old);
+	wlr_log(WLR_INFO, "Reloaded %s, changes 0x%" PRIx32, server->config_path, changes);
+}
+
+static void ipc_config(FILE *out, const char *args, void *data)
+{
+	struct Server *server = data;
+
+	fprintf(out, "path %s reloads %" PRIu64 "\n",
+		server->config_path ? server->config_path : "(none)", server->config_watch.reloads);
+	config_write_summary(&server->config, out);
+}
+
+static void ipc_metrics(FILE *out, const char *args, void *data)
+{
+	struct Server *server = data;
+
+	if (strcmp(args, "prometheus") == 0)
+	{
+		metrics_write_prometheus(&server->metrics, out);
+	} else
+	{
+		metrics_write_summary(&server->metrics, out);
+	}
+}
+
+static void ipc_listeners(FILE *out, const char *args, void *data)
+{
+	struct Server *server = data;
+
+	fprintf(out, "stalls %" PRIu64 "\n", atomic_load(&server->watchdog.stalls));
+	profile_write(out);
+}
+
+static void ipc_rules(FILE *out, const char *args, void *data)
+{
+	struct Server *server = data;
+
+	rules_write_summary(&server->rules, out);
+}
+
+static void ipc_idle(FILE *out, const char *args, void *data)
+{
+	struct Server *server = data;
+
+	idle_write_summary(&server->idle, out);
+}
+
+static void ipc_constraints(FILE *out, const char *args, void *data)
+{
+	struct Server *server = data;
+
+	pointer_constraints_write_summary(&server->constraints, out);
+}
+
+static void ipc_quotas(FILE *out, const char *args, void *data)
+{
+	struct Server *server = data;
+
+	quota_write_summary(&server->quotas, out);
+}
+
+static void ipc_content(FILE *out, const char *args, void *data)
+{
+	static const char *const schedules[] = {
+		[CONTENT_SCHEDULE_VSYNC] = "vsync",
+		[CONTENT_SCHEDULE_ADAPTIVE] = "adaptive",
+		[CONTENT_SCHEDULE_TEARING] = "tearing",
+	};
+	struct Server *server = data;
+
+	struct Output *output;
+	wl_list_for_each(output, &server->outputs, link)
+	{
+		fprintf(out, "output %s schedule %s adaptive sync %s\n", output->wlr_output->name,
+			schedules[output->schedule],
+			output->wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED ?
+				"on" : output->adaptive_sync_failed ? "unsupported" : "off");
+	}
+
+	struct MruEntry *entry;
+	wl_list_for_each(entry, &server->toplevels.stack, link)
+	{
+		struct Client *client = wl_container_of(entry, client, mru);
+		const char *app_id = client->xdg_toplevel->app_id;
+		fprintf(out, "%s: content %s%s hidden %u fps%s\n", app_id ? app_id : "(no app_id)",
+			content_policy(client_content_type(client))->name,
+			client->rules.set & RULE_CONTENT ? " (rule)" : "",
+			client_hidden_fps(client), client_hidden(client) ? ", hidden" : "");
+	}
+}
+
+static void ipc_clipboard(FILE *out, const char *args, void *data)
+{
+	struct Server *server = data;
+
+	clipboard_write_summary(&server->clipboard, out);
+}
+
+static void ipc_toplevels(FILE *out, const char *args, void *data)
+{
+	struct Server *server = data;
+
+	foreign_toplevels_write_summary(&server->foreign, out);
+}
+
+static void ipc_objects(FILE *out, const char *args, void *data)
+{
+	struct Server *server = data;
+
+	pool_write_summary(&server->pools, out);
+}
+
+static void ipc_titlebars(FILE *out, const char *args, void *data)
+{
+	struct Server *server = data;
+
+	if (!server->titlebars)
+	{
+		fprintf(out, "title bars are disabled (set SCOWL_TITLEBARS)\n");
+		return;
+	}
+	title_cache_write(&server->title_cache, out);
+}
+
+static void ipc_startup(FILE *out, const char *args, void *data)
+{
+	startup_write(data, out);
+}
+
+static void ipc_spawn(FILE *out, const char *args, void *data)
+{
+	struct Server *server = data;
+
+	if (*args != '\0')
+	{
+		pid_t pid = spawn(&server->spawner, args);
+		fprintf(out, pid > 0 ? "pid %d\n" : "failed\n", pid);
+		return;
+	}
+	spawn_write_summary(&server->spawner, out);
+}
+
+static void server_run(struct Server *server)
+{
+	/* This is wl_display_run(), except that we wait for events ourselves so the
+	 * time spent dispatching them can be measured without the idle time. */
+	struct wl_event_loop *loop = wl_display_get_event_loop(server->display);
+	struct pollfd pfd = { .fd = wl_event_loop_get_fd(loop), .events = POLLIN };
+
+	server->running = true;
+	while (server->running)
+	{
+		wl_display_flush_clients(server->display);
+
+		if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+		{
+			wlr_log_errno(WLR_ERROR, "poll() on the event loop failed");
+			break;
+		}
+
+		uint64_t start = metrics_now_ns();
+		watchdog_dispatch_begin(&server->watchdog, start);
+		wl_event_loop_dispatch(loop, 0);
+		watchdog_dispatch_end(&server->watchdog);
+		histogram_record(&server->metrics.dispatch_time, metrics_now_ns() - start);
+	}
 }
 
 void server_init(struct Server server)
 {
+	startup_begin(&server.startup, &server.trace);
 	server.display = wl_display_create();
+	metrics_init(&server.metrics, wl_display_get_event_loop(server.display));
+	profile_init();
+	trace_init(&server.trace, wl_display_get_event_loop(server.display), &server.metrics);
+	spawn_init(&server.spawner, wl_display_get_event_loop(server.display));
+
+	/* Before the backend, which announces its input devices right away. */
+	wl_list_init(&server.pools);
+	pool_init(&server.client_pool, &server.pools, "clients", sizeof(struct Client));
+	pool_init(&server.popup_pool, &server.pools, "popups", sizeof(struct Popup));
+	pool_init(&server.layer_pool, &server.pools, "layers", sizeof(struct LayerSurface));
+	pool_init(&server.keyboard_pool, &server.pools, "keyboards", sizeof(struct Keyboard));
+	startup_phase(&server.startup, "display");
+
+	/* Creating the manager is cheap; loading its theme is not, so that and
+	 * the keymap happen on a worker while the backend comes up. */
+	server.config_path = config_default_path();
+	config_load(&server.config, server.config_path);
+	server.cursor_mgr = wlr_xcursor_manager_create(server.config.cursor_theme,
+		server.config.cursor_size);
+	startup_preload(&server.startup, server.cursor_mgr, &server.config.keymap);
+
 	server.backend = wlr_backend_autocreate(wl_display_get_event_loop(server.display), NULL);
 
 	if (server.backend == NULL) 
@@ -987,6 +2808,7 @@ void server_init(struct Server server)
 		wlr_log(WLR_ERROR, "Failed to instantiate backend");
 		return;
 	}
+	startup_phase(&server.startup, "backend");
 
 	server.renderer = wlr_renderer_autocreate(server.backend);
 	if (server.renderer == NULL) 
@@ -996,6 +2818,7 @@ void server_init(struct Server server)
 	}
 
 	wlr_renderer_init_wl_display(server.renderer, server.display);
+	startup_phase(&server.startup, "renderer");
 
 	server.allocator = wlr_allocator_autocreate(server.backend, server.renderer);
 	if (server.allocator == NULL) 
@@ -1003,10 +2826,19 @@ void server_init(struct Server server)
 		wlr_log(WLR_ERROR, "Failed to instantiate allocator");
 		return;
 	}
+	startup_phase(&server.startup, "allocator");
 
 	wlr_log(WLR_INFO, "Creating wlroots compositor");
 	server.compositor = wlr_compositor_create(server.display, 5, server.renderer);
 
+	/* Every client is accounted; limits only apply when configured. */
+	struct QuotaLimits limits = { .action = QUOTA_LOG };
+	if (server.config.quota != NULL)
+	{
+		quota_parse_limits(&limits, server.config.quota);
+	}
+	quota_init(&server.quotas, server.display, server.compositor, &server.pools, &limits);
+
 	wlr_log(WLR_INFO, "Creating wlroots subcompositor");
 	server.subcompositor = wlr_subcompositor_create(server.display);
 
@@ -1014,45 +2846,79 @@ void server_init(struct Server server)
 	wlr_data_device_manager_create(server.display);
 
 	server.output_layout = wlr_output_layout_create(server.display);
+	startup_phase(&server.startup, "globals");
 
 	wl_list_init(&server.outputs);
+	wl_list_init(&server.latency_pending);
 	server.new_output.notify = server_new_output;
 	wl_signal_add(&server.backend->events.new_output, &server.new_output);
 	
 	wlr_log(WLR_INFO, "Creating scene");
 	server.scene = wlr_scene_create();
 	server.scene_layout = wlr_scene_attach_output_layout(server.scene, server.output_layout);
+	for (int layer = 0; layer < 4; layer++)
+	{
+		wl_list_init(&server.layers[layer]);
+	}
+	server.layer_trees[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND] = wlr_scene_tree_create(&server.scene->tree);
+	server.layer_trees[ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM] = wlr_scene_tree_create(&server.scene->tree);
+	server.window_tree = wlr_scene_tree_create(&server.scene->tree);
+	server.layer_trees[ZWLR_LAYER_SHELL_V1_LAYER_TOP] = wlr_scene_tree_create(&server.scene->tree);
+	server.layer_trees[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY] = wlr_scene_tree_create(&server.scene->tree);
+
+	/* Solid fills (wallpaper colours, dimming, letterboxing) as 1x1 buffers
+	 * stretched by a viewport, instead of full-size uploads. */
+	wlr_single_pixel_buffer_manager_v1_create(server.display);
 
 	wlr_log(WLR_INFO, "Setting up xdg-shell V3");
-	wl_list_init(&server.toplevels);
+	mru_init(&server.toplevels);
 	server.xdg_shell = wlr_xdg_shell_create(server.display, 3);
 	server.new_xdg_toplevel.notify = server_new_xdg_toplevel;
 	wl_signal_add(&server.xdg_shell->events.new_toplevel, &server.new_xdg_toplevel);
 	server.new_xdg_popup.notify = server_new_xdg_popup;
 	wl_signal_add(&server.xdg_shell->events.new_popup, &server.new_xdg_popup);
 
+	/* Title bars are opt-in; without them, windows only get borders. */
+	rules_init(&server.rules);
+	server_load_rules(&server);
+
+	wl_list_init(&server.dirty_titlebars);
+	wl_list_init(&server.dirty_clients);
+	server.titlebars = getenv("SCOWL_TITLEBARS") != NULL;
+	if (server.titlebars)
+	{
+		title_cache_init(&server.title_cache, TITLE_CACHE_BYTES, "sans 10",
+			border_color, focus_color);
+	}
+
+	foreign_toplevels_init(&server.foreign, server.display);
+
+	server.decoration_mgr = wlr_xdg_decoration_manager_v1_create(server.display);
+	server.new_decoration.notify = server_new_decoration;
+	wl_signal_add(&server.decoration_mgr->events.new_toplevel_decoration,
+			&server.new_decoration);
+
 	wlr_log(WLR_INFO, "Setting up wlr-layer-shell");
 	server.layer_shell = wlr_layer_shell_v1_create(server.display, 3);
 	wl_signal_add(&server.layer_shell->events.new_surface, &server.new_layer_surface);
 	server.new_layer_surface.notify = server_new_layer_surface;
+	startup_phase(&server.startup, "shells");
 	
 	wlr_log(WLR_INFO, "Initializing cursor");
 	server.cursor = wlr_cursor_create();
 	wlr_cursor_attach_output_layout(server.cursor, server.output_layout);
-	
-	server.cursor_mgr = wlr_xcursor_manager_create(NULL, 24);
 
 	server.cursor_mode = SCOWL_CURSOR_PASSTHROUGH;
-	server.cursor_motion.notify = server_cursor_motion;
+	server.cursor_motion.notify = PROFILED(server_cursor_motion);
 	wl_signal_add(&server.cursor->events.motion, &server.cursor_motion);
-	server.cursor_motion_absolute.notify = server_cursor_motion_absolute;
+	server.cursor_motion_absolute.notify = PROFILED(server_cursor_motion_absolute);
 	wl_signal_add(&server.cursor->events.motion_absolute,
 			&server.cursor_motion_absolute);
-	server.cursor_button.notify = server_cursor_button;
+	server.cursor_button.notify = PROFILED(server_cursor_button);
 	wl_signal_add(&server.cursor->events.button, &server.cursor_button);
-	server.cursor_axis.notify = server_cursor_axis;
+	server.cursor_axis.notify = PROFILED(server_cursor_axis);
 	wl_signal_add(&server.cursor->events.axis, &server.cursor_axis);
-	server.cursor_frame.notify = server_cursor_frame;
+	server.cursor_frame.notify = PROFILED(server_cursor_frame);
 	wl_signal_add(&server.cursor->events.frame, &server.cursor_frame);
 
 	wl_list_init(&server.keyboards);
@@ -1065,6 +2931,37 @@ void server_init(struct Server server)
 	server.request_set_selection.notify = seat_request_set_selection;
 	wl_signal_add(&server.seat->events.request_set_selection,
 			&server.request_set_selection);
+
+	idle_init(&server.idle, server.display, server.seat, server.config.idle_timeout,
+		server_set_idle, &server);
+	pointer_constraints_init(&server.constraints, server.display, server.seat, server.cursor);
+
+	/* The clipboard store is opt-in; without it the selection stays with
+	 * the client that set it. */
+	if (getenv("SCOWL_CLIPBOARD") != NULL)
+	{
+		const char *max = getenv("SCOWL_CLIPBOARD_MAX");
+		const char *mimes = getenv("SCOWL_CLIPBOARD_MIMES");
+		clipboard_init(&server.clipboard, server.display, server.seat,
+			max ? strtoul(max, NULL, 10) : CLIPBOARD_MAX_BYTES,
+			mimes ? mimes : CLIPBOARD_MIME_TYPES);
+	}
+
+	/* Clients say what they show; see content.h for what that changes. */
+	server.content_type_mgr = wlr_content_type_manager_v1_create(server.display, 1);
+	server.hidden_frames = wl_event_loop_add_timer(wl_display_get_event_loop(server.display),
+		hidden_frames_timer, &server);
+
+	/* The scene tells each surface the fractional scale of the outputs it
+	 * is on; clients render at that size and viewporter maps it back. */
+	wlr_fractional_scale_manager_v1_create(server.display, 1);
+	wlr_viewporter_create(server.display);
+
+	server.cursor_shape_mgr = wlr_cursor_shape_manager_v1_create(server.display, 1);
+	server.request_set_shape.notify = seat_request_set_shape;
+	wl_signal_add(&server.cursor_shape_mgr->events.request_set_shape,
+			&server.request_set_shape);
+	startup_phase(&server.startup, "seat");
 	
 	const char *sock = wl_display_add_socket_auto(server.display);
 	if (!sock) 
@@ -1074,6 +2971,41 @@ void server_init(struct Server server)
 		return;
 	}
 
+	if (ipc_init(&server.ipc, wl_display_get_event_loop(server.display), sock))
+	{
+		ipc_register(&server.ipc, "metrics", "[prometheus] - dump frame, client and event-loop metrics",
+			ipc_metrics, &server);
+		ipc_register(&server.ipc, "trace", "[start|stop] - record a Chrome trace-event timeline",
+			trace_ipc, &server.trace);
+		ipc_register(&server.ipc, "listeners", "- per-listener dispatch times and stall count",
+			ipc_listeners, &server);
+		ipc_register(&server.ipc, "startup", "- startup phase timings and time to first frame",
+			ipc_startup, &server.startup);
+		ipc_register(&server.ipc, "titlebars", "- title bar cache statistics",
+			ipc_titlebars, &server);
+		ipc_register(&server.ipc, "spawn", "[command] - launch a command, or list launch-to-map times",
+			ipc_spawn, &server);
+		ipc_register(&server.ipc, "objects", "- live and peak counts of pooled objects",
+			ipc_objects, &server);
+		ipc_register(&server.ipc, "toplevels", "- taskbar handles and how many updates were batched",
+			ipc_toplevels, &server);
+		ipc_register(&server.ipc, "clipboard", "- clipboard store contents and transfer counts",
+			ipc_clipboard, &server);
+		ipc_register(&server.ipc, "rules", "- window rules and how often each matched",
+			ipc_rules, &server);
+		ipc_register(&server.ipc, "config", "- the running configuration and reload count",
+			ipc_config, &server);
+		ipc_register(&server.ipc, "idle", "- idle timeout, inhibitors and output sleeps",
+			ipc_idle, &server);
+		ipc_register(&server.ipc, "constraints", "- pointer locks and confinement",
+			ipc_constraints, &server);
+		ipc_register(&server.ipc, "quotas", "- per-client surface, buffer and commit accounting",
+			ipc_quotas, &server);
+		ipc_register(&server.ipc, "content", "- content types, output schedules and hidden windows",
+			ipc_content, &server);
+	}
+	startup_phase(&server.startup, "socket");
+
 	wlr_log(WLR_INFO, "Starting backend");
 	if (!wlr_backend_start(server.backend)) 
 	{
@@ -1082,11 +3014,14 @@ void server_init(struct Server server)
 		wl_display_destroy(server.display);
 		return;
 	}
+	startup_phase(&server.startup, "backend start");
 	
 	wlr_log(WLR_INFO, "Initializing XWayland layer");
 
 	/* Make sure that XWayland clients don't connect to the parent X server when running in a nested compositor */
 	unsetenv("DISPLAY");
+	/* Lazy: only the X socket is opened now, Xwayland itself is started when
+	 * the first X client connects. */
 	server.xwayland = wlr_xwayland_create(server.display, server.compositor, true);
 
 	if (server.xwayland == NULL)
@@ -1103,17 +3038,63 @@ void server_init(struct Server server)
 	
 	setenv("WAYLAND_DISPLAY", sock, true);
 	setenv("XDG_CURRENT_DESKTOP", "scowl", true);
-	setenv("DISPLAY", server.xwayland->display_name, true);
+	if (server.xwayland != NULL)
+	{
+		setenv("DISPLAY", server.xwayland->display_name, true);
+	}
+	startup_phase(&server.startup, "xwayland");
 
-	if (fork() == 0)
+	/* Everything is launched at once; nothing here waits for a client. */
+	spawn_list(&server.spawner, server.config.autostart != NULL ?
+		server.config.autostart : server.config.terminal);
+	startup_phase(&server.startup, "autostart");
+
+	if (server.config_path != NULL)
 	{
-		execl("/bin/sh", "/bin/sh", "-c", "foot", (void *)NULL);
+		config_watch_init(&server.config_watch, wl_display_get_event_loop(server.display),
+			server.config_path, server_reload_config, &server);
 	}
 
 	wlr_log(WLR_INFO, "Wayland backend starting on socket path: %s", sock);
-	wl_display_run(server.display);
+	const char *record_path = getenv("SCOWL_RECORD");
+	if (record_path != NULL)
+	{
+		recorder_open(&server.recorder, record_path);
+	}
+
+	const char *replay_path = getenv("SCOWL_REPLAY");
+	if (replay_path != NULL)
+	{
+		const char *speed = getenv("SCOWL_REPLAY_SPEED");
+		replay_start(&server.replay, replay_path, speed ? atof(speed) : 1.0,
+			server.display, server.backend,
+			getenv("SCOWL_REPLAY_EXIT") ? &server.running : NULL);
+	}
+
+	const char *watchdog_ms = getenv("SCOWL_WATCHDOG_MS");
+	if (watchdog_ms != NULL && atoi(watchdog_ms) > 0)
+	{
+		watchdog_start(&server.watchdog, atoi(watchdog_ms));
+	}
+
+	server_run(&server);
 
 	wlr_log(WLR_INFO, "Cleaning up and exiting.");
+	watchdog_stop(&server.watchdog);
+	trace_finish(&server.trace);
+	replay_finish(&server.replay);
+	recorder_close(&server.recorder);
+	spawn_finish(&server.spawner);
+	startup_finish(&server.startup);
+	title_cache_finish(&server.title_cache);
+	foreign_toplevels_finish(&server.foreign);
+	config_watch_finish(&server.config_watch);
+	wl_event_source_remove(server.hidden_frames);
+	clipboard_finish(&server.clipboard);
+	ipc_finish(&server.ipc);
+	metrics_finish(&server.metrics);
+	idle_finish(&server.idle);
+	pointer_constraints_finish(&server.constraints);
 	wl_display_destroy_clients(server.display);
 	wlr_scene_node_destroy(&server.scene->tree.node);
 	wlr_xcursor_manager_destroy(server.cursor_mgr);
@@ -1122,4 +3103,16 @@ void server_init(struct Server server)
 	wlr_renderer_destroy(server.renderer);
 	wlr_backend_destroy(server.backend);
 	wl_display_destroy(server.display);
+	pool_finish(&server.keyboard_pool);
+	pool_finish(&server.layer_pool);
+	pool_finish(&server.popup_pool);
+	pool_finish(&server.client_pool);
+	quota_finish(&server.quotas);
+	rules_finish(&server.rules);
+	if (server.keymap != NULL)
+	{
+		xkb_keymap_unref(server.keymap);
+	}
+	config_finish(&server.config);
+	free(server.config_path);
 }
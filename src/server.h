@@ -3,7 +3,25 @@
 
 #include "wayland.h"
 #include "xwayland.h"
+#include "clipboard.h"
+#include "config.h"
+#include "constraint.h"
+#include "content.h"
 #include "cursor.h"
+#include "foreign.h"
+#include "idle.h"
+#include "ipc.h"
+#include "metrics.h"
+#include "mru.h"
+#include "pool.h"
+#include "quota.h"
+#include "record.h"
+#include "rules.h"
+#include "spawn.h"
+#include "startup.h"
+#include "titlebar.h"
+#include "trace.h"
+#include "watchdog.h"
 
 struct Server 
 {
@@ -15,18 +33,39 @@ struct Server
 	struct wlr_subcompositor *subcompositor;
 	struct wlr_scene *scene;
 	struct wlr_scene_output_layout *scene_layout;
+	/* Stacking order, bottom to top: background and bottom layers, windows,
+	 * top and overlay layers. */
+	struct wlr_scene_tree *layer_trees[4];
+	struct wlr_scene_tree *window_tree;
 
 	struct wlr_layer_shell_v1 *layer_shell;
 	struct wl_listener new_layer_surface;
-	struct wl_list layers[4];
+	struct wl_list layers[4]; /* LayerSurface.link, by zwlr_layer_shell_v1_layer */
 
 	struct wlr_xdg_shell *xdg_shell;
 	struct wl_listener new_xdg_toplevel;
 	struct wl_listener new_xdg_popup;
-	struct wl_list toplevels;
+	struct Mru toplevels;      /* mapped toplevels, Client.mru */
+	struct Client *cycle;    /* alt-tab candidate, focused when Alt is released */
+	struct wlr_xdg_decoration_manager_v1 *decoration_mgr;
+	struct wl_listener new_decoration;
+	bool titlebars;
+	struct TitleCache title_cache;
+	struct wl_list dirty_titlebars; /* Titlebar.dirty_link */
+	struct wl_list dirty_clients;   /* Client.dirty_link */
+	struct ForeignToplevels foreign;
+	struct RuleSet rules;
+	unsigned int throttled; /* clients with a frame rate limit */
+	struct wlr_content_type_manager_v1 *content_type_mgr;
+	struct wl_event_source *hidden_frames; /* frame callbacks for hidden windows */
+	bool hidden_frames_armed;
+	bool hidden_frames_dirty; /* a window may have been hidden or shown since the last check */
 
 	struct wlr_cursor *cursor;
 	struct wlr_xcursor_manager *cursor_mgr;
+	struct wlr_cursor_shape_manager_v1 *cursor_shape_mgr;
+	const char *cursor_image; /* current xcursor name, NULL for client surfaces */
+	struct wl_listener request_set_shape;
 	struct wl_listener cursor_motion;
 	struct wl_listener cursor_motion_absolute;
 	struct wl_listener cursor_button;
@@ -42,9 +81,10 @@ struct Server
 	struct wl_listener new_input;
 	struct wl_listener request_cursor;
 	struct wl_listener request_set_selection;
+	struct Clipboard clipboard;
 	struct wl_list keyboards;
 	enum CursorMode cursor_mode;
-	struct Toplevel *grabbed_toplevel;
+	struct Client *grabbed_toplevel;
 	double grab_x, grab_y;
 	struct wlr_box grab_geobox;
 	uint32_t resize_edges;
@@ -52,59 +92,49 @@ struct Server
 	struct wlr_output_layout *output_layout;
 	struct wl_list outputs;
 	struct wl_listener new_output;
+
+	struct Metrics metrics;
+	struct Ipc ipc;
+	struct Watchdog watchdog;
+	struct Trace trace;
+	struct Recorder recorder;
+	struct Replay replay;
+	struct Spawner spawner;
+	struct Startup startup;
+	char *config_path;
+	struct Config config;
+	struct ConfigWatch config_watch;
+	struct xkb_keymap *keymap; /* once the config changed it; else the startup one */
+	struct wl_list latency_pending; /* InputLatency.link */
+	struct wl_list pools;           /* Pool.link */
+	struct Pool client_pool;
+	struct Pool popup_pool;
+	struct Pool layer_pool;
+	struct Pool keyboard_pool;
+	struct Quotas quotas;
+	struct Idle idle;
+	struct PointerConstraints constraints;
+	bool running;
 };
 
 struct LayerSurface
 {
 	unsigned int kind;
+	struct Server *server;
 	struct wlr_box geom;
 	struct wlr_scene_tree *scene;
 	struct wlr_scene_tree *popups;
 	struct wlr_scene_layer_surface_v1 *scene_layer;
+	struct wlr_scene_buffer *surface_buffer; /* the main surface's node, once found */
+	struct wlr_scene_rect *solid;            /* stands in for a 1x1 background buffer */
 	struct wl_list link;
 	int mapped;
 	struct wlr_layer_surface_v1 *layer_surface;
 
-	
-	struct wl_listener destroy;
-	struct wl_listener unmap;
-	struct wl_listener surface_commit;
-};
-
-struct Client
-{
-	unsigned int kind; // XDGShell or XWayland
-	struct wlr_box geom;
-	struct wlr_scene_tree *scene;
-	struct wlr_scene_rect *border[4];
-	struct wlr_scene_tree *scene_surface;
-	struct wl_list link;
-	struct wl_list flink;
-	union {
-		struct wlr_xdg_surface *xdg;
-		struct wlr_xwayland_surface *xwayland;
-	} surface;
-	struct wlr_xdg_toplevel_decoration_v1 *decoration;
-	struct wl_listener commit;
+	struct wl_listener destroy; /* of the layer surface, which can go before its wlr_surface */
 	struct wl_listener map;
-	struct wl_listener maximize;
 	struct wl_listener unmap;
-	struct wl_listener destroy;
-	struct wl_listener set_title;
-	struct wl_listener fullscreen;
-	struct wl_listener set_decoration_mode;
-	struct wl_listener destroy_decoration;
-	struct wlr_box prev; /* layout-relative, includes border */
-	struct wlr_box bounds;
-	struct wl_listener activate;
-	struct wl_listener associate;
-	struct wl_listener dissociate;
-	struct wl_listener configure;
-	struct wl_listener set_hints;
-	unsigned int bw;
-	uint32_t tags;
-	int isfloating, isurgent, isfullscreen;
-	uint32_t resize; /* configure serial of a pending resize */
+	struct wl_listener surface_commit;
 };
 
 struct Output
@@ -113,16 +143,55 @@ struct Output
 	struct Server *server;
 	struct wlr_output *wlr_output;
 	struct wl_listener frame;
+	struct wl_listener present;
 	struct wl_listener request_state;
 	struct wl_listener destroy;
+	struct OutputMetrics metrics;
+	enum ContentSchedule schedule; /* of the last frame */
+	bool adaptive_sync_failed;     /* the output refused it; don't ask every frame */
+	struct wl_event_source *throttle_timer; /* a frame for skipped callbacks falling due */
 };
 
-struct Toplevel
+/*
+ * A window: an xdg toplevel (kind Wayland) or an X11 surface (kind X11).
+ * Everything about it, listeners included, lives in this one object, which
+ * comes out of Server.client_pool.
+ */
+struct Client
 {
-	struct wl_list link;
+	unsigned int kind; /* Wayland or X11 */
 	struct Server *server;
+	struct MruEntry mru;
+	union {
+		struct wlr_xdg_surface *xdg;
+		struct wlr_xwayland_surface *xwayland;
+	} surface;
 	struct wlr_xdg_toplevel *xdg_toplevel;
-	struct wlr_scene_tree *scene_tree;
+	struct wlr_scene_tree *scene_tree;    /* borders and surface, at the outer top-left */
+	struct wlr_scene_tree *scene_surface; /* the xdg surface and its popups */
+	struct wlr_scene_rect *border[4];     /* top, bottom, left, right */
+	struct wlr_box geom;                  /* window geometry the borders were sized for */
+	unsigned int bw;
+	unsigned int title_height;            /* 0 without a title bar */
+	struct Titlebar titlebar;
+	bool focused;
+	uint32_t tags;
+	int isfloating, isurgent, isfullscreen;
+	struct RuleCache rule_cache;
+	struct RuleResult rules;
+	bool placed;                          /* the rules' output applied */
+	uint64_t frame_interval_ns;           /* 0 unless throttled by a rule */
+	uint64_t frame_done_ns;               /* last frame callback sent while throttled or hidden */
+	enum wp_content_type_v1_type content_type; /* as of the last commit */
+	uint32_t dirty;                       /* ClientDirty bits, flushed at the next frame */
+	struct wl_list dirty_link;
+	struct ForeignToplevel foreign;       /* taskbar handles while mapped */
+	struct wlr_xdg_toplevel_decoration_v1 *decoration;
+	struct ClientMetrics metrics;
+
+	/* xdg-shell */
+	struct wl_listener set_decoration_mode;
+	struct wl_listener destroy_decoration;
 	struct wl_listener map;
 	struct wl_listener unmap;
 	struct wl_listener commit;
@@ -131,10 +200,27 @@ struct Toplevel
 	struct wl_listener request_resize;
 	struct wl_listener request_maximize;
 	struct wl_listener request_fullscreen;
+	struct wl_listener set_app_id;
+	struct wl_listener set_title;
+	struct wl_listener configure;
+	struct wl_listener ack_configure;
+	struct wl_listener foreign_activate;
+	struct wl_listener foreign_close;
+
+	/* XWayland; commit and destroy above are shared */
+	struct wl_listener associate;
+	struct wl_listener dissociate;
+};
+
+enum ClientDirty
+{
+	CLIENT_DIRTY_TITLE = 1 << 0,
+	CLIENT_DIRTY_APP_ID = 1 << 1,
 };
 
 struct Popup 
 {
+	struct Server *server;
 	struct wlr_xdg_popup *xdg_popup;
 	struct wl_listener commit;
 	struct wl_listener destroy;
@@ -151,6 +237,13 @@ struct Keyboard
 	struct wl_listener destroy;
 };
 
+/* A subset of the MRU stack: toplevels on `output` (any if NULL). */
+struct MruView
+{
+	struct Server *server;
+	struct wlr_output *output;
+};
+
 void server_init(struct Server server);
 
 #endif
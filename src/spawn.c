@@ -0,0 +1,264 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "spawn.h"
+#include "logger.h"
+
+/* How far up the process tree a mapping client is matched to a launch, for
+ * commands that go through a wrapper script or a launcher that forks. */
+#define SPAWN_ANCESTORS 4
+
+extern char **environ;
+
+static struct SpawnApp *spawn_app_get(struct Spawner *spawner, const char *command)
+{
+	struct SpawnApp *app;
+	wl_list_for_each(app, &spawner->apps, link)
+	{
+		if (strncmp(app->command, command, sizeof(app->command) - 1) == 0)
+		{
+			return app;
+		}
+	}
+
+	app = calloc(1, sizeof(*app));
+	if (app == NULL)
+	{
+		return NULL;
+	}
+	snprintf(app->command, sizeof(app->command), "%s", command);
+	wl_list_insert(spawner->apps.prev, &app->link);
+	return app;
+}
+
+static void spawn_child_destroy(struct SpawnChild *child)
+{
+	wl_list_remove(&child->link);
+	free(child);
+}
+
+static int spawn_handle_sigchld(int sig, void *data)
+{
+	/* Only our own children are waited for: wlroots reaps the processes it
+	 * starts (Xwayland) itself, and a waitpid(-1) here would race it. */
+	struct Spawner *spawner = data;
+	struct SpawnChild *child, *tmp;
+	wl_list_for_each_safe(child, tmp, &spawner->children, link)
+	{
+		int status;
+		pid_t pid = waitpid(child->pid, &status, WNOHANG);
+		if (pid == 0 || (pid < 0 && errno == EINTR))
+		{
+			continue;
+		}
+
+		if (pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) != 0)
+		{
+			wlr_log(WLR_INFO, "'%s' (pid %d) exited with status %d", child->app->command,
+				child->pid, WEXITSTATUS(status));
+		} else if (pid > 0 && WIFSIGNALED(status))
+		{
+			wlr_log(WLR_INFO, "'%s' (pid %d) killed by signal %d", child->app->command,
+				child->pid, WTERMSIG(status));
+		}
+		spawner->reaped++;
+		if (!child->mapped)
+		{
+			spawner->pending--;
+		}
+		spawn_child_destroy(child);
+	}
+	return 0;
+}
+
+void spawn_init(struct Spawner *spawner, struct wl_event_loop *loop)
+{
+	wl_list_init(&spawner->apps);
+	wl_list_init(&spawner->children);
+	spawner->pending = 0;
+	spawner->reaped = 0;
+
+	/* The signal source blocks SIGCHLD and reads it from a signalfd, so the
+	 * handler runs as a normal event-loop callback. */
+	spawner->sigchld = wl_event_loop_add_signal(loop, SIGCHLD, spawn_handle_sigchld, spawner);
+	if (spawner->sigchld == NULL)
+	{
+		wlr_log(WLR_ERROR, "Failed to watch SIGCHLD; spawned processes will not be reaped");
+	}
+}
+
+void spawn_finish(struct Spawner *spawner)
+{
+	struct SpawnChild *child, *tmp_child;
+	wl_list_for_each_safe(child, tmp_child, &spawner->children, link)
+	{
+		spawn_child_destroy(child);
+	}
+
+	struct SpawnApp *app, *tmp_app;
+	wl_list_for_each_safe(app, tmp_app, &spawner->apps, link)
+	{
+		wl_list_remove(&app->link);
+		free(app);
+	}
+
+	if (spawner->sigchld != NULL)
+	{
+		wl_event_source_remove(spawner->sigchld);
+		spawner->sigchld = NULL;
+	}
+}
+
+pid_t spawn(struct Spawner *spawner, const char *command)
+{
+	char *argv[] = { "/bin/sh", "-c", (char *)command, NULL };
+	posix_spawnattr_t attr;
+	sigset_t mask, defaults;
+	pid_t pid;
+
+	/* The compositor blocks SIGCHLD for its signalfd and installs handlers
+	 * of its own; children get a clean mask and default dispositions. */
+	sigemptyset(&mask);
+	sigfillset(&defaults);
+	sigdelset(&defaults, SIGKILL);
+	sigdelset(&defaults, SIGSTOP);
+
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF |
+		POSIX_SPAWN_SETSID);
+
+	int err = posix_spawn(&pid, argv[0], NULL, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+	if (err != 0)
+	{
+		wlr_log(WLR_ERROR, "Failed to spawn '%s': %s", command, strerror(err));
+		return -1;
+	}
+
+	struct SpawnChild *child = calloc(1, sizeof(*child));
+	struct SpawnApp *app = spawn_app_get(spawner, command);
+	if (child == NULL || app == NULL)
+	{
+		/* Still running, but it will be left for init to reap. */
+		free(child);
+		return pid;
+	}
+
+	child->pid = pid;
+	child->app = app;
+	child->launch_ns = metrics_now_ns();
+	wl_list_insert(&spawner->children, &child->link);
+	spawner->pending++;
+	app->launches++;
+
+	DEBUG_LOG("Spawned '%s' as pid %d", command, pid);
+	return pid;
+}
+
+void spawn_list(struct Spawner *spawner, const char *commands)
+{
+	char *list = strdup(commands);
+	char *save = NULL;
+
+	if (list == NULL)
+	{
+		return;
+	}
+
+	for (char *command = strtok_r(list, ";", &save); command != NULL;
+		command = strtok_r(NULL, ";", &save))
+	{
+		command += strspn(command, " \t");
+		if (*command != '\0')
+		{
+			spawn(spawner, command);
+		}
+	}
+	free(list);
+}
+
+static pid_t parent_pid(pid_t pid)
+{
+	char path[32], buf[512];
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+
+	FILE *file = fopen(path, "r");
+	if (file == NULL)
+	{
+		return -1;
+	}
+
+	size_t len = fread(buf, 1, sizeof(buf) - 1, file);
+	fclose(file);
+	buf[len] = '\0';
+
+	/* The command name may contain spaces and parentheses; the fields after
+	 * the last ')' are "state ppid ...". */
+	char *end = strrchr(buf, ')');
+	int ppid;
+	if (end == NULL || sscanf(end + 1, " %*c %d", &ppid) != 1)
+	{
+		return -1;
+	}
+	return ppid;
+}
+
+void spawn_mapped(struct Spawner *spawner, pid_t pid)
+{
+	/* Long-lived children that already mapped, like a terminal, do not
+	 * make every later window pay for the /proc reads. */
+	if (spawner->pending == 0)
+	{
+		return;
+	}
+
+	for (int depth = 0; depth < SPAWN_ANCESTORS && pid > 1; depth++)
+	{
+		struct SpawnChild *child;
+		wl_list_for_each(child, &spawner->children, link)
+		{
+			if (child->pid != pid)
+			{
+				continue;
+			}
+
+			if (!child->mapped)
+			{
+				uint64_t latency = metrics_now_ns() - child->launch_ns;
+				histogram_record(&child->app->map_latency, latency);
+				child->mapped = true;
+				spawner->pending--;
+				wlr_log(WLR_INFO, "'%s' mapped its first window %.1fms after launch",
+					child->app->command, latency / 1e6);
+			}
+			return;
+		}
+		pid = parent_pid(pid);
+	}
+}
+
+void spawn_write_summary(struct Spawner *spawner, FILE *out)
+{
+	fprintf(out, "running %d pending %u reaped %" PRIu64 "\n",
+		wl_list_length(&spawner->children), spawner->pending, spawner->reaped);
+
+	struct SpawnApp *app;
+	wl_list_for_each(app, &spawner->apps, link)
+	{
+		fprintf(out, "app '%s' launches %" PRIu64 " mapped %" PRIu64
+			" map_latency_ms p50=%.1f p99=%.1f max=%.1f\n",
+			app->command, app->launches, atomic_load(&app->map_latency.count),
+			histogram_percentile(&app->map_latency, 0.5) / 1e6,
+			histogram_percentile(&app->map_latency, 0.99) / 1e6,
+			atomic_load(&app->map_latency.max) / 1e6);
+	}
+}
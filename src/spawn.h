@@ -0,0 +1,55 @@
+#ifndef SPAWN_H_
+#define SPAWN_H_
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "wayland.h"
+#include "metrics.h"
+
+/*
+ * Launches commands with posix_spawn, which uses vfork/CLONE_VM under the hood
+ * instead of duplicating the compositor's address space and GPU mappings.
+ * Children are reaped from a SIGCHLD source on the event loop, and the time
+ * from launch to the first toplevel mapped by each child is recorded per
+ * command.
+ */
+struct SpawnApp
+{
+	struct wl_list link;
+	char command[64];
+	uint64_t launches;
+	struct Histogram map_latency; /* ns from spawn to first toplevel map */
+};
+
+struct SpawnChild
+{
+	struct wl_list link;
+	pid_t pid;
+	struct SpawnApp *app;
+	uint64_t launch_ns;
+	bool mapped;
+};
+
+struct Spawner
+{
+	struct wl_list apps;     /* SpawnApp.link */
+	struct wl_list children; /* SpawnChild.link */
+	struct wl_event_source *sigchld;
+	unsigned int pending;    /* children that have not mapped a window yet */
+	uint64_t reaped;
+};
+
+void spawn_init(struct Spawner *spawner, struct wl_event_loop *loop);
+void spawn_finish(struct Spawner *spawner);
+
+/* Runs `command` through /bin/sh -c; returns the child's pid or -1. */
+pid_t spawn(struct Spawner *spawner, const char *command);
+/* Spawns every entry of a `;`-separated list without waiting for any. */
+void spawn_list(struct Spawner *spawner, const char *commands);
+/* Called when a toplevel owned by `pid` maps for the first time. Walks up
+ * /proc only while some launch is still waiting for its first window. */
+void spawn_mapped(struct Spawner *spawner, pid_t pid);
+
+void spawn_write_summary(struct Spawner *spawner, FILE *out);
+
+#endif
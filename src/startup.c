@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "startup.h"
+#include "metrics.h"
+
+void startup_begin(struct Startup *startup, struct Trace *trace)
+{
+	startup->trace = trace;
+	startup->start_ns = startup->last_ns = metrics_now_ns();
+	startup->first_commit_ns = 0;
+	startup->count = 0;
+}
+
+static void startup_trace_span(struct Startup *startup, const char *name)
+{
+	/* The trace starts once the event loop exists, a little after the
+	 * first phase did; that phase is clipped to the trace's start. */
+	uint64_t start = startup->last_ns;
+	if (start < startup->trace->started_ns)
+	{
+		start = startup->trace->started_ns;
+	}
+	trace_span(startup->trace, name, "startup", TRACE_TID_COMPOSITOR, start);
+}
+
+void startup_phase(struct Startup *startup, const char *name)
+{
+	uint64_t now = metrics_now_ns();
+
+	if (startup->count < STARTUP_PHASES)
+	{
+		startup->phases[startup->count++] = (struct StartupPhase){
+			.name = name,
+			.start_ns = startup->last_ns,
+			.end_ns = now,
+		};
+	}
+	startup_trace_span(startup, name);
+	startup->last_ns = now;
+}
+
+void startup_output_commit(struct Startup *startup)
+{
+	if (startup->first_commit_ns != 0)
+	{
+		return;
+	}
+
+	startup->first_commit_ns = metrics_now_ns();
+	startup_trace_span(startup, "first output commit");
+
+	wlr_log(WLR_INFO, "First output commit %.1fms after startup",
+		(startup->first_commit_ns - startup->start_ns) / 1e6);
+	for (size_t i = 0; i < startup->count; i++)
+	{
+		struct StartupPhase *phase = &startup->phases[i];
+		wlr_log(WLR_INFO, "  %-24s %8.2fms", phase->name,
+			(phase->end_ns - phase->start_ns) / 1e6);
+	}
+}
+
+void startup_write(struct Startup *startup, FILE *out)
+{
+	for (size_t i = 0; i < startup->count; i++)
+	{
+		struct StartupPhase *phase = &startup->phases[i];
+		fprintf(out, "phase %-24s start %8.2fms took %8.2fms\n", phase->name,
+			(phase->start_ns - startup->start_ns) / 1e6,
+			(phase->end_ns - phase->start_ns) / 1e6);
+	}
+	fprintf(out, "preload took %.2fms, blocked main thread %.2fms\n",
+		startup->preload_ns / 1e6, startup->preload_wait_ns / 1e6);
+	if (startup->first_commit_ns != 0)
+	{
+		fprintf(out, "first_commit %.2fms\n",
+			(startup->first_commit_ns - startup->start_ns) / 1e6);
+	} else
+	{
+		fprintf(out, "first_commit pending\n");
+	}
+}
+
+static void *startup_preload_thread(void *data)
+{
+	struct Startup *startup = data;
+	uint64_t start = metrics_now_ns();
+
+	/* Neither object is touched by the main thread until it has joined us. */
+	struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+	if (context != NULL)
+	{
+		startup->keymap = xkb_keymap_new_from_names(context, startup->keymap_names,
+			XKB_KEYMAP_COMPILE_NO_FLAGS);
+		xkb_context_unref(context);
+	}
+
+	if (!wlr_xcursor_manager_load(startup->cursor_mgr, 1))
+	{
+		wlr_log(WLR_ERROR, "Failed to load the cursor theme");
+	}
+
+	startup->preload_ns = metrics_now_ns() - start;
+	return NULL;
+}
+
+void startup_preload(struct Startup *startup, struct wlr_xcursor_manager *cursor_mgr,
+	const struct xkb_rule_names *names)
+{
+	startup->cursor_mgr = cursor_mgr;
+	startup->keymap_names = names;
+	startup->keymap = NULL;
+	startup->preload_wait_ns = 0;
+
+	if (pthread_create(&startup->preload_thread, NULL, startup_preload_thread, startup) != 0)
+	{
+		wlr_log(WLR_ERROR, "Failed to start preload thread, loading inline");
+		startup_preload_thread(startup);
+		return;
+	}
+	startup->preloading = true;
+}
+
+void startup_preload_wait(struct Startup *startup)
+{
+	if (!startup->preloading)
+	{
+		return;
+	}
+
+	uint64_t start = metrics_now_ns();
+	pthread_join(startup->preload_thread, NULL);
+	startup->preloading = false;
+	startup->preload_wait_ns = metrics_now_ns() - start;
+}
+
+struct xkb_keymap *startup_keymap(struct Startup *startup)
+{
+	startup_preload_wait(startup);
+	return startup->keymap != NULL ? xkb_keymap_ref(startup->keymap) : NULL;
+}
+
+void startup_finish(struct Startup *startup)
+{
+	startup_preload_wait(startup);
+	if (startup->keymap != NULL)
+	{
+		xkb_keymap_unref(startup->keymap);
+		startup->keymap = NULL;
+	}
+}
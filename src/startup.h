@@ -0,0 +1,62 @@
+#ifndef STARTUP_H_
+#define STARTUP_H_
+
+#include <pthread.h>
+#include <stdio.h>
+#include "wayland.h"
+#include "trace.h"
+
+#define STARTUP_PHASES 24
+
+/*
+ * Startup instrumentation. server_init marks the end of each phase; the first
+ * output commit closes the measurement and logs a summary, which the "startup"
+ * IPC command can print again later. With SCOWL_TRACE_EVENTS set, tracing
+ * starts at launch and the phases show up in the trace as well.
+ *
+ * Work that nothing needs until the first input device or output appears (the
+ * keymap and the cursor theme) is done on a worker thread meanwhile, and
+ * joined by whichever needs it first.
+ */
+struct StartupPhase
+{
+	const char *name;
+	uint64_t start_ns;
+	uint64_t end_ns;
+};
+
+struct Startup
+{
+	struct Trace *trace;
+	uint64_t start_ns;
+	uint64_t last_ns;
+	uint64_t first_commit_ns;
+	struct StartupPhase phases[STARTUP_PHASES];
+	size_t count;
+
+	pthread_t preload_thread;
+	bool preloading;
+	struct wlr_xcursor_manager *cursor_mgr;
+	const struct xkb_rule_names *keymap_names;
+	struct xkb_keymap *keymap;
+	uint64_t preload_ns;
+	uint64_t preload_wait_ns; /* time the main thread spent blocked on it */
+};
+
+void startup_begin(struct Startup *startup, struct Trace *trace);
+void startup_phase(struct Startup *startup, const char *name);
+/* Cheap enough to call on every output commit. */
+void startup_output_commit(struct Startup *startup);
+void startup_write(struct Startup *startup, FILE *out);
+
+/* Compiles the configured keymap and loads `cursor_mgr`'s theme at scale 1.
+ * `names` must stay valid until the preload has been waited for. */
+void startup_preload(struct Startup *startup, struct wlr_xcursor_manager *cursor_mgr,
+	const struct xkb_rule_names *names);
+/* Waits for the preload to finish; returns immediately once it has. */
+void startup_preload_wait(struct Startup *startup);
+/* Returns a new reference to the keymap compiled at startup, or NULL. */
+struct xkb_keymap *startup_keymap(struct Startup *startup);
+void startup_finish(struct Startup *startup);
+
+#endif
@@ -0,0 +1,269 @@
+#include <drm_fourcc.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/interfaces/wlr_buffer.h>
+
+#include "titlebar.h"
+
+#define TITLE_PADDING 6
+
+struct TitleBuffer
+{
+	struct wlr_buffer base;
+	cairo_surface_t *surface;
+};
+
+static void title_buffer_destroy(struct wlr_buffer *wlr_buffer)
+{
+	struct TitleBuffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+	cairo_surface_destroy(buffer->surface);
+	free(buffer);
+}
+
+static bool title_buffer_begin_data_ptr_access(struct wlr_buffer *wlr_buffer, uint32_t flags,
+	void **data, uint32_t *format, size_t *stride)
+{
+	struct TitleBuffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+
+	if (flags & WLR_BUFFER_DATA_PTR_ACCESS_WRITE)
+	{
+		return false;
+	}
+
+	/* CAIRO_FORMAT_ARGB32 is premultiplied, native-endian ARGB. */
+	*data = cairo_image_surface_get_data(buffer->surface);
+	*format = DRM_FORMAT_ARGB8888;
+	*stride = cairo_image_surface_get_stride(buffer->surface);
+	return true;
+}
+
+static void title_buffer_end_data_ptr_access(struct wlr_buffer *wlr_buffer)
+{
+}
+
+static const struct wlr_buffer_impl title_buffer_impl = {
+	.destroy = title_buffer_destroy,
+	.begin_data_ptr_access = title_buffer_begin_data_ptr_access,
+	.end_data_ptr_access = title_buffer_end_data_ptr_access,
+};
+
+static struct wlr_buffer *title_render(struct TitleCache *cache, const char *text, int width,
+	bool focused, float scale)
+{
+	struct TitleBuffer *buffer = calloc(1, sizeof(*buffer));
+	if (buffer == NULL)
+	{
+		return NULL;
+	}
+
+	/* Drawn in logical units on a surface of the output's pixel size. */
+	int buffer_width = ceilf(width * scale);
+	int buffer_height = ceilf(TITLE_HEIGHT * scale);
+	buffer->surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, buffer_width,
+		buffer_height);
+	if (cairo_surface_status(buffer->surface) != CAIRO_STATUS_SUCCESS)
+	{
+		wlr_log(WLR_ERROR, "Failed to allocate a %dx%d title bar", buffer_width,
+			buffer_height);
+		cairo_surface_destroy(buffer->surface);
+		free(buffer);
+		return NULL;
+	}
+
+	const float *color = focused ? cache->focus_color : cache->color;
+	cairo_t *cr = cairo_create(buffer->surface);
+	cairo_scale(cr, scale, scale);
+	cairo_set_source_rgba(cr, color[0], color[1], color[2], color[3]);
+	cairo_paint(cr);
+
+	PangoLayout *layout = pango_cairo_create_layout(cr);
+	pango_layout_set_font_description(layout, cache->font);
+	pango_layout_set_single_paragraph_mode(layout, 1);
+	pango_layout_set_width(layout, (width - 2 * TITLE_PADDING) * PANGO_SCALE);
+	pango_layout_set_ellipsize(layout, PANGO_ELLIPSIZE_END);
+	pango_layout_set_text(layout, text, -1);
+
+	int text_height;
+	pango_layout_get_pixel_size(layout, NULL, &text_height);
+	cairo_set_source_rgba(cr, 1.0, 1.0, 1.0, 1.0);
+	cairo_move_to(cr, TITLE_PADDING, (TITLE_HEIGHT - text_height) / 2);
+	pango_cairo_show_layout(cr, layout);
+
+	g_object_unref(layout);
+	cairo_destroy(cr);
+	cairo_surface_flush(buffer->surface);
+
+	wlr_buffer_init(&buffer->base, &title_buffer_impl, buffer_width, buffer_height);
+	return &buffer->base;
+}
+
+static void title_cache_evict(struct TitleCache *cache, struct TitleCacheEntry *entry)
+{
+	/* Scene nodes hold their own lock, so a title bar still showing this
+	 * buffer keeps it alive until it is replaced. */
+	cache->bytes -= entry->bytes;
+	wl_list_remove(&entry->link);
+	wlr_buffer_drop(entry->buffer);
+	free(entry->text);
+	free(entry);
+}
+
+static struct wlr_buffer *title_cache_get(struct TitleCache *cache, const char *text,
+	int width, bool focused, float scale)
+{
+	struct TitleCacheEntry *entry;
+	wl_list_for_each(entry, &cache->entries, link)
+	{
+		if (entry->width == width && entry->focused == focused && entry->scale == scale &&
+			strcmp(entry->text, text) == 0)
+		{
+			wl_list_remove(&entry->link);
+			wl_list_insert(&cache->entries, &entry->link);
+			cache->hits++;
+			return entry->buffer;
+		}
+	}
+
+	cache->misses++;
+	struct wlr_buffer *buffer = title_render(cache, text, width, focused, scale);
+	entry = calloc(1, sizeof(*entry));
+	if (buffer == NULL || entry == NULL)
+	{
+		if (buffer != NULL)
+		{
+			wlr_buffer_drop(buffer);
+		}
+		free(entry);
+		return NULL;
+	}
+
+	entry->text = strdup(text);
+	entry->width = width;
+	entry->focused = focused;
+	entry->scale = scale;
+	entry->buffer = buffer;
+	entry->bytes = (size_t)buffer->width * buffer->height * 4;
+	wl_list_insert(&cache->entries, &entry->link);
+	cache->bytes += entry->bytes;
+
+	/* The new entry is never evicted, even if it alone is over the limit. */
+	while (cache->bytes > cache->max_bytes && cache->entries.prev != &entry->link)
+	{
+		struct TitleCacheEntry *oldest = wl_container_of(cache->entries.prev, oldest, link);
+		title_cache_evict(cache, oldest);
+		cache->evictions++;
+	}
+	return buffer;
+}
+
+void title_cache_init(struct TitleCache *cache, size_t max_bytes, const char *font,
+	const float color[4], const float focus_color[4])
+{
+	wl_list_init(&cache->entries);
+	cache->bytes = 0;
+	cache->max_bytes = max_bytes;
+	cache->font = pango_font_description_from_string(font);
+	cache->color = color;
+	cache->focus_color = focus_color;
+	cache->hits = cache->misses = cache->evictions = cache->coalesced = 0;
+}
+
+void title_cache_finish(struct TitleCache *cache)
+{
+	if (cache->font == NULL)
+	{
+		return;
+	}
+
+	struct TitleCacheEntry *entry, *tmp;
+	wl_list_for_each_safe(entry, tmp, &cache->entries, link)
+	{
+		title_cache_evict(cache, entry);
+	}
+	pango_font_description_free(cache->font);
+	cache->font = NULL;
+}
+
+void title_cache_write(struct TitleCache *cache, FILE *out)
+{
+	fprintf(out, "entries %d bytes %zu max_bytes %zu\n", wl_list_length(&cache->entries),
+		cache->bytes, cache->max_bytes);
+	fprintf(out, "hits %" PRIu64 " misses %" PRIu64 " evictions %" PRIu64
+		" coalesced %" PRIu64 "\n", cache->hits, cache->misses, cache->evictions,
+		cache->coalesced);
+}
+
+void titlebar_init(struct Titlebar *bar, struct wlr_scene_tree *parent)
+{
+	bar->scene = wlr_scene_buffer_create(parent, NULL);
+	wl_list_init(&bar->dirty_link);
+	bar->dirty = false;
+	bar->text = NULL;
+	bar->width = 0;
+	bar->focused = false;
+	bar->scale = 1.0f;
+}
+
+void titlebar_finish(struct Titlebar *bar)
+{
+	/* The scene buffer goes away with its parent tree. */
+	wl_list_remove(&bar->dirty_link);
+	free(bar->text);
+	bar->text = NULL;
+}
+
+bool titlebar_set(struct TitleCache *cache, struct wl_list *dirty, struct Titlebar *bar,
+	const char *text, int width, bool focused, float scale)
+{
+	if (text == NULL)
+	{
+		text = "";
+	}
+
+	if (bar->text != NULL && strcmp(bar->text, text) == 0 && bar->width == width &&
+		bar->focused == focused && bar->scale == scale)
+	{
+		return false;
+	}
+
+	if (bar->text == NULL || strcmp(bar->text, text) != 0)
+	{
+		free(bar->text);
+		bar->text = strdup(text);
+	}
+	bar->width = width;
+	bar->focused = focused;
+	bar->scale = scale;
+
+	if (bar->dirty)
+	{
+		cache->coalesced++;
+		return false;
+	}
+
+	bar->dirty = true;
+	wl_list_insert(dirty->prev, &bar->dirty_link);
+	return true;
+}
+
+void titlebar_flush(struct TitleCache *cache, struct wl_list *dirty)
+{
+	struct Titlebar *bar, *tmp;
+	wl_list_for_each_safe(bar, tmp, dirty, dirty_link)
+	{
+		struct wlr_buffer *buffer = NULL;
+		if (bar->width > 0 && bar->text != NULL)
+		{
+			buffer = title_cache_get(cache, bar->text, bar->width, bar->focused,
+				bar->scale);
+		}
+		wlr_scene_buffer_set_buffer(bar->scene, buffer);
+		wlr_scene_buffer_set_dest_size(bar->scene, bar->width, TITLE_HEIGHT);
+
+		bar->dirty = false;
+		wl_list_remove(&bar->dirty_link);
+		wl_list_init(&bar->dirty_link);
+	}
+}
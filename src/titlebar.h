@@ -0,0 +1,72 @@
+#ifndef TITLEBAR_H_
+#define TITLEBAR_H_
+
+#include <stdio.h>
+#include <pango/pangocairo.h>
+#include "wayland.h"
+
+#define TITLE_HEIGHT 20
+#define TITLE_CACHE_BYTES (4 << 20)
+
+/*
+ * Server-side title bars. Titles are rendered with pangocairo into
+ * CPU-backed wlr_buffers that are cached by (text, width, focus, scale), so
+ * refocusing a window or going back to a previous title is a lookup. Each
+ * is rendered at the scale of the output the window is on and shown at its
+ * logical size, so text stays sharp on HiDPI outputs. The cache is an LRU
+ * list bounded by the bytes of pixel data it keeps alive; an evicted buffer
+ * lives on for as long as a scene node still shows it.
+ *
+ * Title bars never render on the spot: changes only mark them dirty, and
+ * every dirty title bar is brought up to date once at the start of the next
+ * output frame, however often the client retitled itself in between.
+ */
+struct TitleCacheEntry
+{
+	struct wl_list link;
+	char *text;
+	int width;
+	bool focused;
+	float scale;
+	struct wlr_buffer *buffer;
+	size_t bytes;
+};
+
+struct TitleCache
+{
+	struct wl_list entries; /* TitleCacheEntry.link, most recently used first */
+	size_t bytes;
+	size_t max_bytes;
+	PangoFontDescription *font;
+	const float *color;
+	const float *focus_color;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	uint64_t coalesced; /* changes absorbed by a title bar that was already dirty */
+};
+
+struct Titlebar
+{
+	struct wlr_scene_buffer *scene;
+	struct wl_list dirty_link;
+	bool dirty;
+	char *text;
+	int width; /* logical */
+	bool focused;
+	float scale;
+};
+
+void title_cache_init(struct TitleCache *cache, size_t max_bytes, const char *font,
+	const float color[4], const float focus_color[4]);
+void title_cache_finish(struct TitleCache *cache);
+void title_cache_write(struct TitleCache *cache, FILE *out);
+
+void titlebar_init(struct Titlebar *bar, struct wlr_scene_tree *parent);
+void titlebar_finish(struct Titlebar *bar);
+/* Returns true if the title bar was clean and has now been queued on `dirty`. */
+bool titlebar_set(struct TitleCache *cache, struct wl_list *dirty, struct Titlebar *bar,
+	const char *text, int width, bool focused, float scale);
+void titlebar_flush(struct TitleCache *cache, struct wl_list *dirty);
+
+#endif
@@ -0,0 +1,211 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define TRACE_DEFAULT_EVENTS (1 << 18)
+
+void trace_record(struct Trace *trace, char phase, const char *name, const char *cat,
+	uint32_t tid, uint32_t id, uint64_t ts_ns, uint64_t dur_ns)
+{
+	struct TraceEvent *event = &trace->events[trace->head];
+
+	event->name = name;
+	event->cat = cat;
+	event->phase = phase;
+	event->tid = tid;
+	event->id = id;
+	event->ts_ns = ts_ns;
+	event->dur_ns = dur_ns;
+
+	if (++trace->head == trace->capacity)
+	{
+		trace->head = 0;
+		trace->wrapped = true;
+	}
+}
+
+bool trace_start(struct Trace *trace)
+{
+	if (trace->active)
+	{
+		return true;
+	}
+
+	if (trace->events == NULL)
+	{
+		const char *capacity = getenv("SCOWL_TRACE_EVENTS");
+		trace->capacity = capacity && atoi(capacity) > 0 ?
+			(size_t)atoi(capacity) : TRACE_DEFAULT_EVENTS;
+		trace->events = calloc(trace->capacity, sizeof(*trace->events));
+		if (trace->events == NULL)
+		{
+			wlr_log(WLR_ERROR, "Failed to allocate the trace buffer (%zu events)",
+				trace->capacity);
+			return false;
+		}
+	}
+
+	trace->head = 0;
+	trace->wrapped = false;
+	trace->started_ns = metrics_now_ns();
+	trace->active = true;
+
+	wlr_log(WLR_INFO, "Tracing started (%zu event buffer)", trace->capacity);
+	return true;
+}
+
+static void trace_write_event(FILE *out, struct Trace *trace, struct TraceEvent *event)
+{
+	fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%.3f",
+		event->name, event->cat, event->phase, event->tid,
+		(event->ts_ns - trace->started_ns) / 1e3);
+
+	switch (event->phase)
+	{
+	case 'X':
+		fprintf(out, ",\"dur\":%.3f", event->dur_ns / 1e3);
+		break;
+	case 'i':
+		fputs(",\"s\":\"t\"", out);
+		break;
+	case 'b':
+	case 'e':
+		fprintf(out, ",\"id\":\"%u-%u\"", event->tid, event->id);
+		break;
+	}
+	fputc('}', out);
+}
+
+static void trace_write(struct Trace *trace, FILE *out)
+{
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", out);
+	fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"scowl\"}}", out);
+	fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+		"\"args\":{\"name\":\"compositor\"}}", TRACE_TID_COMPOSITOR);
+
+	struct ClientMetrics *client;
+	wl_list_for_each(client, &trace->metrics->clients, link)
+	{
+		/* app_ids come from clients, so keep only characters that need no
+		 * escaping in JSON. */
+		char name[sizeof(client->app_id)];
+		size_t i;
+		for (i = 0; client->app_id[i] != '\0'; i++)
+		{
+			char c = client->app_id[i];
+			name[i] = (c == '"' || c == '\\' || (unsigned char)c < 0x20) ? '_' : c;
+		}
+		name[i] = '\0';
+
+		fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+			"\"args\":{\"name\":\"%s (pid %d)\"}}", client->id, i ? name : "client",
+			(int)client->pid);
+	}
+
+	size_t start = trace->wrapped ? trace->head : 0;
+	size_t count = trace->wrapped ? trace->capacity : trace->head;
+	for (size_t i = 0; i < count; i++)
+	{
+		trace_write_event(out, trace, &trace->events[(start + i) % trace->capacity]);
+	}
+
+	fputs("\n]}\n", out);
+}
+
+const char *trace_stop(struct Trace *trace)
+{
+	static char path[4096];
+
+	if (!trace->active)
+	{
+		return NULL;
+	}
+	trace->active = false;
+
+	const char *file = getenv("SCOWL_TRACE_FILE");
+	if (file != NULL)
+	{
+		snprintf(path, sizeof(path), "%s", file);
+	} else
+	{
+		const char *dir = getenv("XDG_RUNTIME_DIR");
+		snprintf(path, sizeof(path), "%s/scowl-trace-%d-%u.json",
+			dir ? dir : "/tmp", (int)getpid(), trace->sequence++);
+	}
+
+	FILE *out = fopen(path, "w");
+	if (out == NULL)
+	{
+		wlr_log_errno(WLR_ERROR, "Failed to write trace to %s", path);
+		return NULL;
+	}
+	trace_write(trace, out);
+	fclose(out);
+
+	if (trace->wrapped)
+	{
+		wlr_log(WLR_INFO, "Trace buffer wrapped; only the last %zu events were kept",
+			trace->capacity);
+	}
+	wlr_log(WLR_INFO, "Trace written to %s", path);
+	return path;
+}
+
+void trace_ipc(FILE *out, const char *args, void *data)
+{
+	struct Trace *trace = data;
+
+	if (strcmp(args, "start") == 0)
+	{
+		fprintf(out, trace_start(trace) ? "tracing\n" : "error: could not start tracing\n");
+	} else if (strcmp(args, "stop") == 0)
+	{
+		const char *path = trace_stop(trace);
+		fprintf(out, "%s\n", path ? path : "error: no trace written");
+	} else
+	{
+		fprintf(out, "%s\n", trace->active ? "tracing" : "idle");
+	}
+}
+
+static int trace_handle_signal(int signal_number, void *data)
+{
+	struct Trace *trace = data;
+
+	if (trace->active)
+	{
+		trace_stop(trace);
+	} else
+	{
+		trace_start(trace);
+	}
+	return 0;
+}
+
+void trace_init(struct Trace *trace, struct wl_event_loop *loop, struct Metrics *metrics)
+{
+	memset(trace, 0, sizeof(*trace));
+	trace->metrics = metrics;
+	trace->signal = wl_event_loop_add_signal(loop, SIGUSR2, trace_handle_signal, trace);
+
+	/* Setting the buffer size also records from launch, startup included. */
+	if (getenv("SCOWL_TRACE_EVENTS") != NULL)
+	{
+		trace_start(trace);
+	}
+}
+
+void trace_finish(struct Trace *trace)
+{
+	trace_stop(trace);
+	if (trace->signal != NULL)
+	{
+		wl_event_source_remove(trace->signal);
+	}
+	free(trace->events);
+	trace->events = NULL;
+}
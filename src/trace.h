@@ -0,0 +1,88 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdio.h>
+#include "wayland.h"
+#include "metrics.h"
+
+/*
+ * Timeline recording in the Chrome trace-event format (loadable in
+ * chrome://tracing and ui.perfetto.dev). Events go into a ring buffer that is
+ * allocated once when tracing is first started; recording never allocates,
+ * and the JSON file is only written when the trace is stopped. A trace is
+ * started over IPC, by SIGUSR2, or at launch when SCOWL_TRACE_EVENTS (the
+ * buffer size) is set. Event names and categories must be string literals,
+ * as only the pointers are stored.
+ */
+
+#define TRACE_TID_COMPOSITOR 0
+
+struct TraceEvent
+{
+	const char *name;
+	const char *cat;
+	char phase;
+	uint32_t tid;
+	uint32_t id;
+	uint64_t ts_ns;
+	uint64_t dur_ns;
+};
+
+struct Trace
+{
+	bool active;
+	struct TraceEvent *events;
+	size_t capacity;
+	size_t head;
+	bool wrapped;
+	uint64_t started_ns;
+	unsigned int sequence;
+	struct Metrics *metrics; /* used to name client tracks */
+	struct wl_event_source *signal;
+};
+
+void trace_init(struct Trace *trace, struct wl_event_loop *loop, struct Metrics *metrics);
+void trace_finish(struct Trace *trace);
+bool trace_start(struct Trace *trace);
+/* Writes the recorded events out; returns the path written, or NULL. */
+const char *trace_stop(struct Trace *trace);
+void trace_ipc(FILE *out, const char *args, void *data);
+
+void trace_record(struct Trace *trace, char phase, const char *name, const char *cat,
+	uint32_t tid, uint32_t id, uint64_t ts_ns, uint64_t dur_ns);
+
+static inline uint64_t trace_begin(struct Trace *trace)
+{
+	return trace->active ? metrics_now_ns() : 0;
+}
+
+/* Closes a span opened with trace_begin(). */
+static inline void trace_span(struct Trace *trace, const char *name, const char *cat,
+	uint32_t tid, uint64_t start)
+{
+	if (trace->active && start != 0)
+	{
+		trace_record(trace, 'X', name, cat, tid, 0, start, metrics_now_ns() - start);
+	}
+}
+
+static inline void trace_instant(struct Trace *trace, const char *name, const char *cat,
+	uint32_t tid)
+{
+	if (trace->active)
+	{
+		trace_record(trace, 'i', name, cat, tid, 0, metrics_now_ns(), 0);
+	}
+}
+
+/* Async spans that begin and end in different callbacks, paired by `id`. */
+static inline void trace_async(struct Trace *trace, char phase, const char *name,
+	const char *cat, uint32_t tid, uint32_t id)
+{
+	if (trace->active)
+	{
+		trace_record(trace, phase, name, cat, tid, id, metrics_now_ns(), 0);
+	}
+}
+
+#endif
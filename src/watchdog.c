@@ -0,0 +1,103 @@
+#include <errno.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "watchdog.h"
+#include "metrics.h"
+#include "profile.h"
+
+#define BACKTRACE_DEPTH 64
+
+static void watchdog_handle_sigprof(int sig)
+{
+	/* Runs on the stalled main thread, so this is where it is stuck. */
+	static const char header[] = "scowl: event loop stalled here:\n";
+	void *frames[BACKTRACE_DEPTH];
+	int depth = backtrace(frames, BACKTRACE_DEPTH);
+
+	/* A non-blocking stderr that is full only loses this report; any other
+	 * error means there is nowhere to write the backtrace either. */
+	int saved_errno = errno;
+	if (write(STDERR_FILENO, header, sizeof(header) - 1) >= 0 || errno == EAGAIN)
+	{
+		backtrace_symbols_fd(frames, depth, STDERR_FILENO);
+	}
+	errno = saved_errno;
+}
+
+static void *watchdog_thread(void *data)
+{
+	struct Watchdog *watchdog = data;
+	struct timespec interval = {
+		.tv_sec = watchdog->timeout_ms / 2000,
+		.tv_nsec = (watchdog->timeout_ms % 2000) * 500000l,
+	};
+	uint64_t timeout_ns = watchdog->timeout_ms * 1000000ull;
+	uint64_t reported = 0;
+
+	while (atomic_load(&watchdog->running))
+	{
+		nanosleep(&interval, NULL);
+
+		uint64_t start = atomic_load_explicit(&watchdog->dispatch_start_ns,
+			memory_order_relaxed);
+		if (start == 0 || start == reported)
+		{
+			continue;
+		}
+
+		uint64_t stalled = metrics_now_ns() - start;
+		if (stalled > timeout_ns)
+		{
+			/* Report each stalled dispatch once, not every half timeout. */
+			const char *listener = profile_current();
+			reported = start;
+			atomic_fetch_add(&watchdog->stalls, 1);
+			wlr_log(WLR_ERROR, "Event loop has not iterated for %.1fms (in %s)",
+				stalled / 1e6, listener ? listener : "unknown listener");
+			pthread_kill(watchdog->main_thread, SIGPROF);
+		}
+	}
+
+	return NULL;
+}
+
+bool watchdog_start(struct Watchdog *watchdog, int timeout_ms)
+{
+	memset(watchdog, 0, sizeof(*watchdog));
+	watchdog->timeout_ms = timeout_ms;
+	watchdog->main_thread = pthread_self();
+
+	/* backtrace() loads libgcc on first use, which is not something to do
+	 * from a signal handler. */
+	void *frame;
+	backtrace(&frame, 1);
+
+	struct sigaction sa = { .sa_handler = watchdog_handle_sigprof, .sa_flags = SA_RESTART };
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGPROF, &sa, NULL);
+
+	atomic_store(&watchdog->running, true);
+	if (pthread_create(&watchdog->thread, NULL, watchdog_thread, watchdog) != 0)
+	{
+		wlr_log(WLR_ERROR, "Failed to start the event-loop watchdog");
+		atomic_store(&watchdog->running, false);
+		return false;
+	}
+
+	wlr_log(WLR_INFO, "Event-loop watchdog armed with a %ims timeout", timeout_ms);
+	return true;
+}
+
+void watchdog_stop(struct Watchdog *watchdog)
+{
+	if (!atomic_exchange(&watchdog->running, false))
+	{
+		return;
+	}
+
+	pthread_join(watchdog->thread, NULL);
+	signal(SIGPROF, SIG_DFL);
+}
@@ -0,0 +1,37 @@
+#ifndef WATCHDOG_H_
+#define WATCHDOG_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "wayland.h"
+
+/*
+ * Detects event-loop stalls. The main loop brackets every dispatch with
+ * watchdog_dispatch_begin/end; a helper thread wakes up every half timeout and
+ * complains when a single dispatch has been running for longer than the
+ * timeout. Time spent waiting for events is never counted as a stall.
+ */
+struct Watchdog
+{
+	int timeout_ms;
+	pthread_t thread;
+	pthread_t main_thread;
+	_Atomic bool running;
+	_Atomic uint64_t dispatch_start_ns;
+	_Atomic uint64_t stalls;
+};
+
+bool watchdog_start(struct Watchdog *watchdog, int timeout_ms);
+void watchdog_stop(struct Watchdog *watchdog);
+
+static inline void watchdog_dispatch_begin(struct Watchdog *watchdog, uint64_t now)
+{
+	atomic_store_explicit(&watchdog->dispatch_start_ns, now, memory_order_relaxed);
+}
+
+static inline void watchdog_dispatch_end(struct Watchdog *watchdog)
+{
+	atomic_store_explicit(&watchdog->dispatch_start_ns, 0, memory_order_relaxed);
+}
+
+#endif